@@ -15,6 +15,7 @@
 #include "app/check_update.h"
 #include "app/cli/app_options.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_server.h"
 #include "app/cli/default_cli_delegate.h"
 #include "app/cli/preview_cli_delegate.h"
 #include "app/color_spaces.h"
@@ -265,6 +266,8 @@ int App::initialize(const AppOptions& options)
 #endif
 
   m_isShell = options.startShell();
+  if (options.startServer())
+    m_server = std::make_unique<CliServer>(options.exeName());
   m_coreModules = std::make_unique<CoreModules>();
 
   auto& pref = preferences();
@@ -574,6 +577,11 @@ void App::run()
   }
 #endif  // ENABLE_SCRIPTING
 
+  // Process CLI requests from stdin (all modules, preferences,
+  // extensions, and the scripting engine are already loaded).
+  if (m_server)
+    m_server->run(context(), std::cin, std::cout);
+
   // ----------------------------------------------------------------------
 
 #ifdef ENABLE_SCRIPTING
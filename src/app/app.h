@@ -37,6 +37,7 @@ namespace app {
   class AppMod;
   class AppOptions;
   class BackupIndicator;
+  class CliServer;
   class Context;
   class ContextBar;
   class Doc;
@@ -137,6 +138,7 @@ namespace app {
     std::unique_ptr<LegacyModules> m_legacy;
     bool m_isGui;
     bool m_isShell;
+    std::unique_ptr<CliServer> m_server;
 #ifdef ENABLE_STEAM
     bool m_inAppSteam = true;
 #endif
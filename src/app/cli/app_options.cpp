@@ -21,6 +21,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
   , m_previewCLI(false)
   , m_showHelp(false)
   , m_showVersion(false)
@@ -29,7 +30,9 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_server(m_po.add("server").description("Do not start the UI, process CLI requests\n(one per line) from stdin"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
+  , m_jobs(m_po.add("jobs").requiresValue("<n>").description("Save files in <n> threads in parallel\n(0 = number of CPU cores)"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previously opened sprites"))
@@ -42,10 +45,12 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_sheet(m_po.add("sheet").requiresValue("<filename.png>").description("Image file to save the texture"))
   , m_sheetType(m_po.add("sheet-type").requiresValue("<type>").description("Algorithm to create the sprite sheet:\n  horizontal\n  vertical\n  rows\n  columns\n  packed"))
   , m_sheetPack(m_po.add("sheet-pack").description("Same as -sheet-type packed"))
+  , m_sheetPackAlgorithm(m_po.add("sheet-pack-algorithm").requiresValue("<algorithm>").description("Algorithm to pack sprites with -sheet-type packed:\n  bestfit\n  maxrects\n  skyline"))
   , m_sheetWidth(m_po.add("sheet-width").requiresValue("<pixels>").description("Sprite sheet width"))
   , m_sheetHeight(m_po.add("sheet-height").requiresValue("<pixels>").description("Sprite sheet height"))
   , m_sheetColumns(m_po.add("sheet-columns").requiresValue("<columns>").description("Fixed # of columns for -sheet-type rows"))
   , m_sheetRows(m_po.add("sheet-rows").requiresValue("<rows>").description("Fixed # of rows for -sheet-type columns"))
+  , m_sheetCache(m_po.add("sheet-cache").requiresValue("<directory>").description("Directory to cache the rendered frames\nbetween runs to export only modified frames"))
   , m_splitLayers(m_po.add("split-layers").description("Save each visible layer of sprites\nas separated images in the sheet\n"))
   , m_splitTags(m_po.add("split-tags").description("Save each tag as a separated file"))
   , m_splitSlices(m_po.add("split-slices").description("Save each slice as a separated file"))
@@ -101,11 +106,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #ifdef ENABLE_SCRIPTING
     m_startShell = m_po.enabled(m_shell);
 #endif
+    m_startServer = m_po.enabled(m_server);
     m_previewCLI = m_po.enabled(m_preview);
     m_showHelp = m_po.enabled(m_help);
     m_showVersion = m_po.enabled(m_version);
 
     if (m_startShell ||
+        m_startServer ||
         m_showHelp ||
         m_showVersion ||
         m_po.enabled(m_batch)) {
@@ -126,6 +133,39 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+bool AppOptions::hasOnlyListParams() const
+{
+  if (m_startUI || m_startShell)
+    return false;
+
+  bool list = false;
+  for (const auto& value : m_po.values()) {
+    const Option* opt = value.option();
+    if (!opt)                   // File names
+      continue;
+
+    if (opt == &m_listLayers ||
+        opt == &m_listLayerHierarchy ||
+        opt == &m_listTags ||
+        opt == &m_listSlices) {
+      list = true;
+    }
+    // Any other option that might need the pixels of cels
+    else if (opt != &m_batch &&
+             opt != &m_preview &&
+             opt != &m_jobs &&
+             opt != &m_layer &&
+             opt != &m_allLayers &&
+             opt != &m_ignoreLayer &&
+             opt != &m_oneFrame &&
+             opt != &m_verbose &&
+             opt != &m_debug) {
+      return false;
+    }
+  }
+  return list;
+}
+
 #ifdef ENABLE_STEAM
 bool AppOptions::noInApp() const
 {
@@ -36,6 +36,7 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
   bool previewCLI() const { return m_previewCLI; }
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
@@ -46,6 +47,7 @@ public:
   }
 
   // Export options
+  const Option& jobs() const { return m_jobs; }
   const Option& saveAs() const { return m_saveAs; }
   const Option& palette() const { return m_palette; }
   const Option& scale() const { return m_scale; }
@@ -58,10 +60,12 @@ public:
   const Option& sheet() const { return m_sheet; }
   const Option& sheetType() const { return m_sheetType; }
   const Option& sheetPack() const { return m_sheetPack; }
+  const Option& sheetPackAlgorithm() const { return m_sheetPackAlgorithm; }
   const Option& sheetWidth() const { return m_sheetWidth; }
   const Option& sheetHeight() const { return m_sheetHeight; }
   const Option& sheetColumns() const { return m_sheetColumns; }
   const Option& sheetRows() const { return m_sheetRows; }
+  const Option& sheetCache() const { return m_sheetCache; }
   const Option& splitLayers() const { return m_splitLayers; }
   const Option& splitTags() const { return m_splitTags; }
   const Option& splitSlices() const { return m_splitSlices; }
@@ -97,6 +101,9 @@ public:
   const Option& exportTileset() const { return m_exportTileset; }
 
   bool hasExporterParams() const;
+  // True if the files are opened just to list their layers, tags,
+  // or slices (so cels don't need to be loaded).
+  bool hasOnlyListParams() const;
 #ifdef ENABLE_STEAM
   bool noInApp() const;
 #endif
@@ -111,6 +118,7 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
   bool m_previewCLI;
   bool m_showHelp;
   bool m_showVersion;
@@ -120,7 +128,9 @@ private:
   Option& m_shell;
 #endif
   Option& m_batch;
+  Option& m_server;
   Option& m_preview;
+  Option& m_jobs;
   Option& m_saveAs;
   Option& m_palette;
   Option& m_scale;
@@ -133,10 +143,12 @@ private:
   Option& m_sheet;
   Option& m_sheetType;
   Option& m_sheetPack;
+  Option& m_sheetPackAlgorithm;
   Option& m_sheetWidth;
   Option& m_sheetHeight;
   Option& m_sheetColumns;
   Option& m_sheetRows;
+  Option& m_sheetCache;
   Option& m_splitLayers;
   Option& m_splitTags;
   Option& m_splitSlices;
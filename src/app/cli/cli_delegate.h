@@ -27,6 +27,7 @@ namespace app {
     virtual void uiMode() { }
     virtual void shellMode() { }
     virtual void batchMode() { }
+    virtual void setJobs(const int jobs) { }
     virtual void beforeOpenFile(const CliOpenFile& cof) { }
     virtual void afterOpenFile(const CliOpenFile& cof) { }
     virtual void saveFile(Context* ctx, const CliOpenFile& cof) { }
@@ -38,6 +38,7 @@
 
 #include <algorithm>
 #include <queue>
+#include <thread>
 #include <vector>
 
 namespace app {
@@ -165,6 +166,7 @@ CliProcessor::CliProcessor(CliDelegate* delegate,
   : m_delegate(delegate)
   , m_options(options)
   , m_exporter(nullptr)
+  , m_metadataOnly(options.hasOnlyListParams())
 {
   if (options.hasExporterParams())
     m_exporter.reset(new DocExporter);
@@ -197,8 +199,15 @@ int CliProcessor::process(Context* ctx)
 
       // Special options/commands
       if (opt) {
+        // --jobs <n>
+        if (opt == &m_options.jobs()) {
+          int jobs = strtol(value.value().c_str(), nullptr, 0);
+          if (jobs <= 0)
+            jobs = std::max(1, int(std::thread::hardware_concurrency()));
+          m_delegate->setJobs(jobs);
+        }
         // --data <file.json>
-        if (opt == &m_options.data()) {
+        else if (opt == &m_options.data()) {
           if (m_exporter)
             m_exporter->setDataFilename(value.value());
         }
@@ -240,6 +249,11 @@ int CliProcessor::process(Context* ctx)
           if (m_exporter)
             m_exporter->setTextureRows(strtol(value.value().c_str(), nullptr, 0));
         }
+        // --sheet-cache <directory>
+        else if (opt == &m_options.sheetCache()) {
+          if (m_exporter)
+            m_exporter->setCacheDirectory(base::normalize_path(value.value()));
+        }
         // --sheet-type <sheet-type>
         else if (opt == &m_options.sheetType()) {
           if (value.value() == "horizontal")
@@ -257,6 +271,24 @@ int CliProcessor::process(Context* ctx)
         else if (opt == &m_options.sheetPack()) {
           sheetType = SpriteSheetType::Packed;
         }
+        // --sheet-pack-algorithm <algorithm>
+        else if (opt == &m_options.sheetPackAlgorithm()) {
+          SpriteSheetPackAlgorithm algorithm;
+          if (value.value() == "bestfit")
+            algorithm = SpriteSheetPackAlgorithm::BestFit;
+          else if (value.value() == "maxrects")
+            algorithm = SpriteSheetPackAlgorithm::MaxRects;
+          else if (value.value() == "skyline")
+            algorithm = SpriteSheetPackAlgorithm::Skyline;
+          else
+            throw std::runtime_error("--sheet-pack-algorithm needs a valid algorithm name\n"
+                                     "Usage: --sheet-pack-algorithm <algorithm>\n"
+                                     "Where <algorithm> can be bestfit, maxrects, or skyline");
+
+          sheetType = SpriteSheetType::Packed;
+          if (m_exporter)
+            m_exporter->setPackAlgorithm(algorithm);
+        }
         // --split-layers
         else if (opt == &m_options.splitLayers()) {
           cof.splitLayers = true;
@@ -654,7 +686,8 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   m_batch.open(ctx,
                cof.filename,
-               cof.oneFrame);
+               cof.oneFrame,
+               m_metadataOnly);
 
   // Mark used file names as "already processed" so we don't try to
   // open then again
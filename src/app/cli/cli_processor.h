@@ -61,6 +61,9 @@ namespace app {
     const AppOptions& m_options;
     std::unique_ptr<DocExporter> m_exporter;
 
+    // Open files without cels (only to list layers/tags/slices)
+    bool m_metadataOnly;
+
     // Files already used in the CLI processing (e.g. when used to
     // load a sequence of files) so we don't ask for them again.
     std::set<std::string> m_usedFiles;
@@ -0,0 +1,141 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_server.h"
+
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+#include "app/cli/preview_cli_delegate.h"
+#include "app/context.h"
+#include "app/doc.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace app {
+
+CliServer::CliServer(const std::string& exeName)
+  : m_exeName(exeName)
+{
+}
+
+void CliServer::run(Context* ctx, std::istream& is, std::ostream& os)
+{
+  std::string line;
+  while (std::getline(is, line)) {
+    const std::vector<std::string> args = split_cli_args(line);
+    if (args.empty())
+      continue;
+    if (args.size() == 1 && args[0] == "exit")
+      break;
+
+    const int code = processRequest(ctx, args);
+
+    // Flush stdout/stderr so the client gets the whole output of the
+    // request before the "done" line.
+    std::cerr.flush();
+    os << "done " << code << std::endl;
+  }
+}
+
+int CliServer::processRequest(Context* ctx,
+                              const std::vector<std::string>& args)
+{
+  // Requests are always processed in batch mode
+  std::vector<const char*> argv;
+  argv.push_back(m_exeName.c_str());
+  argv.push_back("--batch");
+  for (const std::string& arg : args)
+    argv.push_back(arg.c_str());
+
+  const std::vector<Doc*> oldDocs(ctx->documents().begin(),
+                                  ctx->documents().end());
+  int code = 0;
+  try {
+    AppOptions options(int(argv.size()), &argv[0]);
+
+    // The delegate is destroyed before closing the documents to
+    // wait the files that are saved in background (--jobs).
+    std::unique_ptr<CliDelegate> delegate;
+    if (options.previewCLI())
+      delegate.reset(new PreviewCliDelegate);
+    else
+      delegate.reset(new DefaultCliDelegate);
+
+    CliProcessor cli(delegate.get(), options);
+    code = cli.process(ctx);
+  }
+  catch (const std::exception& ex) {
+    std::cerr << m_exeName << ": " << ex.what() << '\n';
+    code = 1;
+  }
+
+  // Close documents opened by this request
+  const std::vector<Doc*> docs(ctx->documents().begin(),
+                               ctx->documents().end());
+  for (Doc* doc : docs) {
+    if (std::find(oldDocs.begin(), oldDocs.end(), doc) == oldDocs.end()) {
+      doc->close();
+      delete doc;
+    }
+  }
+  return code;
+}
+
+static bool is_escaped_char(const char chr)
+{
+  return (chr == '"' || chr == '\'' || chr == '\\' || chr == ' ');
+}
+
+std::vector<std::string> split_cli_args(const std::string& line)
+{
+  std::vector<std::string> args;
+  std::string arg;
+  bool hasArg = false;
+  char quote = 0;
+
+  for (auto it=line.begin(), end=line.end(); it != end; ++it) {
+    const char chr = *it;
+    if (quote) {
+      if (chr == quote)
+        quote = 0;
+      else if (chr == '\\' && quote == '"' && it+1 != end && is_escaped_char(*(it+1)))
+        arg.push_back(*(++it));
+      else
+        arg.push_back(chr);
+    }
+    else if (chr == '"' || chr == '\'') {
+      quote = chr;
+      hasArg = true;
+    }
+    else if (chr == '\\' && it+1 != end && is_escaped_char(*(it+1))) {
+      arg.push_back(*(++it));
+      hasArg = true;
+    }
+    else if (chr == ' ' || chr == '\t' || chr == '\r') {
+      if (hasArg) {
+        args.push_back(arg);
+        arg.clear();
+        hasArg = false;
+      }
+    }
+    else {
+      arg.push_back(chr);
+      hasArg = true;
+    }
+  }
+  if (hasArg)
+    args.push_back(arg);
+  return args;
+}
+
+} // namespace app
@@ -0,0 +1,53 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_SERVER_H_INCLUDED
+#define APP_CLI_CLI_SERVER_H_INCLUDED
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+
+  // Batch server started with --server. It reads requests from the
+  // input stream, one request per line with the same arguments that
+  // can be used in the command line (e.g. "file.aseprite --save-as
+  // file.png"), and processes each one of them in batch mode with a
+  // CliProcessor. This avoids paying the whole program startup
+  // (preferences, extensions, palettes, scripting engine, etc.) for
+  // each request.
+  //
+  // When a request is completed, a "done <code>" line is written in
+  // the output stream, so the client knows that all output files
+  // were saved. Documents opened by a request are closed after it.
+  // The server stops with an "exit" line or at the end of the input.
+  class CliServer {
+  public:
+    CliServer(const std::string& exeName);
+
+    void run(Context* ctx, std::istream& is, std::ostream& os);
+
+  private:
+    int processRequest(Context* ctx,
+                       const std::vector<std::string>& args);
+
+    std::string m_exeName;
+  };
+
+  // Splits a request line in arguments. Arguments are separated by
+  // spaces, and can be quoted with double or single quotes. A
+  // backslash escapes the next quote, space or backslash (except
+  // inside single quotes), other backslashes are kept as they are
+  // (e.g. Windows paths).
+  std::vector<std::string> split_cli_args(const std::string& line);
+
+} // namespace app
+
+#endif
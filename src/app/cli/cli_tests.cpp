@@ -9,6 +9,7 @@
 
 #include "app/cli/app_options.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_server.h"
 #include "app/doc_exporter.h"
 
 #include <initializer_list>
@@ -93,3 +94,18 @@ TEST(Cli, Version)
   p.process(nullptr);
   EXPECT_TRUE(d.versionWasShown());
 }
+
+TEST(Cli, SplitServerRequest)
+{
+  typedef std::vector<std::string> V;
+  EXPECT_EQ(V(), split_cli_args(""));
+  EXPECT_EQ(V(), split_cli_args("  \t "));
+  EXPECT_EQ(V({ "a.aseprite", "--save-as", "b.png" }),
+            split_cli_args("a.aseprite  --save-as b.png\r"));
+  EXPECT_EQ(V({ "my file.aseprite", "--save-as", "{tag} it's.png" }),
+            split_cli_args("\"my file.aseprite\" --save-as '{tag} it'\\''s.png'"));
+  EXPECT_EQ(V({ "a b", "\"", "" }),
+            split_cli_args("a\\ b \"\\\"\" ''"));
+  EXPECT_EQ(V({ "C:\\dir\\file.png" }),
+            split_cli_args("C:\\dir\\file.png"));
+}
@@ -13,13 +13,19 @@
 
 #include "app/cli/app_options.h"
 #include "app/cli/cli_open_file.h"
+#include "app/cli/parallel_saver.h"
+#include "app/commands/cmd_save_file.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
 #include "app/console.h"
 #include "app/doc.h"
 #include "app/doc_exporter.h"
+#include "app/file/file.h"
 #include "app/file/palette_file.h"
+#include "app/site.h"
+#include "app/ui/layer_frame_comboboxes.h"
 #include "app/ui_context.h"
+#include "app/util/doc_snapshot.h"
 #include "base/convert_to.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
@@ -40,6 +46,16 @@
 
 namespace app {
 
+DefaultCliDelegate::DefaultCliDelegate()
+{
+}
+
+DefaultCliDelegate::~DefaultCliDelegate()
+{
+  // Wait files that are still being saved
+  m_saver.reset();
+}
+
 void DefaultCliDelegate::showHelp(const AppOptions& options)
 {
   std::cout
@@ -59,6 +75,20 @@ void DefaultCliDelegate::showVersion()
   std::cout << get_app_name() << ' ' << get_app_version() << '\n';
 }
 
+void DefaultCliDelegate::setJobs(const int jobs)
+{
+  m_saver.reset();
+  if (jobs > 1)
+    m_saver = std::make_unique<ParallelSaver>(jobs);
+}
+
+void DefaultCliDelegate::beforeOpenFile(const CliOpenFile& cof)
+{
+  // We cannot open a file that is still being saved
+  if (m_saver)
+    m_saver->waitFile(cof.filename);
+}
+
 void DefaultCliDelegate::afterOpenFile(const CliOpenFile& cof)
 {
   if (!cof.document)            // Do nothing
@@ -86,6 +116,11 @@ void DefaultCliDelegate::afterOpenFile(const CliOpenFile& cof)
 
 void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
 {
+  if (m_saver) {
+    saveFileInBackground(ctx, cof);
+    return;
+  }
+
   Command* saveAsCommand = Commands::instance()->byId(CommandId::SaveFileCopyAs());
   Params params;
   params.set("filename", cof.filename.c_str());
@@ -111,6 +146,48 @@ void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
   ctx->executeCommand(saveAsCommand, params);
 }
 
+// Does the same as the SaveFileCopyAs command in batch mode, but
+// the file is saved from a snapshot of the document in a background
+// thread, so the CLI can continue processing the next files or split
+// variants (which can change the visible layers, trim the sprite,
+// etc.) while the file is being encoded.
+void DefaultCliDelegate::saveFileInBackground(Context* ctx, const CliOpenFile& cof)
+{
+  Doc* doc = cof.document;
+  std::unique_ptr<Doc> snapshot(make_doc_snapshot(doc));
+
+  // Same frames/tag as the serial SaveFileCopyAs command
+  doc::FramesSequence framesSeq;
+  if (cof.hasFrameRange())
+    framesSeq.insert(cof.fromFrame, cof.toFrame);
+
+  std::string tagName = cof.tag;
+  Site site;
+  site.document(snapshot.get());
+  site.sprite(snapshot->sprite());
+  calculate_copy_frames_sequence(site, kAllFrames,
+                                 cof.playSubtags, doc::AniDir::FORWARD,
+                                 framesSeq, tagName);
+
+  FileOpROI roi(snapshot.get(),
+                snapshot->sprite()->bounds(),
+                cof.slice,
+                tagName,
+                framesSeq,
+                false);
+
+  std::unique_ptr<FileOp> fop(
+    FileOp::createSaveDocumentOperation(
+      ctx, roi,
+      cof.filename,
+      cof.filenameFormat,
+      cof.ignoreEmpty));
+  if (!fop)
+    return;
+
+  m_saver->save(cof.filename, std::move(snapshot), std::move(fop));
+}
+
 void DefaultCliDelegate::loadPalette(Context* ctx,
                                      const std::string& filename)
 {
@@ -130,6 +207,9 @@ void DefaultCliDelegate::loadPalette(Context* ctx,
 
 void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
+  if (m_saver)
+    m_saver->waitAll();
+
   LOG("APP: Exporting sheet...\n");
 
   base::task_token token;
@@ -145,6 +225,10 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 int DefaultCliDelegate::execScript(const std::string& filename,
                                    const Params& params)
 {
+  // Scripts can read the saved files
+  if (m_saver)
+    m_saver->waitAll();
+
   ScriptInputChain scriptInputChain;
   if (!App::instance()->isGui()) {
     App::instance()->inputChain().prioritize(&scriptInputChain, nullptr);
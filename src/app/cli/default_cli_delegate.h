@@ -11,12 +11,20 @@
 
 #include "app/cli/cli_delegate.h"
 
+#include <memory>
+
 namespace app {
+  class ParallelSaver;
 
   class DefaultCliDelegate : public CliDelegate {
   public:
+    DefaultCliDelegate();
+    ~DefaultCliDelegate();
+
     void showHelp(const AppOptions& programOptions) override;
     void showVersion() override;
+    void setJobs(const int jobs) override;
+    void beforeOpenFile(const CliOpenFile& cof) override;
     void afterOpenFile(const CliOpenFile& cof) override;
     void saveFile(Context* ctx, const CliOpenFile& cof) override;
     void loadPalette(Context* ctx, const std::string& filename) override;
@@ -25,6 +33,12 @@ namespace app {
     int execScript(const std::string& filename,
                    const Params& params) override;
 #endif
+
+  private:
+    void saveFileInBackground(Context* ctx, const CliOpenFile& cof);
+
+    // Used to save files in parallel with --jobs
+    std::unique_ptr<ParallelSaver> m_saver;
   };
 
 } // namespace app
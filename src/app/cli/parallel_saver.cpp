@@ -0,0 +1,113 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/parallel_saver.h"
+
+#include "app/console.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace app {
+
+struct ParallelSaver::Item {
+  std::string filename;
+  std::unique_ptr<Doc> doc;
+  std::unique_ptr<FileOp> fop;
+  int job = 0;                  // Index of the job in m_pool
+};
+
+ParallelSaver::ParallelSaver(const int jobs)
+  : m_jobs(std::max(1, jobs))
+  , m_pool(m_jobs)
+{
+}
+
+ParallelSaver::~ParallelSaver()
+{
+  waitAll();
+}
+
+void ParallelSaver::save(const std::string& filename,
+                         std::unique_ptr<Doc>&& doc,
+                         std::unique_ptr<FileOp>&& fop)
+{
+  // Two operations over the same file must finish in the same order
+  // as the serial version.
+  waitFile(filename);
+
+  auto item = std::make_shared<Item>();
+  item->filename = filename;
+  item->doc = std::move(doc);
+  item->fop = std::move(fop);
+  item->job = m_pool.add([fop = item->fop.get()]{
+    try {
+      fop->operate(nullptr);
+    }
+    catch (const std::exception& e) {
+      fop->setError("Error saving file:\n%s", e.what());
+    }
+    fop->done();
+  });
+  m_items.push_back(item);
+
+  // Limit the number of snapshots in memory
+  const int maxItems = 2*jobs();
+  if (int(m_items.size()) > maxItems)
+    waitItems(int(m_items.size()) - maxItems);
+  else
+    reportFinishedItems();
+}
+
+void ParallelSaver::waitFile(const std::string& filename)
+{
+  int n = 0;
+  for (int i=0; i<int(m_items.size()); ++i) {
+    if (m_items[i]->filename == filename)
+      n = i+1;
+  }
+  if (n > 0)
+    waitItems(n);
+}
+
+void ParallelSaver::waitAll()
+{
+  waitItems(int(m_items.size()));
+}
+
+void ParallelSaver::waitItems(const int n)
+{
+  for (int i=0; i<n && i<int(m_items.size()); ++i)
+    m_pool.wait(m_items[i]->job);
+  reportFinishedItems();
+}
+
+void ParallelSaver::reportFinishedItems()
+{
+  std::vector<ItemPtr> finished;
+  while (!m_items.empty() && m_pool.isDone(m_items.front()->job)) {
+    finished.push_back(m_items.front());
+    m_items.pop_front();
+  }
+
+  // Errors are printed (and documents deleted) in the main thread
+  for (ItemPtr& item : finished) {
+    if (item->fop->hasError()) {
+      Console console;
+      console.printf(item->fop->error().c_str());
+    }
+    item->fop.reset();
+    item->doc.reset();
+  }
+}
+
+} // namespace app
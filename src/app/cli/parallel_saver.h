@@ -0,0 +1,66 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_PARALLEL_SAVER_H_INCLUDED
+#define APP_CLI_PARALLEL_SAVER_H_INCLUDED
+#pragma once
+
+#include "doc/ordered_jobs.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace app {
+  class Doc;
+  class FileOp;
+
+  // Saves documents in N worker threads of a doc::OrderedJobs pool
+  // (used by the CLI --jobs option). Each save operation owns its document (generally a
+  // snapshot created with make_doc_snapshot()), so the original
+  // document can be modified while the file is being encoded.
+  //
+  // All functions must be called from the main thread. Errors are
+  // printed in the same order the files were queued.
+  class ParallelSaver {
+  public:
+    ParallelSaver(const int jobs);
+    ~ParallelSaver();
+
+    int jobs() const { return m_jobs; }
+
+    // Queues the save operation "fop" of the given document to the
+    // given filename. If there are too many pending operations it
+    // waits the oldest ones.
+    void save(const std::string& filename,
+              std::unique_ptr<Doc>&& doc,
+              std::unique_ptr<FileOp>&& fop);
+
+    // Waits all pending operations that are saving the given file.
+    void waitFile(const std::string& filename);
+
+    // Waits all pending operations.
+    void waitAll();
+
+  private:
+    struct Item;
+    typedef std::shared_ptr<Item> ItemPtr;
+
+    void waitItems(const int n);
+    void reportFinishedItems();
+
+    int m_jobs;
+    // Queued items in order (used to report errors in order)
+    std::deque<ItemPtr> m_items;
+    // Saving operations run as jobs, so nested parallel operations
+    // (e.g. OrderedJobs::calcThreads() to encode a GIF file) run in
+    // the same worker thread.
+    doc::OrderedJobs m_pool;
+  };
+
+} // namespace app
+
+#endif
@@ -52,6 +52,11 @@ void PreviewCliDelegate::batchMode()
   std::cout << "- Exit\n";
 }
 
+void PreviewCliDelegate::setJobs(const int jobs)
+{
+  std::cout << "- Save files using " << jobs << " thread(s)\n";
+}
+
 void PreviewCliDelegate::beforeOpenFile(const CliOpenFile& cof)
 {
   std::cout << "- Open file '" << cof.filename << "'\n";
@@ -193,8 +198,24 @@ void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 
   gfx::Size size = exporter.calculateSheetSize();
   std::cout << "- Export sprite sheet:\n"
-            << "  - Type: " << type << "\n"
-            << "  - Size: " << size.w << "x" << size.h << "\n";
+            << "  - Type: " << type << "\n";
+
+  if (exporter.spriteSheetType() == SpriteSheetType::Packed) {
+    std::string algorithm = "Best Fit";
+    switch (exporter.packAlgorithm()) {
+      case SpriteSheetPackAlgorithm::BestFit:  algorithm = "Best Fit"; break;
+      case SpriteSheetPackAlgorithm::MaxRects: algorithm = "MaxRects"; break;
+      case SpriteSheetPackAlgorithm::Skyline:  algorithm = "Skyline";  break;
+    }
+    std::cout << "  - Pack algorithm: " << algorithm << "\n";
+  }
+
+  std::cout << "  - Size: " << size.w << "x" << size.h << "\n";
+
+  if (!exporter.cacheDirectory().empty()) {
+    std::cout << "  - Cache directory: '"
+              << exporter.cacheDirectory() << "'\n";
+  }
 
   if (!exporter.textureFilename().empty()) {
     std::cout << "  - Save texture file: '"
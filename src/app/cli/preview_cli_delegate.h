@@ -26,6 +26,7 @@ namespace app {
     void uiMode() override;
     void shellMode() override;
     void batchMode() override;
+    void setJobs(const int jobs) override;
     void beforeOpenFile(const CliOpenFile& cof) override;
     void afterOpenFile(const CliOpenFile& cof) override;
     void saveFile(Context* ctx, const CliOpenFile& cof) override;
@@ -468,6 +468,8 @@ private:
       }
     }
 
+    // Pixels of the preview image were modified by the thread
+    m_image->incrementVersion();
     m_editor->invalidate();
   }
 
@@ -79,6 +79,7 @@ OpenFileCommand::OpenFileCommand()
   , m_ui(true)
   , m_repeatCheckbox(false)
   , m_oneFrame(false)
+  , m_metadataOnly(false)
   , m_seqDecision(gen::SequenceDecision::ASK)
 {
 }
@@ -95,9 +96,11 @@ void OpenFileCommand::onLoadParams(const Params& params)
 
   m_repeatCheckbox = params.get_as<bool>("repeat_checkbox");
   m_oneFrame = params.get_as<bool>("oneframe");
+  m_metadataOnly = params.get_as<bool>("metadataonly");
 
   std::string sequence = params.get("sequence");
   if (m_oneFrame ||
+      m_metadataOnly ||
       sequence == "skip" ||
       sequence == "no") {
     m_seqDecision = gen::SequenceDecision::NO;
@@ -179,6 +182,9 @@ void OpenFileCommand::onExecute(Context* context)
   if (m_oneFrame)
     flags |= FILE_LOAD_ONE_FRAME;
 
+  if (m_metadataOnly)
+    flags |= FILE_LOAD_METADATA_ONLY;
+
   std::string filename;
   while (!filenames.empty()) {
     filename = filenames[0];
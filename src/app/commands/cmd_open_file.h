@@ -41,6 +41,7 @@ namespace app {
     bool m_ui;
     bool m_repeatCheckbox;
     bool m_oneFrame;
+    bool m_metadataOnly;
     base::paths m_usedFiles;
     gen::SequenceDecision m_seqDecision;
   };
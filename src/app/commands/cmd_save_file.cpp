@@ -492,17 +492,11 @@ void SaveFileCopyAsCommand::onExecute(Context* context)
                                layersVisibility);
     }
 
-    // m_selFrames is not empty if fromFrame/toFrame parameters are
-    // specified.
-    if (m_framesSeq.empty()) {
-      // Frames sequence to export
-      FramesSequence framesSeq;
-      Tag* tag = calculate_frames_sequence(
-        site, frames, framesSeq, isPlaySubtags, aniDirValue);
-      if (tag)
-        params().tag(tag->name());
-      m_framesSeq = framesSeq;
-    }
+    // Frames sequence to export
+    std::string tagName = params().tag();
+    calculate_copy_frames_sequence(
+      site, frames, isPlaySubtags, aniDirValue, m_framesSeq, tagName);
+    params().tag(tagName);
     m_adjustFramesByTag = false;
 
     // Set other parameters
@@ -545,6 +539,24 @@ void SaveFileCopyAsCommand::moveToUndoState(Doc* doc,
   }
 }
 
+void calculate_copy_frames_sequence(const Site& site,
+                                    const std::string& frames,
+                                    const bool playSubtags,
+                                    const doc::AniDir aniDir,
+                                    doc::FramesSequence& framesSeq,
+                                    std::string& tagName)
+{
+  // framesSeq is not empty if fromFrame/toFrame parameters are
+  // specified.
+  if (!framesSeq.empty())
+    return;
+
+  Tag* tag = calculate_frames_sequence(
+    site, frames, framesSeq, playSubtags, aniDir);
+  if (tag)
+    tagName = tag->name();
+}
+
 Command* CommandFactory::createSaveFileCommand()
 {
   return new SaveFileCommand;
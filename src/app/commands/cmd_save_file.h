@@ -20,6 +20,7 @@
 
 namespace app {
   class Doc;
+  class Site;
 
   struct SaveFileParams : public NewParams {
     Param<bool> ui { this, true, { "ui", "useUI" } };
@@ -68,6 +69,17 @@ namespace app {
     bool m_adjustFramesByTag;
   };
 
+  // Calculates the frames and the tag to export a copy of the site
+  // document (as the SaveFileCopyAs command does). If framesSeq is
+  // not empty (specific frames were given), it isn't modified and
+  // it's relative to the tag.
+  void calculate_copy_frames_sequence(const Site& site,
+                                      const std::string& frames,
+                                      const bool playSubtags,
+                                      const doc::AniDir aniDir,
+                                      doc::FramesSequence& framesSeq,
+                                      std::string& tagName);
+
 } // namespace app
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -373,6 +373,10 @@ void FilterManagerImpl::flush()
   int h = m_row - m_nextRowToFlush;
 
   if (m_row >= 0 && h > 0) {
+    // The destination image is the preview image of the editors,
+    // a new version discards their cached renders.
+    m_dst->incrementVersion();
+
     // Redraw the color palette
     if (m_nextRowToFlush == 0 && paletteHasChanged())
       redrawColorPalette();
@@ -20,18 +20,23 @@
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
+#include "app/util/atlas_packer.h"
 #include "app/util/autocrop.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "base/process.h"
 #include "base/replace_string.h"
 #include "base/string.h"
+#include "base/time.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
+#include "doc/hash64.h"
 #include "doc/image.h"
 #include "doc/images_map.h"
 #include "doc/images_map.h"
 #include "doc/layer.h"
+#include "doc/ordered_jobs.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/selected_frames.h"
@@ -48,12 +53,22 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <initializer_list>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -62,6 +77,11 @@ using namespace doc;
 
 namespace {
 
+// Maximum memory used by the renders of samples that are kept only to
+// copy them to the texture (the other samples are rendered again
+// directly in the texture).
+const int64_t kMaxSampleRendersMemory = int64_t(256)*1024*1024;
+
 std::string escape_for_json(const std::string& path)
 {
   std::string res = path;
@@ -88,6 +108,51 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Calls func(i) for each i in [0, n) using a doc::OrderedJobs pool
+// with all the available CPU cores. Each index is processed just once
+// by one thread, so func() can modify the i-th element of a vector
+// without locks. The first exception thrown by func() is re-thrown in
+// the caller thread.
+template<typename Func>
+void for_each_index_in_parallel(const int n,
+                                base::task_token& token,
+                                Func&& func)
+{
+  const int nthreads =
+    OrderedJobs::calcThreads(n, int(std::thread::hardware_concurrency()));
+  if (nthreads <= 1) {
+    for (int i=0; i<n && !token.canceled(); ++i)
+      func(i);
+    return;
+  }
+
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  OrderedJobs jobs(nthreads);
+  for (int i=0; i<n; ++i) {
+    jobs.add([&, i]{
+      if (failed || token.canceled())
+        return;
+      try {
+        func(i);
+      }
+      catch (...) {
+        const std::lock_guard lock(errorMutex);
+        if (!error)
+          error = std::current_exception();
+        failed = true;
+      }
+    });
+  }
+  for (int i=0; i<n; ++i)
+    jobs.wait(i);
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
 } // anonymous namespace
 
 namespace app {
@@ -211,7 +276,10 @@ public:
     // TODO we cannot assign an empty rectangle (samples that are
     // completely trimmed out should be included as a sample of size 1x1)
     ASSERT(!bounds.isEmpty());
-    m_trimmedBounds = bounds;
+    if (m_trimmedBounds != bounds) {
+      m_trimmedBounds = bounds;
+      releaseRender();
+    }
   }
 
   void setInTextureBounds(const gfx::Rect& bounds) {
@@ -235,7 +303,45 @@ public:
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
 
-  ImageRef createRender(ImageBufferPtr& imageBuf) {
+  // Key of the rendered content of this sample in the
+  // DocExporter::SamplesCache (0 if it cannot be cached).
+  uint64_t cacheKey() const { return m_cacheKey; }
+  void setCacheKey(const uint64_t key) { m_cacheKey = key; }
+
+  // Rendered image of the trimmed bounds of this sample (created
+  // by DocExporter::renderSamples() or when the sample is trimmed).
+  const ImageRef& render() const { return m_render; }
+  void setRender(const ImageRef& render) {
+    ASSERT(!render || render->size() == m_trimmedBounds.size());
+    m_render = render;
+    m_renderHash = 0;
+  }
+  void releaseRender() {
+    m_render.reset();
+    m_renderHash = 0;
+  }
+
+  // Hash of the render() pixels to find duplicated samples. It's
+  // calculated for each sample (instead of caching it in the image)
+  // because some renders are images shared with the sprite (e.g.
+  // tiles of a tileset).
+  uint32_t renderHash() const { return m_renderHash; }
+  void calculateRenderHash() {
+    if (m_render)
+      m_renderHash = calculate_image_hash(m_render.get(), m_render->bounds());
+  }
+
+  // Hides all layers that are not selected for this sample until
+  // the given "layersVisibility" is destroyed. This must be done
+  // before calling createRender()/renderSample(), and it cannot be
+  // done from worker threads (it modifies the sprite layers).
+  void showSelectedLayers(RestoreVisibleLayers& layersVisibility) const {
+    if (m_selLayers)
+      layersVisibility.showSelectedLayers(m_sprite,
+                                          *m_selLayers);
+  }
+
+  ImageRef createRender(ImageBufferPtr& imageBuf) const {
     ASSERT(m_sprite);
 
     // We use the m_image as it is, it doesn't require a special
@@ -254,11 +360,19 @@ public:
     return render;
   }
 
+  // Returns true if renderSample() can copy the pixels from the
+  // render()/image of this sample directly (without rendering the
+  // sprite again), i.e. it was rendered with the same pixel format
+  // and background of the destination.
+  bool canCopyRender(const doc::Image* dst) const {
+    return (m_image ||
+            (m_render &&
+             m_render->pixelFormat() == dst->pixelFormat() &&
+             m_render->maskColor() == dst->maskColor()));
+  }
+
   void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
-    RestoreVisibleLayers layersVisibility;
-    if (m_selLayers)
-      layersVisibility.showSelectedLayers(m_sprite,
-                                          *m_selLayers);
+    const bool useRender = (!m_image && canCopyRender(dst));
 
     render::Render render;
 
@@ -266,6 +380,21 @@ public:
     // 2) We should use the new blend mode always when we're saving files
     //render.setNewBlend(Preferences::instance().experimental.newBlend());
 
+    auto copyArea = [&](const gfx::Clip& clip) {
+      if (m_image) {
+        dst->copy(m_image.get(), clip);
+      }
+      else if (useRender) {
+        gfx::Clip renderClip(clip);
+        renderClip.src.x -= m_trimmedBounds.x;
+        renderClip.src.y -= m_trimmedBounds.y;
+        dst->copy(m_render.get(), renderClip);
+      }
+      else {
+        render.renderSprite(dst, m_sprite, m_frame, clip);
+      }
+    };
+
     if (extrude) {
       const gfx::Rect& trim = m_trimmedBounds;
 
@@ -287,24 +416,12 @@ public:
       // side.
       for (int j=0; j<3; ++j) {
         for (int i=0; i<3; ++i) {
-          gfx::Clip clip(x+dx[i], y+dy[j], gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j]));
-          if (m_image) {
-            dst->copy(m_image.get(), clip);
-          }
-          else {
-            render.renderSprite(dst, m_sprite, m_frame, clip);
-          }
+          copyArea(gfx::Clip(x+dx[i], y+dy[j], gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j])));
         }
       }
     }
     else {
-      gfx::Clip clip(x, y, m_trimmedBounds);
-      if (m_image) {
-        dst->copy(m_image.get(), clip);
-      }
-      else {
-        render.renderSprite(dst, m_sprite, m_frame, clip);
-      }
+      copyArea(gfx::Clip(x, y, m_trimmedBounds));
     }
   }
 
@@ -325,6 +442,9 @@ private:
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   SharedRectPtr m_inTextureBounds;
+  ImageRef m_render;
+  uint32_t m_renderHash = 0;
+  uint64_t m_cacheKey = 0;
 };
 
 class DocExporter::Samples {
@@ -340,6 +460,10 @@ public:
     m_samples.push_back(sample);
   }
 
+  Sample& operator[](const size_t i) {
+    return m_samples[i];
+  }
+
   const Sample& operator[](const size_t i) const {
     return m_samples[i];
   }
@@ -353,6 +477,501 @@ private:
   List m_samples;
 };
 
+// Results of rendering/trimming samples from previous exports. The
+// entries are identified by a hash of everything that affects the
+// render of a sprite frame (cels, layers, palette, etc.), so when a
+// frame is modified only that frame is rendered again.
+//
+// Cel images are identified by their ID and version, or by the hash
+// of their pixels when a directory is used to store the entries on
+// disk (to re-use them between different executions of the program).
+//
+// Only the most recently used renders are kept in memory (see
+// kMaxRendersMemory), other entries keep just their bounds (and the
+// render is loaded from the directory, or rendered again).
+class DocExporter::SamplesCache {
+public:
+  // Maximum memory used by renders of entries kept in memory.
+  static constexpr int64_t kMaxRendersMemory = 128*1024*1024;
+
+  // Maximum size of the entries in the cache directory.
+  static constexpr uint64_t kMaxDirectorySize = 1024*1024*1024;
+
+  struct Entry {
+    bool empty = false;
+    gfx::Rect frameBounds;
+    gfx::Rect renderBounds;
+    ImageRef render;
+  };
+
+  const std::string& directory() const { return m_dir; }
+  void setDirectory(const std::string& dir) {
+    const std::lock_guard lock(m_mutex);
+    m_dir = dir;
+    m_imageHashes.clear();
+  }
+
+  // Removes the entries that weren't used in the previous export.
+  void startExport() {
+    const std::lock_guard lock(m_mutex);
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+      if (it->second.generation < m_generation) {
+        releaseRender(it->second);
+        it = m_entries.erase(it);
+      }
+      else
+        ++it;
+    }
+    for (auto it=m_imageHashes.begin(); it!=m_imageHashes.end(); ) {
+      if (it->second.generation < m_generation)
+        it = m_imageHashes.erase(it);
+      else
+        ++it;
+    }
+    ++m_generation;
+  }
+
+  // Updates the modification time of the directory entries used in
+  // the current export, and deletes the least recently used entries
+  // when the directory is bigger than kMaxDirectorySize. The same
+  // directory can be shared by several sprite sheets (or processes).
+  void finishExport() {
+    std::string dir;
+    std::vector<uint64_t> usedKeys;
+    {
+      const std::lock_guard lock(m_mutex);
+      if (m_dir.empty())
+        return;
+
+      dir = m_dir;
+      for (const auto& it : m_entries) {
+        if (it.second.generation == m_generation)
+          usedKeys.push_back(it.first);
+      }
+    }
+    for (const uint64_t key : usedKeys)
+      touchEntry(dir, key);
+    std::sort(usedKeys.begin(), usedKeys.end());
+
+    struct File {
+      std::string path;
+      uint64_t size;
+      base::Time time;
+    };
+    std::vector<File> files;
+    uint64_t totalSize = 0;
+    const base::Time now = base::current_time();
+
+    for (const auto& fn : base::list_files(dir, base::ItemType::Files)) {
+      const std::string path = base::join_path(dir, fn);
+      uint64_t key;
+
+      // Temporary file of a saveEntry() that was interrupted (recent
+      // ones can be from other process saving an entry right now)
+      if (base::get_file_extension(fn) == "tmp") {
+        if (fn.size() > 20 &&
+            parseEntryFilename(fn.substr(0, 20), key) &&
+            base::get_modification_time(path).addDays(1) < now) {
+          try { base::delete_file(path); }
+          catch (const std::exception&) { }
+        }
+        continue;
+      }
+
+      if (!parseEntryFilename(fn, key))
+        continue;
+
+      const uint64_t size = base::file_size(path);
+      totalSize += size;
+      if (!std::binary_search(usedKeys.begin(), usedKeys.end(), key) &&
+          isEntryFile(path)) {
+        files.push_back(File{ path, size, base::get_modification_time(path) });
+      }
+    }
+    if (totalSize <= kMaxDirectorySize)
+      return;
+
+    // From the least to the most recently used
+    std::sort(files.begin(), files.end(),
+              [](const File& a, const File& b){
+                return a.time < b.time;
+              });
+
+    for (const File& file : files) {
+      if (totalSize <= kMaxDirectorySize)
+        break;
+      try {
+        base::delete_file(file.path);
+        totalSize -= file.size;
+      }
+      catch (const std::exception&) { }
+    }
+  }
+
+  // Returns the key of the rendered content of the given sprite
+  // frame, when only the given layers are visible (or the visible
+  // layers if visibleLayers is nullptr). Returns 0 if the frame
+  // cannot be cached (e.g. it contains tilemaps).
+  uint64_t contentKey(const Sprite* sprite,
+                      const frame_t frame,
+                      const SelectedLayers* visibleLayers) {
+    Hash64 h;
+    feed(h, sprite->pixelFormat());
+    feed(h, sprite->transparentColor());
+    feed(h, sprite->width());
+    feed(h, sprite->height());
+
+    const Palette* palette = sprite->palette(frame);
+    feed(h, palette->size());
+    for (int i=0; i<palette->size(); ++i)
+      feed(h, palette->getEntry(i));
+
+    if (!feedLayer(h, sprite->root(), frame, visibleLayers))
+      return 0;
+
+    return std::max<uint64_t>(1, h.digest());
+  }
+
+  // Returns a key derived from other key and the given values.
+  static uint64_t derivedKey(const uint64_t key,
+                             std::initializer_list<int> values) {
+    Hash64 h(key);
+    for (int value : values)
+      feed(h, value);
+    return std::max<uint64_t>(1, h.digest());
+  }
+
+  // Returns the cached entry of the given key. The entry.render can
+  // be nullptr if it was released from memory and there is no
+  // directory to load it again.
+  bool get(const uint64_t key, Entry& entry) {
+    std::string dir;
+    {
+      const std::lock_guard lock(m_mutex);
+      auto it = m_entries.find(key);
+      if (it != m_entries.end() &&
+          (!it->second.renderReleased || m_dir.empty())) {
+        Item& item = it->second;
+        item.generation = m_generation;
+        if (item.entry.render)
+          m_lru.splice(m_lru.begin(), m_lru, item.lru);
+        entry = item.entry;
+        return true;
+      }
+      dir = m_dir;
+    }
+    if (dir.empty() || !loadEntry(dir, key, entry))
+      return false;
+
+    const std::lock_guard lock(m_mutex);
+    addItem(key, entry);
+    return true;
+  }
+
+  void set(const uint64_t key, const Entry& entry) {
+    std::string dir;
+    {
+      const std::lock_guard lock(m_mutex);
+      addItem(key, entry);
+      dir = m_dir;
+    }
+    if (!dir.empty())
+      saveEntry(dir, key, entry);
+  }
+
+private:
+  struct Item {
+    Entry entry;
+    int generation = 0;
+    // Position in m_lru (only if entry.render != nullptr)
+    std::list<uint64_t>::iterator lru;
+    // True if entry.render was released to limit the used memory
+    bool renderReleased = false;
+  };
+
+  // Adds or replaces the entry of the given key, releasing the least
+  // recently used renders if needed. m_mutex must be locked.
+  void addItem(const uint64_t key, const Entry& entry) {
+    Item& item = m_entries[key];
+    releaseRender(item);
+    item.entry = entry;
+    item.generation = m_generation;
+    item.renderReleased = false;
+    if (!entry.render)
+      return;
+
+    m_lru.push_front(key);
+    item.lru = m_lru.begin();
+    m_rendersMemory += entry.render->getMemSize();
+
+    while (m_rendersMemory > kMaxRendersMemory && m_lru.size() > 1) {
+      Item& old = m_entries[m_lru.back()];
+      releaseRender(old);
+      old.renderReleased = true;
+    }
+  }
+
+  void releaseRender(Item& item) {
+    if (item.entry.render) {
+      m_rendersMemory -= item.entry.render->getMemSize();
+      m_lru.erase(item.lru);
+      item.entry.render.reset();
+    }
+  }
+
+  struct ImageHash {
+    ObjectVersion version;
+    uint64_t hash;
+    int generation;
+  };
+
+  template<typename T>
+  static void feed(Hash64& h, const T& value) {
+    h.update(&value, sizeof(value));
+  }
+
+  bool feedLayer(Hash64& h,
+                 const Layer* layer,
+                 const frame_t frame,
+                 const SelectedLayers* visibleLayers) {
+    const bool visible = (visibleLayers ? visibleLayers->contains(layer):
+                                          layer->isVisible());
+    feed(h, visible);
+    if (!visible && layer != layer->sprite()->root())
+      return true;
+
+    feed(h, layer->type());
+    feed(h, int(layer->flags()) & ~int(LayerFlags::Visible));
+
+    if (layer->isGroup()) {
+      const LayerGroup* group = static_cast<const LayerGroup*>(layer);
+      feed(h, int(group->layersCount()));
+      for (const Layer* child : group->layers()) {
+        if (!feedLayer(h, child, frame, visibleLayers))
+          return false;
+      }
+    }
+    else if (layer->isTilemap()) {
+      // TODO add tilesets to the key
+      return false;
+    }
+    else if (layer->isImage()) {
+      const LayerImage* layerImage = static_cast<const LayerImage*>(layer);
+      feed(h, layerImage->blendMode());
+      feed(h, layerImage->opacity());
+
+      const Cel* cel = layer->cel(frame);
+      feed(h, cel != nullptr);
+      if (cel) {
+        const gfx::RectF& bounds = cel->boundsF();
+        feed(h, bounds.x);
+        feed(h, bounds.y);
+        feed(h, bounds.w);
+        feed(h, bounds.h);
+        feed(h, cel->opacity());
+        feed(h, cel->zIndex());
+
+        const Image* image = cel->image();
+        feed(h, image->pixelFormat());
+        feed(h, image->width());
+        feed(h, image->height());
+        feed(h, image->maskColor());
+        feed(h, imageHash(image));
+      }
+    }
+    return true;
+  }
+
+  uint64_t imageHash(const Image* image) {
+    // Without a directory the key is valid in this process only, so
+    // the ID+version of the image is enough.
+    if (m_dir.empty()) {
+      Hash64 h;
+      feed(h, image->id());
+      feed(h, image->version());
+      return h.digest();
+    }
+
+    auto it = m_imageHashes.find(image->id());
+    if (it != m_imageHashes.end() &&
+        it->second.version == image->version()) {
+      it->second.generation = m_generation;
+      return it->second.hash;
+    }
+
+    Hash64 h;
+    const int widthBytes = image->widthBytes();
+    for (int y=0; y<image->height(); ++y)
+      h.update(image->getPixelAddress(0, y), widthBytes);
+
+    const uint64_t hash = h.digest();
+    m_imageHashes[image->id()] = ImageHash{ image->version(), hash, m_generation };
+    return hash;
+  }
+
+  static std::string entryFilename(const std::string& dir,
+                                   const uint64_t key) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%016llx.bin", (unsigned long long)key);
+    return base::join_path(dir, buf);
+  }
+
+  // Returns true if the given filename (without path) has the format
+  // used by entryFilename().
+  static bool parseEntryFilename(const std::string& fn, uint64_t& key) {
+    const std::string title = base::get_file_title(fn);
+    if (base::get_file_extension(fn) != "bin" || title.size() != 16)
+      return false;
+
+    char* end = nullptr;
+    key = std::strtoull(title.c_str(), &end, 16);
+    return (end && *end == 0);
+  }
+
+  // Returns a temporary filename to save the entry of the given key,
+  // unique for each thread and process.
+  static std::string tmpEntryFilename(const std::string& dir,
+                                      const uint64_t key) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), ".%x-%zx.tmp",
+                  unsigned(base::get_current_process_id()),
+                  std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return entryFilename(dir, key) + buf;
+  }
+
+  static bool isEntryFile(const std::string& path) {
+    std::ifstream f(FSTREAM_PATH(path), std::ios::binary);
+    uint32_t magic = 0;
+    f.read((char*)&magic, sizeof(magic));
+    return (f && magic == kMagic);
+  }
+
+  static bool loadEntry(const std::string& dir,
+                        const uint64_t key,
+                        Entry& entry) {
+    std::ifstream f(FSTREAM_PATH(entryFilename(dir, key)), std::ios::binary);
+    if (!f)
+      return false;
+
+    auto read = [&f](auto& value) {
+      f.read((char*)&value, sizeof(value));
+    };
+
+    uint32_t magic = 0;
+    uint8_t empty = 0, hasRender = 0;
+    read(magic);
+    if (magic != kMagic)
+      return false;
+    read(empty);
+    read(entry.frameBounds);
+    read(entry.renderBounds);
+    read(hasRender);
+    entry.empty = (empty != 0);
+    entry.render.reset();
+
+    if (hasRender) {
+      uint8_t pixelFormat = 0;
+      int32_t w = 0, h = 0;
+      color_t maskColor = 0;
+      read(pixelFormat);
+      read(w);
+      read(h);
+      read(maskColor);
+      if (!f ||
+          w != entry.renderBounds.w ||
+          h != entry.renderBounds.h ||
+          w < 1 || h < 1 ||
+          pixelFormat > IMAGE_TILEMAP)
+        return false;
+
+      ImageRef render(Image::create(PixelFormat(pixelFormat), w, h));
+      render->setMaskColor(maskColor);
+      const int widthBytes = render->widthBytes();
+      for (int y=0; y<h; ++y)
+        f.read((char*)render->getPixelAddress(0, y), widthBytes);
+      entry.render = render;
+    }
+    return bool(f);
+  }
+
+  // Rewrites the magic number of the entry file to update its
+  // modification time (used to delete the least recently used
+  // entries).
+  static void touchEntry(const std::string& dir,
+                         const uint64_t key) {
+    std::fstream f(FSTREAM_PATH(entryFilename(dir, key)),
+                   std::ios::binary | std::ios::in | std::ios::out);
+    uint32_t magic = 0;
+    f.read((char*)&magic, sizeof(magic));
+    if (f && magic == kMagic) {
+      f.seekp(0);
+      f.write((const char*)&kMagic, sizeof(kMagic));
+    }
+  }
+
+  // Writes the entry in a temporary file and then renames it, so
+  // other threads (or processes) cannot read a partial file.
+  static void saveEntry(const std::string& dir,
+                        const uint64_t key,
+                        const Entry& entry) {
+    const std::string fn = entryFilename(dir, key);
+    const std::string tmp = tmpEntryFilename(dir, key);
+    const bool ok = writeEntry(tmp, entry);
+    try {
+      if (ok) {
+        if (base::is_file(fn))
+          base::delete_file(fn);
+        base::move_file(tmp, fn);
+      }
+      else if (base::is_file(tmp))
+        base::delete_file(tmp);
+    }
+    catch (const std::exception&) {
+      // Ignore errors, the entry will be rendered again
+    }
+  }
+
+  static bool writeEntry(const std::string& fn,
+                         const Entry& entry) {
+    std::ofstream f(FSTREAM_PATH(fn), std::ios::binary);
+    if (!f)
+      return false;
+
+    auto write = [&f](const auto& value) {
+      f.write((const char*)&value, sizeof(value));
+    };
+
+    const uint8_t empty = (entry.empty ? 1: 0);
+    const uint8_t hasRender = (entry.render ? 1: 0);
+    write(kMagic);
+    write(empty);
+    write(entry.frameBounds);
+    write(entry.renderBounds);
+    write(hasRender);
+    if (entry.render) {
+      const Image* render = entry.render.get();
+      write(uint8_t(render->pixelFormat()));
+      write(int32_t(render->width()));
+      write(int32_t(render->height()));
+      write(render->maskColor());
+      const int widthBytes = render->widthBytes();
+      for (int y=0; y<render->height(); ++y)
+        f.write((const char*)render->getPixelAddress(0, y), widthBytes);
+    }
+    return bool(f);
+  }
+
+  static constexpr uint32_t kMagic = 0x31435844; // "DXC1"
+
+  std::mutex m_mutex;
+  std::unordered_map<uint64_t, Item> m_entries;
+  std::list<uint64_t> m_lru;    // Keys of entries with renders (most recent first)
+  int64_t m_rendersMemory = 0;
+  std::unordered_map<ObjectId, ImageHash> m_imageHashes;
+  std::string m_dir;
+  int m_generation = 0;
+};
+
 class DocExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -361,6 +980,32 @@ public:
                              int shapePadding,
                              int& width, int& height,
                              base::task_token& token) = 0;
+
+protected:
+  // Finds samples with the same rendered pixels using the hashes
+  // calculated by DocExporter::renderSamples().
+  class Duplicates {
+  public:
+    // Returns the index of a previous sample with the same render()
+    // as samples[i], or -1 if there is no one (in that case
+    // samples[i] is added to be compared with the next samples).
+    int findOrAdd(const Samples& samples, const int i) {
+      const Sample& sample = samples[i];
+      ASSERT(sample.render());
+
+      const auto range = m_samples.equal_range(sample.renderHash());
+      for (auto it=range.first; it!=range.second; ++it) {
+        if (is_same_image(samples[it->second].render().get(),
+                          sample.render().get()))
+          return it->second;
+      }
+      m_samples.emplace(sample.renderHash(), i);
+      return -1;
+    }
+
+  private:
+    std::unordered_multimap<uint32_t, int> m_samples;
+  };
 };
 
 class DocExporter::SimpleLayoutSamples : public DocExporter::LayoutSamples {
@@ -392,7 +1037,7 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
+    Duplicates duplicates;
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -418,20 +1063,14 @@ public:
       }
 
       if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
+        // Rendered by DocExporter::renderSamples()
+        const int j = duplicates.findOrAdd(samples, i);
+        if (j >= 0) {
           sample.setDuplicated();
           sample.setSharedBounds(samples[j].sharedBounds());
           ++i;
           continue;
         }
-        else {
-          duplicates[sampleRender] = i;
-        }
       }
 
       const Sprite* sprite = sample.sprite();
@@ -528,15 +1167,45 @@ private:
 
 class DocExporter::BestFitLayoutSamples : public DocExporter::LayoutSamples {
 public:
+  BestFitLayoutSamples(SpriteSheetPackAlgorithm algorithm)
+    : m_algorithm(algorithm) {
+  }
+
   void layoutSamples(Samples& samples,
                      int borderPadding,
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
+    switch (m_algorithm) {
+      case SpriteSheetPackAlgorithm::MaxRects: {
+        AtlasPacker pr(AtlasPacker::Algorithm::MaxRects,
+                       borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+      case SpriteSheetPackAlgorithm::Skyline: {
+        AtlasPacker pr(AtlasPacker::Algorithm::Skyline,
+                       borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+      default: {
+        gfx::PackingRects pr(borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+    }
+  }
+
+private:
+  template<typename Packer>
+  void packSamples(Packer& pr,
+                   Samples& samples,
+                   int& width, int& height,
+                   base::task_token& token) {
+    Duplicates duplicates;
 
-    uint32_t i = 0;
+    int i = 0;
     for (auto& sample : samples) {
       if (token.canceled())
         return;
@@ -548,19 +1217,13 @@ public:
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
+      // Rendered by DocExporter::renderSamples()
+      const int j = duplicates.findOrAdd(samples, i);
+      if (j >= 0) {
         sample.setDuplicated();
         sample.setSharedBounds(samples[j].sharedBounds());
       }
       else {
-        duplicates[sampleRender] = i;
         pr.add(sample.requiredSize());
       }
       ++i;
@@ -572,8 +1235,11 @@ public:
       width = sz.w;
       height = sz.h;
     }
-    else {
-      pr.pack(gfx::Size(width, height), token);
+    else if (!pr.pack(gfx::Size(width, height), token)) {
+      // If the samples don't fit in the given texture size, we use
+      // the given width only (the texture will be taller).
+      if constexpr (std::is_same_v<Packer, AtlasPacker>)
+        pr.bestFit(token, width, 0);
     }
     token.set_progress_range(0.0f, 1.0f);
 
@@ -588,19 +1254,26 @@ public:
       sample.setInTextureBounds(*(it++));
     }
   }
+
+  SpriteSheetPackAlgorithm m_algorithm;
 };
 
 DocExporter::DocExporter()
   : m_docBuf(std::make_shared<doc::ImageBuffer>())
-  , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
+  , m_samplesCache(std::make_unique<SamplesCache>())
 {
   m_cache.spriteId = doc::NullId;
   reset();
 }
 
+DocExporter::~DocExporter()
+{
+}
+
 void DocExporter::reset()
 {
   m_sheetType = SpriteSheetType::None;
+  m_packAlgorithm = SpriteSheetPackAlgorithm::Default;
   m_dataFormat = SpriteSheetDataFormat::Default;
   m_dataFilename.clear();
   m_textureFilename.clear();
@@ -633,6 +1306,19 @@ void DocExporter::setDocImageBuffer(const doc::ImageBufferPtr& docBuf)
   m_docBuf = docBuf;
 }
 
+void DocExporter::setCacheDirectory(const std::string& dir)
+{
+  if (!dir.empty() && !base::is_directory(dir))
+    base::make_all_directories(dir);
+
+  m_samplesCache->setDirectory(dir);
+}
+
+const std::string& DocExporter::cacheDirectory() const
+{
+  return m_samplesCache->directory();
+}
+
 Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
 {
   // We output the metadata to std::cout if the user didn't specify a file.
@@ -667,6 +1353,7 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   // 1) Capture the samples (each sprite+frame pair)
   Samples samples;
   captureSamples(samples, token);
+  renderSamples(samples, token);
   if (samples.empty()) {
     if (!ctx->isUIAvailable()) {
       Console console;
@@ -682,6 +1369,7 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   layoutSamples(samples, token);
   if (token.canceled())
     return nullptr;
+  releaseSampleRenders(samples);
   token.set_progress(0.4f);
 
   // 3) Create and render the texture.
@@ -698,6 +1386,7 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   renderTexture(ctx, samples, textureImage, token);
   if (token.canceled())
     return nullptr;
+  m_samplesCache->finishExport();
   token.set_progress(0.8f);
 
   // Trim texture
@@ -729,6 +1418,9 @@ gfx::Size DocExporter::calculateSheetSize()
   base::task_token token;
   Samples samples;
   captureSamples(samples, token);
+  // Renders are needed only to find duplicated samples
+  if (m_mergeDuplicates || m_sheetType == SpriteSheetType::Packed)
+    renderSamples(samples, token);
   layoutSamples(samples, token);
   return calculateSheetSize(samples, token);
 }
@@ -885,6 +1577,11 @@ void DocExporter::captureSamples(Samples& samples,
 {
   DX_TRACE("DX: Capture samples");
 
+  m_samplesCache->startExport();
+
+  // Memory used by the renders kept in samples from the trim pass
+  std::atomic<int64_t> rendersMemory(0);
+
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -941,6 +1638,29 @@ void DocExporter::captureSamples(Samples& samples,
       }
     }
 
+    // Samples of this item (one for each selected frame) and the
+    // result of rendering them to calculate their trimmed bounds.
+    struct FrameSample {
+      Sample sample;
+      Cel* cel = nullptr;
+      Cel* link = nullptr;
+      bool rendered = false;
+      bool empty = false;
+      gfx::Rect frameBounds;
+      // Render of "renderBounds" to re-use in the next steps
+      ImageRef render;
+      gfx::Rect renderBounds;
+    };
+    std::vector<FrameSample> frameSamples;
+
+    // Layers visible in the samples of this item (to calculate the
+    // key of each sample in the cache)
+    SelectedLayers visibleLayers;
+    if (item.selLayers) {
+      visibleLayers = *item.selLayers;
+      visibleLayers.propagateSelection();
+    }
+
     frame_t outputFrame = 0;
     for (frame_t frame : item.getSelectedFrames()) {
       if (token.canceled())
@@ -972,7 +1692,6 @@ void DocExporter::captureSamples(Samples& samples,
         m_innerPadding, m_extrude);
       Cel* cel = nullptr;
       Cel* link = nullptr;
-      bool done = false;
 
       if (layer && layer->isImage()) {
         cel = layer->cel(frame);
@@ -980,6 +1699,175 @@ void DocExporter::captureSamples(Samples& samples,
           link = cel->link();
       }
 
+      if (!item.isOneImageOnly()) {
+        sample.setCacheKey(
+          m_samplesCache->contentKey(sprite, frame,
+                                     item.selLayers ? &visibleLayers: nullptr));
+      }
+
+      frameSamples.push_back(FrameSample{ sample, cel, link });
+    }
+
+    const bool trimRender =
+      ((m_ignoreEmptyCels || m_trimCels) &&
+       !item.isOneImageOnly());
+
+    // Returns true if the given render can be kept in its
+    // FrameSample, i.e. if the kept renders don't exceed
+    // kMaxSampleRendersMemory (other samples are rendered again
+    // in renderSamples()).
+    auto keepRender = [&rendersMemory](const ImageRef& render) -> bool {
+      if (!render)
+        return false;
+      const int64_t size = render->getMemSize();
+      if (rendersMemory.fetch_add(size) + size > kMaxSampleRendersMemory) {
+        rendersMemory -= size;
+        return false;
+      }
+      return true;
+    };
+
+    // Key of the trimmed bounds of a sample in the cache
+    auto trimKey = [this, sprite, &spriteBounds](const Sample& sample) -> uint64_t {
+      if (!sample.cacheKey())
+        return 0;
+
+      const gfx::Rect gridBounds =
+        (m_trimByGrid ? sprite->gridBounds(): gfx::Rect());
+      return SamplesCache::derivedKey(
+        sample.cacheKey(),
+        { 1, m_trimCels, m_trimSprite, m_trimByGrid, m_ignoreEmptyCels,
+          gridBounds.x, gridBounds.y, gridBounds.w, gridBounds.h,
+          spriteBounds.x, spriteBounds.y, spriteBounds.w, spriteBounds.h,
+          sample.originalSize().w, sample.originalSize().h });
+    };
+
+    // Renders the sample to know if it's empty and its trimmed
+    // bounds. This is called from worker threads, so it cannot modify
+    // anything outside the given FrameSample (and the cache).
+    auto trimSample = [this, &item, doc, sprite, layer,
+                       &spriteBounds, &trimKey, &keepRender](FrameSample& fs) {
+      const uint64_t key = trimKey(fs.sample);
+      SamplesCache::Entry entry;
+      if (key && m_samplesCache->get(key, entry)) {
+        fs.rendered = true;
+        fs.empty = entry.empty;
+        fs.frameBounds = entry.frameBounds;
+        fs.renderBounds = entry.renderBounds;
+        if (keepRender(entry.render))
+          fs.render = entry.render;
+        return;
+      }
+
+      ImageBufferPtr sampleBuf;
+      ImageRef sampleRender(fs.sample.createRender(sampleBuf));
+
+      doc::color_t refColor = 0;
+
+      if (m_trimCels) {
+        if ((layer &&
+             layer->isBackground()) ||
+            (!layer &&
+             sprite->backgroundLayer() &&
+             sprite->backgroundLayer()->isVisible())) {
+          refColor = get_pixel(sampleRender.get(), 0, 0);
+        }
+        else {
+          refColor = sprite->transparentColor();
+        }
+      }
+      else if (m_ignoreEmptyCels)
+        refColor = sprite->transparentColor();
+
+      gfx::Rect frameBounds;
+      if (!algorithm::shrink_bounds(sampleRender.get(),
+                                    refColor,
+                                    nullptr,        // layer
+                                    spriteBounds,   // startBounds
+                                    frameBounds)) { // output bounds
+        // If shrink_bounds() returns false, it's because the whole
+        // image is transparent (equal to the mask color).
+        fs.empty = true;
+
+        // Create an entry with Size(1, 1) for this completely
+        // trimmed frame anyway so we conserve the frame information
+        // (position and duration of the frame in the JSON data, and
+        // the relative position of the frame in frame tags).
+        frameBounds = gfx::Rect(0, 0, 1, 1);
+      }
+
+      if (m_trimCels) {
+        // TODO merge this code with the code in DocApi::trimSprite()
+        if (m_trimByGrid) {
+          const gfx::Rect& gridBounds = doc->sprite()->gridBounds();
+          gfx::Point posTopLeft =
+            snap_to_grid(gridBounds,
+                         frameBounds.origin(),
+                         PreferSnapTo::FloorGrid);
+          gfx::Point posBottomRight =
+            snap_to_grid(gridBounds,
+                         frameBounds.point2(),
+                         PreferSnapTo::CeilGrid);
+          frameBounds = gfx::Rect(posTopLeft, posBottomRight);
+        }
+      }
+      fs.frameBounds = frameBounds;
+      fs.rendered = true;
+
+      // Keep the part of the render that will be used in the sprite
+      // sheet so we don't need to render this sample again (the grid
+      // cells of splitGrid items are different samples).
+      if (!(fs.empty && m_ignoreEmptyCels) && !item.splitGrid) {
+        fs.renderBounds =
+          (m_trimCels ? frameBounds:
+           m_trimSprite ? spriteBounds:
+                          sampleRender->bounds());
+        ImageRef render;
+        if (fs.renderBounds == sampleRender->bounds())
+          render = sampleRender;
+        else
+          render.reset(crop_image(sampleRender.get(), fs.renderBounds,
+                                  sprite->transparentColor()));
+        if (keepRender(render))
+          fs.render = render;
+      }
+
+      if (key) {
+        entry.empty = fs.empty;
+        entry.frameBounds = fs.frameBounds;
+        entry.renderBounds = fs.renderBounds;
+        entry.render = fs.render;
+        m_samplesCache->set(key, entry);
+      }
+    };
+
+    // Render all samples of this item in parallel (except the ones
+    // that will probably re-use the trimmed bounds of a linked cel)
+    if (trimRender) {
+      RestoreVisibleLayers layersVisibility;
+      if (!frameSamples.empty())
+        frameSamples.front().sample.showSelectedLayers(layersVisibility);
+
+      for_each_index_in_parallel(
+        int(frameSamples.size()), token,
+        [this, layer, &frameSamples, &trimSample](const int i) {
+          FrameSample& fs = frameSamples[i];
+          if ((fs.link && m_mergeDuplicates) ||
+              (layer && layer->isImage() && !fs.cel && m_ignoreEmptyCels))
+            return;
+          trimSample(fs);
+        });
+    }
+
+    for (FrameSample& fs : frameSamples) {
+      if (token.canceled())
+        return;
+
+      Sample& sample = fs.sample;
+      Cel* cel = fs.cel;
+      Cel* link = fs.link;
+      bool done = false;
+
       // Re-use linked samples
       bool alreadyTrimmed = false;
       if (link && m_mergeDuplicates &&
@@ -1006,67 +1894,26 @@ void DocExporter::captureSamples(Samples& samples,
         ASSERT(done || (!done && tag));
       }
 
-      if (!done && (m_ignoreEmptyCels || m_trimCels) &&
-          !item.isOneImageOnly()) {
+      if (!done && trimRender) {
         // Ignore empty cels
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
-
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
-          }
-          else {
-            refColor = sprite->transparentColor();
-          }
+        // Linked cels that couldn't re-use other sample are trimmed
+        // here (it should be just a few of them).
+        if (!fs.rendered) {
+          RestoreVisibleLayers layersVisibility;
+          sample.showSelectedLayers(layersVisibility);
+          trimSample(fs);
         }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
 
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
-
-          // Should we ignore this empty frame? (i.e. don't include
-          // the frame in the sprite sheet)
-          if (m_ignoreEmptyCels)
-            continue;
-
-          // Create an entry with Size(1, 1) for this completely
-          // trimmed frame anyway so we conserve the frame information
-          // (position and duration of the frame in the JSON data, and
-          // the relative position of the frame in frame tags).
-          sample.setTrimmedBounds(frameBounds = gfx::Rect(0, 0, 1, 1));
-        }
+        // Should we ignore this empty frame? (i.e. don't include
+        // the frame in the sprite sheet)
+        if (fs.empty && m_ignoreEmptyCels)
+          continue;
 
         if (m_trimCels) {
-          // TODO merge this code with the code in DocApi::trimSprite()
-          if (m_trimByGrid) {
-            const gfx::Rect& gridBounds = doc->sprite()->gridBounds();
-            gfx::Point posTopLeft =
-              snap_to_grid(gridBounds,
-                           frameBounds.origin(),
-                           PreferSnapTo::FloorGrid);
-            gfx::Point posBottomRight =
-              snap_to_grid(gridBounds,
-                           frameBounds.point2(),
-                           PreferSnapTo::CeilGrid);
-            frameBounds = gfx::Rect(posTopLeft, posBottomRight);
-          }
-          sample.setTrimmedBounds(frameBounds);
+          sample.setTrimmedBounds(fs.frameBounds);
           alreadyTrimmed = true;
         }
       }
@@ -1080,6 +1927,9 @@ void DocExporter::captureSamples(Samples& samples,
       if (!alreadyTrimmed && m_trimSprite)
         sample.setTrimmedBounds(spriteBounds);
 
+      if (fs.render && fs.renderBounds == sample.trimmedBounds())
+        sample.setRender(fs.render);
+
       if (item.splitGrid) {
         const gfx::Rect& gridBounds = sprite->gridBounds();
         gfx::Point initPos(0, 0), pos;
@@ -1107,6 +1957,108 @@ void DocExporter::captureSamples(Samples& samples,
   }
 }
 
+void DocExporter::renderSamples(Samples& samples,
+                                base::task_token& token) const
+{
+  DX_TRACE("DX: Render samples");
+
+  // Renders are needed to find duplicated samples, in other case they
+  // are used only to copy them to the texture, so we don't create
+  // more renders after reaching kMaxSampleRendersMemory.
+  const bool findDuplicates = (m_mergeDuplicates ||
+                               m_sheetType == SpriteSheetType::Packed);
+  std::atomic<int64_t> rendersMemory(0);
+  for (const auto& sample : samples) {
+    if (sample.render())
+      rendersMemory += sample.render()->getMemSize();
+  }
+
+  int i = 0;
+  while (i < samples.size()) {
+    if (token.canceled())
+      return;
+
+    // Consecutive samples with the same visible layers are rendered
+    // in parallel (the layers visibility is changed just once for
+    // all of them).
+    const Sample& first = samples[i];
+    int j = i+1;
+    while (j < samples.size() &&
+           samples[j].sprite() == first.sprite() &&
+           samples[j].selectedLayers() == first.selectedLayers())
+      ++j;
+
+    RestoreVisibleLayers layersVisibility;
+    first.showSelectedLayers(layersVisibility);
+
+    for_each_index_in_parallel(
+      j-i, token,
+      [this, &samples, &rendersMemory, i, findDuplicates](const int k) {
+        Sample& sample = samples[i+k];
+        if (sample.isEmpty())
+          return;
+
+        if (!sample.render() &&
+            (findDuplicates || rendersMemory < kMaxSampleRendersMemory)) {
+          const gfx::Rect& bounds = sample.trimmedBounds();
+          const uint64_t key =
+            (sample.cacheKey() ?
+             SamplesCache::derivedKey(sample.cacheKey(),
+                                      { 2, bounds.x, bounds.y, bounds.w, bounds.h }): 0);
+          SamplesCache::Entry entry;
+          if (key && m_samplesCache->get(key, entry) && entry.render) {
+            sample.setRender(entry.render);
+          }
+          else {
+            // Each render has its own ImageBuffer because it's stored
+            // in the sample (and it's created in a worker thread).
+            ImageBufferPtr sampleBuf;
+            sample.setRender(sample.createRender(sampleBuf));
+
+            if (key) {
+              entry.renderBounds = bounds;
+              entry.render = sample.render();
+              m_samplesCache->set(key, entry);
+            }
+          }
+
+          if (sample.render())
+            rendersMemory += sample.render()->getMemSize();
+        }
+
+        // Calculate the hash to find duplicates in this thread too
+        if (findDuplicates)
+          sample.calculateRenderHash();
+      });
+
+    i = j;
+  }
+}
+
+void DocExporter::releaseSampleRenders(Samples& samples) const
+{
+  // After the layout, renders are needed only to copy them to the
+  // texture, so we release the renders of samples that are not copied
+  // (linked/duplicated samples), and the renders that exceed the
+  // kMaxSampleRendersMemory limit (these samples are rendered again
+  // directly in the texture).
+  int64_t rendersMemory = 0;
+  for (auto& sample : samples) {
+    if (!sample.render())
+      continue;
+
+    if (sample.isLinked() ||
+        sample.isDuplicated() ||
+        sample.isEmpty() ||
+        rendersMemory >= kMaxSampleRendersMemory) {
+      sample.releaseRender();
+    }
+    else {
+      rendersMemory += sample.render()->getMemSize();
+    }
+  }
+}
+
 void DocExporter::layoutSamples(Samples& samples,
                                 base::task_token& token)
 {
@@ -1115,7 +2067,7 @@ void DocExporter::layoutSamples(Samples& samples,
 
   switch (m_sheetType) {
     case SpriteSheetType::Packed: {
-      BestFitLayoutSamples layout;
+      BestFitLayoutSamples layout(m_packAlgorithm);
       layout.layoutSamples(
         samples, m_borderPadding, m_shapePadding,
         width, height, token);
@@ -1304,6 +2256,12 @@ void DocExporter::renderTexture(Context* ctx,
         .execute(ctx);
     }
 
+    // Samples rendered by renderSamples() are just copied to the
+    // texture, the others are rendered again.
+    RestoreVisibleLayers layersVisibility;
+    if (!sample.canCopyRender(textureImage))
+      sample.showSelectedLayers(layersVisibility);
+
     sample.renderSample(
       textureImage,
       sample.inTextureBounds().x+m_innerPadding,
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/sprite_sheet_data_format.h"
+#include "app/sprite_sheet_pack_algorithm.h"
 #include "app/sprite_sheet_type.h"
 #include "base/disable_copying.h"
 #include "base/task.h"
@@ -43,14 +44,21 @@ namespace app {
   class DocExporter {
   public:
     DocExporter();
+    ~DocExporter();
 
     void reset();
     void setDocImageBuffer(const doc::ImageBufferPtr& docBuf);
 
+    // Directory to store the rendered samples between different
+    // executions (by default they are cached in memory only).
+    const std::string& cacheDirectory() const;
+    void setCacheDirectory(const std::string& dir);
+
     SpriteSheetDataFormat dataFormat() const { return m_dataFormat; }
     const std::string& dataFilename() { return m_dataFilename; }
     const std::string& textureFilename() { return m_textureFilename; }
     SpriteSheetType spriteSheetType() { return m_sheetType; }
+    SpriteSheetPackAlgorithm packAlgorithm() const { return m_packAlgorithm; }
     const std::string& filenameFormat() const { return m_filenameFormat; }
     const std::string& tagnameFormat() const { return m_tagnameFormat; }
 
@@ -62,6 +70,7 @@ namespace app {
     void setTextureColumns(int columns) { m_textureColumns = columns; }
     void setTextureRows(int rows) { m_textureRows = rows; }
     void setSpriteSheetType(SpriteSheetType type) { m_sheetType = type; }
+    void setPackAlgorithm(SpriteSheetPackAlgorithm algorithm) { m_packAlgorithm = algorithm; }
     void setIgnoreEmptyCels(bool ignore) { m_ignoreEmptyCels = ignore; }
     void setMergeDuplicates(bool merge) { m_mergeDuplicates = merge; }
     void setBorderPadding(int padding) { m_borderPadding = padding; }
@@ -106,6 +115,7 @@ namespace app {
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
+    class SamplesCache;
 
     void addDocument(
       Doc* doc,
@@ -115,8 +125,11 @@ namespace app {
       const bool splitGrid);
     void captureSamples(Samples& samples,
                         base::task_token& token);
+    void renderSamples(Samples& samples,
+                       base::task_token& token) const;
     void layoutSamples(Samples& samples,
                        base::task_token& token);
+    void releaseSampleRenders(Samples& samples) const;
     gfx::Size calculateSheetSize(const Samples& samples,
                                  base::task_token& token) const;
     Doc* createEmptyTexture(const Samples& samples,
@@ -159,6 +172,7 @@ namespace app {
     typedef std::vector<Item> Items;
 
     SpriteSheetType m_sheetType;
+    SpriteSheetPackAlgorithm m_packAlgorithm;
     SpriteSheetDataFormat m_dataFormat;
     std::string m_dataFilename;
     std::string m_textureFilename;
@@ -187,7 +201,6 @@ namespace app {
 
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
-    doc::ImageBufferPtr m_sampleBuf;
 
     // Trimmed bounds of a specific sprite (to avoid recalculating
     // this)
@@ -198,6 +211,9 @@ namespace app {
       bool trimmedByGrid;
     } m_cache;
 
+    // Rendered/trimmed samples of previous exports
+    std::unique_ptr<SamplesCache> m_samplesCache;
+
     DISABLE_COPYING(DocExporter);
   };
 
@@ -70,6 +70,10 @@ public:
     return m_fop->isOneFrame();
   }
 
+  bool decodeMetadataOnly() override {
+    return m_fop->isMetadataOnly();
+  }
+
   doc::color_t defaultSliceColor() override {
     auto color = m_fop->config().defaultSliceColor;
     return doc::rgba(color.getRed(),
@@ -281,7 +285,7 @@ FileFormat* CreateAseFormat()
 bool AseFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+  dio::MappedFileInterface fileInterface(handle.get());
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
@@ -36,6 +36,7 @@
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
+#include "doc/ordered_jobs.h"
 #include "fmt/format.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -48,8 +49,12 @@
 #include "open_sequence.xml.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
 #include <cstdarg>
+#include <mutex>
+#include <vector>
 
 namespace app {
 
@@ -77,32 +82,17 @@ public:
       m_spec.setSize(std::max<int>(1, frameSize.w*m_scale.x),
                      std::max<int>(1, frameSize.h*m_scale.y));
     }
+    invalidateScaledImage();
   }
 
   void setUnscaledImageToSave(const doc::frame_t frame,
                               const doc::ImageRef& image) {
-    // If we don't need to rescale the input "image", we can just
-    // reference the same exact image to encode (as we don't need to
-    // call resize_image()).
-    if (!needResize()) {
-      m_tmpScaledImage = image;
-    }
-    else {
-      // In other case we need to create a temporal image to resize
-      // the input "image" to "m_tmpScaledImage" for the encoder.
-      if (!m_tmpScaledImage ||
-          m_tmpScaledImage->spec() != m_spec) {
-        m_tmpScaledImage.reset(doc::Image::create(m_spec));
-      }
-
-      doc::algorithm::resize_image(
-        image.get(),
-        m_tmpScaledImage.get(),
-        doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
-        palette(frame),
-        m_sprite->rgbMap(frame),
-        image->maskColor());
-    }
+    // The scaled image is not created here, getScanline() scales
+    // each requested row on the fly (so encoders that work row by
+    // row don't need a full copy of the scaled image in memory), and
+    // getScaledImage() creates it only if it's requested.
+    m_unscaledImage = image;
+    invalidateScaledImage();
   }
 
   // FileAbstractImage impl
@@ -141,11 +131,84 @@ public:
   }
 
   const doc::ImageRef getScaledImage() const override {
+    // If we don't need to rescale the input image, we can just
+    // reference the same exact image to encode.
+    if (!needResize())
+      return m_unscaledImage;
+
+    const std::lock_guard lock(m_scaledImageMutex);
+    if (!m_scaledImageIsValid) {
+      if (!m_tmpScaledImage ||
+          m_tmpScaledImage->spec() != m_spec) {
+        m_tmpScaledImage.reset(doc::Image::create(m_spec));
+      }
+
+      // The nearest neighbor method doesn't need the palette/RgbMap
+      // (so we don't touch the sprite RgbMap, which cannot be used
+      // from several threads).
+      doc::algorithm::resize_image(
+        m_unscaledImage.get(),
+        m_tmpScaledImage.get(),
+        doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+        nullptr, nullptr,
+        m_unscaledImage->maskColor());
+      m_scaledImageIsValid = true;
+    }
     return m_tmpScaledImage;
   }
 
+  // The returned row is valid until the next getScanline() call from
+  // the same thread. It can be called from several threads at the
+  // same time (e.g. to encode several bands of rows in parallel).
   const uint8_t* getScanline(int y) const override {
-    return m_tmpScaledImage->getPixelAddress(0, y);
+    if (!needResize())
+      return m_unscaledImage->getPixelAddress(0, y);
+
+    const doc::Image* src = m_unscaledImage.get();
+    if (src->pixelFormat() == doc::IMAGE_BITMAP)
+      return getScaledImage()->getPixelAddress(0, y);
+
+    // Each thread has its own scaled row, consecutive rows that come
+    // from the same source row (e.g. integer scales) are not
+    // converted again.
+    struct ScaledRow {
+      uint64_t imageId = 0;
+      int srcY = -1;
+      std::vector<int> srcX;
+      std::vector<uint8_t> pixels;
+    };
+    static thread_local ScaledRow row;
+
+    const int dstW = m_spec.width();
+    const int dstH = m_spec.height();
+    if (row.imageId != m_imageId) {
+      // Same mapping of pixels as resize_image_nearest()
+      const double xRatio = double(src->width()) / double(dstW);
+      row.imageId = m_imageId;
+      row.srcY = -1;
+      row.srcX.resize(dstW);
+      for (int x=0; x<dstW; ++x)
+        row.srcX[x] = int(std::floor(x * xRatio));
+      row.pixels.resize(std::size_t(dstW) * src->bytesPerPixel());
+    }
+
+    const double yRatio = double(src->height()) / double(dstH);
+    const int srcY = int(std::floor(y * yRatio));
+    if (row.srcY != srcY) {
+      switch (src->pixelFormat()) {
+        case doc::IMAGE_RGB:
+          scaleRow<doc::RgbTraits>(src, srcY, row.srcX, row.pixels.data());
+          break;
+        case doc::IMAGE_GRAYSCALE:
+          scaleRow<doc::GrayscaleTraits>(src, srcY, row.srcX, row.pixels.data());
+          break;
+        case doc::IMAGE_INDEXED:
+          scaleRow<doc::IndexedTraits>(src, srcY, row.srcX, row.pixels.data());
+          break;
+      }
+      row.srcY = srcY;
+    }
+    return row.pixels.data();
   }
 
   void renderFrame(const doc::frame_t frame,
@@ -153,31 +216,31 @@ public:
                    doc::Image* dst) const override {
     const bool needResize = this->needResize();
 
-    if (needResize &&
-        (!m_tmpUnscaledRender ||
-         m_tmpUnscaledRender->size() != frameBounds.size())) {
+    // Each call uses its own temporary image, so several frames can
+    // be rendered at the same time from different threads.
+    doc::ImageRef tmpUnscaledRender;
+    if (needResize) {
       auto spec = m_sprite->spec();
       spec.setSize(frameBounds.size());
       spec.setColorMode(dst->colorMode());
-      m_tmpUnscaledRender.reset(doc::Image::create(spec));
+      tmpUnscaledRender.reset(doc::Image::create(spec));
     }
 
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
     render.renderSprite(
-      (needResize ? m_tmpUnscaledRender.get(): dst),
+      (needResize ? tmpUnscaledRender.get(): dst),
       m_sprite, frame,
       gfx::Clip(gfx::Point(0, 0), frameBounds));
 
     if (needResize) {
       doc::algorithm::resize_image(
-        m_tmpUnscaledRender.get(),
+        tmpUnscaledRender.get(),
         dst,
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
-        palette(frame),
-        m_sprite->rgbMap(frame),
-        m_tmpUnscaledRender->maskColor());
+        nullptr, nullptr,
+        tmpUnscaledRender->maskColor());
     }
   }
 
@@ -185,6 +248,11 @@ public:
     m_scale = scale;
     m_spec.setWidth(m_spec.width() * m_scale.x);
     m_spec.setHeight(m_spec.height() * m_scale.y);
+    invalidateScaledImage();
+  }
+
+  const gfx::PointF& scale() const {
+    return m_scale;
   }
 
 private:
@@ -192,16 +260,43 @@ private:
     return (m_scale != gfx::PointF(1.0, 1.0));
   }
 
+  void invalidateScaledImage() {
+    const std::lock_guard lock(m_scaledImageMutex);
+    m_scaledImageIsValid = false;
+    m_imageId = ++g_imageId;
+  }
+
+  template<typename ImageTraits>
+  static void scaleRow(const doc::Image* src,
+                       const int srcY,
+                       const std::vector<int>& srcX,
+                       uint8_t* dst) {
+    auto srcRow = (const typename ImageTraits::pixel_t*)src->getPixelAddress(0, srcY);
+    auto dstRow = (typename ImageTraits::pixel_t*)dst;
+    for (const int x : srcX)
+      *(dstRow++) = srcRow[x];
+  }
+
+  // Used to identify the image given in each setUnscaledImageToSave()
+  // call (so the scaled rows cached in each thread can be discarded).
+  static std::atomic<uint64_t> g_imageId;
+
   const Doc* m_doc;
   const doc::Sprite* m_sprite;
   doc::ImageSpec m_spec;
   const bool m_supportAnimation;
   const bool m_newBlend;
-  doc::ImageRef m_tmpScaledImage = nullptr;
-  mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
+  doc::ImageRef m_unscaledImage = nullptr;
+  uint64_t m_imageId = 0;
+  mutable std::mutex m_scaledImageMutex;
+  mutable doc::ImageRef m_tmpScaledImage = nullptr;
+  mutable bool m_scaledImageIsValid = false;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
 };
 
+// static
+std::atomic<uint64_t> FileOp::FileAbstractImageImpl::g_imageId(0);
+
 base::paths get_readable_extensions()
 {
   base::paths paths;
@@ -523,6 +618,10 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context,
   if (flags & FILE_LOAD_ONE_FRAME)
     fop->m_oneframe = true;
 
+  // Load just the sprite structure without cels
+  if (flags & FILE_LOAD_METADATA_ONLY)
+    fop->m_metadataOnly = true;
+
   if (flags & FILE_LOAD_CREATE_PALETTE)
     fop->m_createPaletteFromRgba = true;
 
@@ -872,13 +971,62 @@ void FileOp::operate(IFileOpProgress* progress)
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)frames;
 
+      // Decode the files in several threads, each file is decoded by
+      // its own FileOp, and then its frame is added to this sprite
+      // in order (as if the files were loaded one by one). Only a few
+      // files are decoded ahead of the last added frame (to limit the
+      // used memory).
+      struct SequenceFile {
+        std::unique_ptr<FileOp> fop;
+        bool loadres = false;
+      };
+      std::vector<SequenceFile> files;
+      std::unique_ptr<doc::OrderedJobs> jobs;
+      const int nthreads = doc::OrderedJobs::calcThreads(frames);
+      const int maxFilesAhead = 2*nthreads;
+      int nextLoad = 0;
+
+      auto loadAhead = [this, &files, &jobs, &nextLoad, frames](const int limit) {
+        for (; nextLoad<std::min(limit, frames); ++nextLoad) {
+          jobs->add([this, &files, i=nextLoad]{
+            SequenceFile& file = files[i];
+            file.fop.reset(createSequenceFileOp(m_seq.filename_list[i],
+                                                frame_t(i)));
+            if (file.fop->isStop())
+              return;
+            try {
+              file.loadres = m_format->load(file.fop.get());
+            }
+            catch (const std::exception& ex) {
+              file.fop->setError("%s\n", ex.what());
+            }
+          });
+        }
+      };
+
+      if (nthreads > 1) {
+        files.resize(frames);
+        jobs = std::make_unique<doc::OrderedJobs>(nthreads);
+        loadAhead(maxFilesAhead);
+      }
+
       auto it = m_seq.filename_list.begin(),
            end = m_seq.filename_list.end();
       for (; it != end; ++it) {
         m_filename = it->c_str();
 
-        // Call the "load" procedure to read the first bitmap.
-        bool loadres = m_format->load(this);
+        bool loadres;
+        if (jobs) {
+          loadAhead(frame+1+maxFilesAhead);
+          jobs->wait(frame);
+          loadres = takeLoadedSequenceFile(files[frame].fop.get(),
+                                           files[frame].loadres);
+          files[frame].fop.reset();
+        }
+        else {
+          // Call the "load" procedure to read the first bitmap.
+          loadres = m_format->load(this);
+        }
         if (!loadres) {
           setError("Error loading frame %d from file \"%s\"\n",
                    frame+1, m_filename.c_str());
@@ -932,11 +1080,25 @@ void FileOp::operate(IFileOpProgress* progress)
 
         m_document->sprite()->setFrameDuration(frame, m_seq.duration);
 
+        if (jobs)
+          setProgress(1.0);
+
         ++frame;
         m_seq.progress_offset += m_seq.progress_fraction;
       }
       m_filename = *m_seq.filename_list.begin();
 
+      // Discard the files that were loaded after an error
+      if (jobs) {
+        jobs.reset();
+        for (SequenceFile& file : files) {
+          if (file.fop) {
+            delete file.fop->releaseDocument();
+            delete file.fop->m_seq.last_cel;
+          }
+        }
+      }
+
       // Final setup
       if (m_document) {
         // Configure the layer as the 'Background'
@@ -1004,63 +1166,70 @@ void FileOp::operate(IFileOpProgress* progress)
 
       Sprite* sprite = m_document->sprite();
 
-      // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      m_roi.fileCanvasSize().w,
-                                      m_roi.fileCanvasSize().h));
-
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
 
-      // For each frame in the sprite.
-      render::Render render;
-      render.setNewBlend(m_config.newBlend);
-
-      frame_t outputFrame = 0;
-      for (frame_t frame : m_roi.framesSequence()) {
-        gfx::Rect bounds = m_roi.frameBounds(frame);
-        if (bounds.isEmpty())
-          continue; // Skip frame because there is no slice key
-
-        if (m_abstractImage) {
-          m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
-                                       bounds.size());
-        }
+      // Frames are rendered and encoded in several threads
+      const int nthreads = doc::OrderedJobs::calcThreads(m_roi.frames());
+      if (nthreads > 1) {
+        saveSequenceInParallel(nthreads);
+      }
+      else {
+        // Create a temporary bitmap
+        m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                        m_roi.fileCanvasSize().w,
+                                        m_roi.fileCanvasSize().h));
+
+        // For each frame in the sprite.
+        render::Render render;
+        render.setNewBlend(m_config.newBlend);
+
+        frame_t outputFrame = 0;
+        for (frame_t frame : m_roi.framesSequence()) {
+          gfx::Rect bounds = m_roi.frameBounds(frame);
+          if (bounds.isEmpty())
+            continue; // Skip frame because there is no slice key
+
+          if (m_abstractImage) {
+            m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
+                                         bounds.size());
+          }
 
-        // Render the (unscaled) sequenced image.
-        render.renderSprite(
-          m_seq.image.get(), sprite, frame,
-          gfx::Clip(gfx::Point(0, 0), bounds));
+          // Render the (unscaled) sequenced image.
+          render.renderSprite(
+            m_seq.image.get(), sprite, frame,
+            gfx::Clip(gfx::Point(0, 0), bounds));
 
-        bool save = true;
+          bool save = true;
 
-        // Check if we have to ignore empty frames
-        if (m_ignoreEmpty &&
-            !sprite->isOpaque() &&
-            doc::is_empty_image(m_seq.image.get())) {
-          save = false;
-        }
+          // Check if we have to ignore empty frames
+          if (m_ignoreEmpty &&
+              !sprite->isOpaque() &&
+              doc::is_empty_image(m_seq.image.get())) {
+            save = false;
+          }
 
-        if (save) {
-          // Setup the palette.
-          sprite->palette(frame)->copyColorsTo(m_seq.palette);
+          if (save) {
+            // Setup the palette.
+            sprite->palette(frame)->copyColorsTo(m_seq.palette);
 
-          // Setup the filename to be used.
-          m_filename = m_seq.filename_list[outputFrame];
+            // Setup the filename to be used.
+            m_filename = m_seq.filename_list[outputFrame];
 
-          // Make directories
-          makeDirectories();
+            // Make directories
+            makeDirectories();
 
-          // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
-            setError("Error saving frame %d in the file \"%s\"\n",
-                     outputFrame+1, m_filename.c_str());
-            break;
+            // Call the "save" procedure... did it fail?
+            if (!m_format->save(this)) {
+              setError("Error saving frame %d in the file \"%s\"\n",
+                       outputFrame+1, m_filename.c_str());
+              break;
+            }
           }
-        }
 
-        m_seq.progress_offset += m_seq.progress_fraction;
-        ++outputFrame;
+          m_seq.progress_offset += m_seq.progress_fraction;
+          ++outputFrame;
+        }
       }
 
       m_filename = *m_seq.filename_list.begin();
@@ -1505,6 +1674,9 @@ bool FileOp::isStop() const
     std::scoped_lock lock(m_mutex);
     stop = m_stop;
   }
+  // A file of a sequence is stopped with the whole sequence
+  if (!stop && m_sequenceOwner)
+    stop = m_sequenceOwner->isStop();
   return stop;
 }
 
@@ -1514,12 +1686,15 @@ FileOp::FileOp(FileOpType type,
   : m_type(type)
   , m_format(nullptr)
   , m_context(context)
+  , m_sequenceOwner(nullptr)
   , m_document(nullptr)
   , m_progress(0.0)
   , m_progressInterface(nullptr)
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_metadataOnly(false)
+  , m_thumbnailSize(0)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
@@ -1550,6 +1725,166 @@ void FileOp::prepareForSequence()
   m_formatOptions.reset();
 }
 
+FileOp* FileOp::createSequenceFileOp(const std::string& filename,
+                                     const frame_t frame) const
+{
+  ASSERT(isSequence());
+
+  auto fop = std::unique_ptr<FileOp>(new FileOp(m_type, nullptr, &m_config));
+  fop->m_format = m_format;
+  fop->m_sequenceOwner = this;
+  fop->m_filename = filename;
+  fop->m_formatOptions = m_formatOptions;
+  fop->m_seq.palette = new Palette(frame_t(0), 256);
+  fop->m_seq.frame = frame;
+  fop->m_seq.has_alpha = false;
+  return fop.release();
+}
+
+// Moves the frame that "fop" loaded in a worker thread (its document,
+// image, cel, and palette) to this FileOp, as if this FileOp had
+// loaded the file. Returns the result of the "load" procedure.
+bool FileOp::takeLoadedSequenceFile(FileOp* fop, const bool loadres)
+{
+  if (!fop->m_error.empty())
+    setError("%s", fop->m_error.c_str());
+  if (!fop->m_incompatibilityError.empty())
+    setIncompatibilityError(fop->m_incompatibilityError);
+
+  std::unique_ptr<Doc> doc(fop->releaseDocument());
+  std::unique_ptr<Cel> cel(fop->m_seq.last_cel);
+  fop->m_seq.last_cel = nullptr;
+  if (!doc || !cel)
+    return loadres;
+
+  if (!m_document) {
+    m_document = doc.release();
+    m_seq.layer = fop->m_seq.layer;
+  }
+  else {
+    Sprite* sprite = m_document->sprite();
+    const Sprite* fileSprite = doc->sprite();
+    if (sprite->pixelFormat() != fileSprite->pixelFormat()) {
+      setError("Error: image does not match color mode\n");
+      return false;
+    }
+    if (fileSprite->transparentColor() != 0)
+      sprite->setTransparentColor(fileSprite->transparentColor());
+  }
+
+  m_seq.image = fop->m_seq.image;
+  m_seq.last_cel = cel.release();
+  std::swap(m_seq.palette, fop->m_seq.palette);
+  if (fop->m_seq.has_alpha)
+    m_seq.has_alpha = true;
+  if (fop->m_formatOptions)
+    m_formatOptions = fop->m_formatOptions;
+  if (fop->m_embeddedColorProfile)
+    m_embeddedColorProfile = true;
+  return loadres;
+}
+
+// Each frame is rendered and encoded in a worker thread by its own
+// FileOp, errors are reported in order (as in a serial save).
+void FileOp::saveSequenceInParallel(const int nthreads)
+{
+  const Sprite* sprite = m_document->sprite();
+  const gfx::Size canvasSize = m_roi.fileCanvasSize();
+
+  struct SequenceFrame {
+    frame_t frame;
+    frame_t outputFrame;
+    bool saveres = false;
+    std::string error;
+  };
+  std::vector<SequenceFrame> frames;
+  frame_t outputFrame = 0;
+  for (frame_t frame : m_roi.framesSequence()) {
+    // Skip frames without slice key
+    if (!m_roi.frameBounds(frame).isEmpty())
+      frames.push_back(SequenceFrame{ frame, outputFrame++ });
+  }
+
+  // To avoid creating the same directory from two threads
+  std::mutex dirMutex;
+
+  doc::OrderedJobs jobs(nthreads);
+  for (int i=0; i<int(frames.size()); ++i) {
+    jobs.add([this, sprite, canvasSize, &frames, &dirMutex, i]{
+      SequenceFrame& seqFrame = frames[i];
+      const frame_t frame = seqFrame.frame;
+      const gfx::Rect bounds = m_roi.frameBounds(frame);
+
+      std::unique_ptr<FileOp> fop(
+        createSequenceFileOp(m_seq.filename_list[seqFrame.outputFrame],
+                             frame));
+      if (fop->isStop())
+        return;
+
+      fop->m_document = m_document;
+      fop->m_roi = m_roi;
+      if (m_format->support(FILE_ENCODE_ABSTRACT_IMAGE)) {
+        fop->makeAbstractImage();
+        if (m_abstractImage)
+          fop->m_abstractImage->setScale(m_abstractImage->scale());
+        fop->m_abstractImage->setSpecSize(canvasSize, bounds.size());
+      }
+
+      try {
+        // Render the (unscaled) sequenced image.
+        fop->m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                             canvasSize.w,
+                                             canvasSize.h));
+        render::Render render;
+        render.setNewBlend(m_config.newBlend);
+        render.renderSprite(
+          fop->m_seq.image.get(), sprite, frame,
+          gfx::Clip(gfx::Point(0, 0), bounds));
+
+        // Check if we have to ignore empty frames
+        if (m_ignoreEmpty &&
+            !sprite->isOpaque() &&
+            doc::is_empty_image(fop->m_seq.image.get())) {
+          seqFrame.saveres = true;
+        }
+        else {
+          sprite->palette(frame)->copyColorsTo(fop->m_seq.palette);
+          {
+            const std::lock_guard lock(dirMutex);
+            fop->makeDirectories();
+          }
+          seqFrame.saveres = m_format->save(fop.get());
+        }
+      }
+      catch (const std::exception& ex) {
+        fop->setError("%s\n", ex.what());
+      }
+
+      seqFrame.error = fop->m_error;
+      fop->m_document = nullptr;
+    });
+  }
+
+  for (int i=0; i<int(frames.size()); ++i) {
+    jobs.wait(i);
+
+    const SequenceFrame& seqFrame = frames[i];
+    if (!seqFrame.error.empty())
+      setError("%s", seqFrame.error.c_str());
+
+    if (!seqFrame.saveres) {
+      m_filename = m_seq.filename_list[seqFrame.outputFrame];
+      setError("Error saving frame %d in the file \"%s\"\n",
+               seqFrame.outputFrame+1, m_filename.c_str());
+      jobs.cancel();
+      break;
+    }
+
+    setProgress(1.0);
+    m_seq.progress_offset += m_seq.progress_fraction;
+  }
+}
+
 void FileOp::makeDirectories()
 {
   std::string dir = base::get_file_path(m_filename);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -34,6 +34,7 @@
 #define FILE_LOAD_ONE_FRAME             0x00000010
 #define FILE_LOAD_DATA_FILE             0x00000020
 #define FILE_LOAD_CREATE_PALETTE        0x00000040
+#define FILE_LOAD_METADATA_ONLY         0x00000080
 
 namespace doc {
   class Tag;
@@ -134,11 +135,14 @@ namespace app {
     // In case that the file format can encode scanline by scanline
     // (e.g. PNG format) we can request each row to encode (without
     // the need to call getScaledImage()). Each scanline depends on
-    // the spec() width.
+    // the spec() width. Scaled rows are generated on demand, so the
+    // returned pointer is valid only until the next getScanline()
+    // call from the same thread.
     virtual const uint8_t* getScanline(int y) const = 0;
 
     // In case that the encoder supports animation and needs to render
-    // a full frame renders.
+    // a full frame renders. It can be called from several threads at
+    // the same time (to render several frames in parallel).
     virtual void renderFrame(const doc::frame_t frame,
                              const gfx::Rect& frameBounds,
                              doc::Image* dst) const = 0;
@@ -169,6 +173,14 @@ namespace app {
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+    bool isMetadataOnly() const { return m_metadataOnly; }
+
+    // Size of the thumbnail that will be generated from the loaded
+    // file (or 0 to load the file in its original size). Formats that
+    // can decode a reduced version of the image (e.g. JPEG, WebP) can
+    // create a smaller sprite (but not smaller than this size).
+    int thumbnailSize() const { return m_thumbnailSize; }
+    void setThumbnailSize(const int size) { m_thumbnailSize = size; }
     bool preserveColorProfile() const { return m_config.preserveColorProfile; }
     const FileFormat* fileFormat() const { return m_format; }
 
@@ -294,6 +306,9 @@ namespace app {
     FileOpType m_type;          // Operation type: 0=load, 1=save.
     FileFormat* m_format;
     Context* m_context;
+    // FileOp of the whole sequence when this FileOp loads/saves one
+    // of its files in a worker thread.
+    const FileOp* m_sequenceOwner;
     // TODO this should be a shared pointer (and we should remove
     //      releaseDocument() member function)
     Doc* m_document;            // Loaded document, or document to be saved.
@@ -312,6 +327,10 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_metadataOnly;        // Load only the sprite structure
+                                // (layers, tags, slices, user
+                                // data) without cels (only ASE).
+    int m_thumbnailSize;        // Load a reduced image (only for thumbnails).
     bool m_createPaletteFromRgba;
     bool m_ignoreEmpty;
 
@@ -350,6 +369,13 @@ namespace app {
     void prepareForSequence();
     void makeAbstractImage();
     void makeDirectories();
+
+    // Used to load/save the files of a sequence in several threads,
+    // each file is loaded/saved by its own FileOp.
+    FileOp* createSequenceFileOp(const std::string& filename,
+                                 const frame_t frame) const;
+    bool takeLoadedSequenceFile(FileOp* fop, const bool loadres);
+    void saveSequenceInParallel(const int nthreads);
   };
 
   // Available extensions for each load/save operation.
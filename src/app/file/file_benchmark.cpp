@@ -0,0 +1,222 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/fs.h"
+#include "doc/doc.h"
+#include "fmt/format.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+// Images of each file format are created with these sizes.
+const int kSizes[] = { 64, 256, 1024 };
+
+// Number of frames for formats that support animation.
+const int kFrames[] = { 1, 8 };
+
+struct ColorModeInfo {
+  ColorMode mode;
+  int flag;
+  const char* name;
+};
+
+const ColorModeInfo kColorModes[] = {
+  { ColorMode::RGB, FILE_SUPPORT_RGB, "rgb" },
+  { ColorMode::GRAYSCALE, FILE_SUPPORT_GRAY, "gray" },
+  { ColorMode::INDEXED, FILE_SUPPORT_INDEXED, "indexed" },
+};
+
+// Creates a document with random horizontal runs of colors (so it's
+// not too easy or too hard to compress for lossless formats).
+Doc* create_fixture(const ColorMode mode,
+                    const int w, const int h,
+                    const int frames)
+{
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(mode, w, h), 256);
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  for (frame_t f=1; f<frames; ++f) {
+    sprite->addFrame(f);
+    layer->addCel(new Cel(f, ImageRef(Image::create(ImageSpec(mode, w, h)))));
+  }
+
+  std::srand(w*h*frames);
+  for (frame_t f=0; f<frames; ++f) {
+    Image* image = layer->cel(f)->image();
+    color_t c = 0;
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        if ((std::rand() & 7) == 0) {
+          switch (mode) {
+            case ColorMode::RGB:
+              c = rgba(std::rand() & 255, std::rand() & 255,
+                       std::rand() & 255, 255);
+              break;
+            case ColorMode::GRAYSCALE:
+              c = graya(std::rand() & 255, 255);
+              break;
+            case ColorMode::INDEXED:
+              c = std::rand() & 255;
+              break;
+          }
+        }
+        put_pixel(image, x, y, c);
+      }
+    }
+  }
+
+  return new Doc(sprite);
+}
+
+// Bytes of pixels in the fixture (to report the MB/s).
+int64_t fixture_bytes(const ColorMode mode,
+                      const int w, const int h,
+                      const int frames)
+{
+  return int64_t(w) * h * frames * bytes_per_pixel_for_colormode(mode);
+}
+
+void BM_SaveFile(benchmark::State& state,
+                 Context* ctx,
+                 const std::string& ext,
+                 const ColorMode mode,
+                 const int size,
+                 const int frames)
+{
+  std::unique_ptr<Doc> doc(create_fixture(mode, size, size, frames));
+  doc->setContext(ctx);
+  doc->setFilename(fmt::format("_bench_save.{}", ext));
+
+  for (auto _ : state) {
+    if (save_document(ctx, doc.get()) != 0) {
+      state.SkipWithError("Error saving file");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          fixture_bytes(mode, size, size, frames));
+
+  if (base::is_file(doc->filename()))
+    base::delete_file(doc->filename());
+  doc->close();
+}
+
+void BM_LoadFile(benchmark::State& state,
+                 Context* ctx,
+                 const std::string& ext,
+                 const ColorMode mode,
+                 const int size,
+                 const int frames)
+{
+  const std::string fn = fmt::format("_bench_load.{}", ext);
+  {
+    std::unique_ptr<Doc> doc(create_fixture(mode, size, size, frames));
+    doc->setContext(ctx);
+    doc->setFilename(fn);
+    const int result = save_document(ctx, doc.get());
+    doc->close();
+    if (result != 0) {
+      state.SkipWithError("Error saving the file to load");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    std::unique_ptr<Doc> doc(load_document(ctx, fn));
+    if (!doc) {
+      state.SkipWithError("Error loading file");
+      break;
+    }
+    doc->close();
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          fixture_bytes(mode, size, size, frames));
+
+  base::delete_file(fn);
+}
+
+// Registers load/save benchmarks for each combination of size,
+// number of frames, and color mode supported by each file format.
+void register_benchmarks(Context* ctx)
+{
+  for (const FileFormat* format : *FileFormatsManager::instance()) {
+    // Formats that cannot save files cannot create their fixtures
+    // either (e.g. psd).
+    if (!format->support(FILE_SUPPORT_SAVE))
+      continue;
+
+    base::paths exts;
+    format->getExtensions(exts);
+    if (exts.empty())
+      continue;
+
+    const std::string ext = exts.front();
+    const bool canLoad = format->support(FILE_SUPPORT_LOAD);
+
+    for (const ColorModeInfo& cm : kColorModes) {
+      if (!format->support(cm.flag))
+        continue;
+
+      for (const int size : kSizes) {
+        // .ico files cannot contain images bigger than 256x256
+        if (ext == "ico" && size > 256)
+          continue;
+
+        for (const int frames : kFrames) {
+          // Files of formats without animation support are saved as
+          // a sequence of files.
+          if (frames > 1 && !format->support(FILE_SUPPORT_FRAMES))
+            continue;
+
+          const std::string args =
+            fmt::format("{}/{}/{}x{}/{}", ext, cm.name, size, size, frames);
+
+          benchmark::RegisterBenchmark(
+            ("BM_SaveFile/" + args).c_str(),
+            BM_SaveFile, ctx, ext, cm.mode, size, frames)
+            ->Unit(benchmark::kMillisecond);
+
+          if (canLoad) {
+            benchmark::RegisterBenchmark(
+              ("BM_LoadFile/" + args).c_str(),
+              BM_LoadFile, ctx, ext, cm.mode, size, frames)
+              ->Unit(benchmark::kMillisecond);
+          }
+        }
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  Context ctx;
+  register_benchmarks(&ctx);
+
+  ::benchmark::Initialize(&argc, argv);
+  const int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  FileFormatsManager::destroyInstance();
+  return status;
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,8 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
+#include "app/file/png_options.h"
+#include "app/file/svg_options.h"
 #include "base/base64.h"
 #include "doc/doc.h"
 #include "doc/user_data.h"
@@ -20,6 +22,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <functional>
+#include <iterator>
+#include <sstream>
 #include <vector>
 #include <fstream>
 
@@ -341,3 +345,268 @@ TEST(File, CustomProperties)
     }
   }
 }
+
+// Big PNG images are compressed in several threads (see
+// write_png_rows_in_parallel()), the decoded pixels must be the same
+// with any compression level and filter.
+TEST(File, PngParallelSave)
+{
+  app::Context ctx;
+
+  struct Test {
+    doc::ColorMode mode;
+    int size;                   // To save at least 4 MB of rows
+  };
+  const Test tests[] = {
+    { doc::ColorMode::RGB, 1100 },
+    { doc::ColorMode::GRAYSCALE, 1500 },
+    { doc::ColorMode::INDEXED, 2100 },
+  };
+
+  struct Options {
+    int level;
+    PngOptions::Filter filter;
+  };
+  const Options options[] = {
+    { -1, PngOptions::Filter::Default },
+    { 0, PngOptions::Filter::None },
+    { 1, PngOptions::Filter::Sub },
+    { 6, PngOptions::Filter::Up },
+    { 6, PngOptions::Filter::Average },
+    { 6, PngOptions::Filter::Paeth },
+    { 9, PngOptions::Filter::Adaptive },
+  };
+
+  for (const Test& test : tests) {
+    const int w = test.size, h = test.size;
+
+    // Random runs of colors (and transparent pixels)
+    ImageRef original(Image::create(ImageSpec(test.mode, w, h)));
+    std::srand(w*h);
+    color_t c = 0;
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        if ((std::rand() & 7) == 0) {
+          const bool transparent = ((std::rand() & 15) == 0);
+          switch (test.mode) {
+            case ColorMode::RGB:
+              c = (transparent ? rgba(0, 0, 0, 0):
+                                 rgba(std::rand() & 255, std::rand() & 255,
+                                      std::rand() & 255, 255));
+              break;
+            case ColorMode::GRAYSCALE:
+              c = (transparent ? graya(0, 0):
+                                 graya(std::rand() & 255, 255));
+              break;
+            case ColorMode::INDEXED:
+              c = std::rand() & 255;
+              break;
+          }
+        }
+        put_pixel(original.get(), x, y, c);
+      }
+    }
+
+    for (const Options& opt : options) {
+      {
+        std::unique_ptr<Doc> doc(
+          ctx.documents().add(w, h, test.mode, 256));
+        doc->setFilename("test.png");
+
+        Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+        copy_image(image, original.get());
+
+        auto pngOptions = std::make_shared<PngOptions>();
+        pngOptions->compressionLevel(opt.level);
+        pngOptions->filter(opt.filter);
+        doc->setFormatOptions(pngOptions);
+
+        ASSERT_EQ(0, save_document(&ctx, doc.get()));
+        doc->close();
+      }
+      {
+        std::unique_ptr<Doc> doc(load_document(&ctx, "test.png"));
+        ASSERT_TRUE(doc != nullptr);
+        ASSERT_EQ(w, doc->sprite()->width());
+        ASSERT_EQ(h, doc->sprite()->height());
+
+        const Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+        ASSERT_EQ(original->pixelFormat(), image->pixelFormat());
+        EXPECT_EQ(0, count_diff_between_images(original.get(), image))
+          << "Color mode " << int(test.mode)
+          << " level " << opt.level
+          << " filter " << int(opt.filter);
+
+        doc->close();
+      }
+    }
+  }
+}
+
+// Each SVG shapes mode merges the same pixels in different elements.
+TEST(File, SvgShapes)
+{
+  app::Context ctx;
+  const color_t r = rgba(255, 0, 0, 255);
+  const color_t b = rgba(0, 0, 255, 128);
+
+  struct Test {
+    SvgOptions::Shapes shapes;
+    const char* elements;
+  };
+  const Test tests[] = {
+    { SvgOptions::Shapes::Pixels,
+      "<rect x=\"0\" y=\"0\" width=\"1\" height=\"1\" fill=\"#FF0000\" />\n"
+      "<rect x=\"1\" y=\"0\" width=\"1\" height=\"1\" fill=\"#FF0000\" />\n"
+      "<rect x=\"2\" y=\"0\" width=\"1\" height=\"1\" fill=\"#0000FF\" opacity=\"0.501961\" />\n"
+      "<rect x=\"0\" y=\"1\" width=\"1\" height=\"1\" fill=\"#FF0000\" />\n"
+      "<rect x=\"1\" y=\"1\" width=\"1\" height=\"1\" fill=\"#FF0000\" />\n" },
+    { SvgOptions::Shapes::Runs,
+      "<rect x=\"0\" y=\"0\" width=\"2\" height=\"1\" fill=\"#FF0000\" />\n"
+      "<rect x=\"2\" y=\"0\" width=\"1\" height=\"1\" fill=\"#0000FF\" opacity=\"0.501961\" />\n"
+      "<rect x=\"0\" y=\"1\" width=\"2\" height=\"1\" fill=\"#FF0000\" />\n" },
+    { SvgOptions::Shapes::Rects,
+      "<rect x=\"0\" y=\"0\" width=\"2\" height=\"2\" fill=\"#FF0000\" />\n"
+      "<rect x=\"2\" y=\"0\" width=\"1\" height=\"1\" fill=\"#0000FF\" opacity=\"0.501961\" />\n" },
+    { SvgOptions::Shapes::Paths,
+      "<path fill=\"#FF0000\" d=\"M0 0h2v2h-2z\"/>\n"
+      "<path fill=\"#0000FF\" opacity=\"0.501961\" d=\"M2 0h1v1h-1z\"/>\n" },
+  };
+
+  for (const Test& test : tests) {
+    {
+      std::unique_ptr<Doc> doc(
+        ctx.documents().add(3, 2, doc::ColorMode::RGB, 256));
+      doc->setFilename("test.svg");
+
+      // Pixels:  r r b
+      //          r r -
+      Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+      put_pixel(image, 0, 0, r);
+      put_pixel(image, 1, 0, r);
+      put_pixel(image, 2, 0, b);
+      put_pixel(image, 0, 1, r);
+      put_pixel(image, 1, 1, r);
+
+      auto svgOptions = std::make_shared<SvgOptions>();
+      svgOptions->shapes = test.shapes;
+      doc->setFormatOptions(svgOptions);
+
+      ASSERT_EQ(0, save_document(&ctx, doc.get()));
+      doc->close();
+    }
+
+    std::ifstream f("test.svg", std::ios::binary);
+    std::stringstream content;
+    content << f.rdbuf();
+    EXPECT_EQ(std::string(
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+                "<svg version=\"1.1\" width=\"3\" height=\"2\" "
+                "xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n")
+              + test.elements + "</svg>",
+              content.str())
+      << "Shapes " << int(test.shapes);
+  }
+}
+
+static std::vector<uint8_t> read_file_bytes(const std::string& fn)
+{
+  std::ifstream f(fn, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f),
+                              std::istreambuf_iterator<char>());
+}
+
+// Thumbnails of JPEG files use the thumbnail embedded in the EXIF
+// data when it's big enough.
+TEST(File, JpegExifThumbnail)
+{
+  app::Context ctx;
+
+  auto save_jpeg = [&ctx](const std::string& fn,
+                          const int w, const int h,
+                          const color_t color) {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(w, h, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+    clear_image(doc->sprite()->root()->firstLayer()->cel(0)->image(), color);
+    ASSERT_EQ(0, save_document(&ctx, doc.get()));
+    doc->close();
+  };
+  save_jpeg("test_exif_thumbnail.jpg", 160, 120, rgba(255, 0, 0, 255));
+  save_jpeg("test_exif_image.jpg", 2000, 1500, rgba(0, 0, 255, 255));
+
+  const std::vector<uint8_t> thumbnail = read_file_bytes("test_exif_thumbnail.jpg");
+  const std::vector<uint8_t> image = read_file_bytes("test_exif_image.jpg");
+  ASSERT_GT(image.size(), size_t(2));
+
+  // APP1 marker with the EXIF data: a little-endian TIFF header, an
+  // empty IFD0, and an IFD1 with the offset/length of the thumbnail
+  std::vector<uint8_t> exif = { 'E', 'x', 'i', 'f', 0, 0 };
+  auto add16 = [&exif](const uint32_t v) {
+    exif.push_back(v & 0xff);
+    exif.push_back((v >> 8) & 0xff);
+  };
+  auto add32 = [&add16](const uint32_t v) {
+    add16(v & 0xffff);
+    add16(v >> 16);
+  };
+  exif.push_back('I');
+  exif.push_back('I');
+  add16(42);
+  add32(8);                     // IFD0 offset
+  add16(0);                     // IFD0 entries
+  add32(14);                    // IFD1 offset
+  add16(2);                     // IFD1 entries
+  add16(0x0201); add16(4); add32(1); add32(44);
+  add16(0x0202); add16(4); add32(1); add32(uint32_t(thumbnail.size()));
+  add32(0);                     // No more IFDs
+  ASSERT_EQ(size_t(6+44), exif.size());
+  exif.insert(exif.end(), thumbnail.begin(), thumbnail.end());
+
+  // Insert the APP1 marker after the SOI marker
+  std::vector<uint8_t> output(image.begin(), image.begin()+2);
+  output.push_back(0xff);
+  output.push_back(0xe1);
+  output.push_back(((exif.size()+2) >> 8) & 0xff);
+  output.push_back((exif.size()+2) & 0xff);
+  output.insert(output.end(), exif.begin(), exif.end());
+  output.insert(output.end(), image.begin()+2, image.end());
+  {
+    std::ofstream f("test_exif.jpg", std::ios::binary);
+    f.write((const char*)output.data(), output.size());
+  }
+
+  // Load the thumbnail
+  {
+    std::unique_ptr<FileOp> fop(
+      FileOp::createLoadDocumentOperation(
+        &ctx, "test_exif.jpg",
+        FILE_LOAD_CREATE_PALETTE |
+        FILE_LOAD_SEQUENCE_NONE |
+        FILE_LOAD_ONE_FRAME));
+    ASSERT_TRUE(fop != nullptr);
+    fop->setThumbnailSize(128);
+    fop->operate();
+    fop->done();
+    EXPECT_FALSE(fop->hasError());
+
+    std::unique_ptr<Doc> doc(fop->releaseDocument());
+    ASSERT_TRUE(doc != nullptr);
+    EXPECT_EQ(160, doc->sprite()->width());
+    EXPECT_EQ(120, doc->sprite()->height());
+
+    const color_t c = get_pixel(doc->sprite()->root()->firstLayer()->cel(0)->image(), 80, 60);
+    EXPECT_GT(rgba_getr(c), 200);
+    EXPECT_LT(rgba_getb(c), 50);
+    doc->close();
+  }
+
+  // Load the whole image
+  {
+    std::unique_ptr<Doc> doc(load_document(&ctx, "test_exif.jpg"));
+    ASSERT_TRUE(doc != nullptr);
+    EXPECT_EQ(2000, doc->sprite()->width());
+    EXPECT_EQ(1500, doc->sprite()->height());
+    doc->close();
+  }
+}
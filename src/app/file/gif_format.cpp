@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -25,6 +25,7 @@
 #include "base/fs.h"
 #include "doc/doc.h"
 #include "doc/octree_map.h"
+#include "doc/ordered_jobs.h"
 #include "gfx/clip.h"
 #include "render/dithering.h"
 #include "render/ordered_dither.h"
@@ -35,6 +36,9 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
 
 #include <gif_lib.h>
 
@@ -1081,10 +1085,9 @@ public:
 
     // Create the 3 temporary images (previous/current/next) to
     // compare pixels between them.
-    for (int i=0; i<3; ++i)
-      m_images[i].reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
-                                      m_spriteBounds.w,
-                                      m_spriteBounds.h));
+    m_previousImage.reset(createFrameImage());
+    m_currentImage.reset(createFrameImage());
+    m_nextImage.reset(createFrameImage());
   }
 
   ~GifEncoder() {
@@ -1097,36 +1100,81 @@ public:
     if (m_loop >= 0)
       writeLoopExtension();
 
-    // Previous and next images are used to decide the best disposal
-    // method (e.g. if it's more convenient to restore the background
-    // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    auto frame_beg = m_fop->roi().framesSequence().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().framesSequence().end();
-#endif
-    auto frame_it = frame_beg;
-
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
-    gifframe_t nframes = totalFrames();
-    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
+    const gifframe_t nframes = totalFrames();
+    std::vector<frame_t> frames;
+    frames.reserve(nframes);
+    for (frame_t frame : m_fop->roi().framesSequence())
+      frames.push_back(frame);
+    ASSERT(int(frames.size()) == nframes);
+
+    // The rendering and the quantization of frames run ahead in
+    // worker threads. Only the delta image calculation (which
+    // depends on the previous frame) and the GIF writing are done in
+    // this thread, frame by frame in order.
+    const int nthreads = doc::OrderedJobs::calcThreads(nframes);
+    const gifframe_t maxFramesAhead = 2*nthreads;
+    std::vector<EncoderFrame> gifFrames(nframes);
+    doc::OrderedJobs jobs(nthreads);
+    gifframe_t nextRender = 0;
+    gifframe_t nextWrite = 0;
+
+    auto renderAhead = [&](const gifframe_t limit) {
+      for (; nextRender<std::min(limit, nframes); ++nextRender) {
+        EncoderFrame& gf = gifFrames[nextRender];
+        const frame_t frame = frames[nextRender];
+        gf.renderJob = jobs.add([this, &gf, frame]{
+          try {
+            ImageRef image(createFrameImage());
+            renderFrame(frame, image.get());
+            gf.image = image;
+          }
+          catch (...) {
+            gf.error = std::current_exception();
+          }
+        });
+      }
+    };
+
+    auto takeRenderedImage = [&](const gifframe_t gifFrame) -> ImageRef {
+      EncoderFrame& gf = gifFrames[gifFrame];
+      jobs.wait(gf.renderJob);
+      if (gf.error)
+        std::rethrow_exception(gf.error);
+      return std::move(gf.image);
+    };
+
+    auto writeNextFrame = [&]() {
+      const gifframe_t gifFrame = nextWrite++;
+      EncoderFrame& gf = gifFrames[gifFrame];
+      jobs.wait(gf.quantizeJob);
+      if (gf.error)
+        std::rethrow_exception(gf.error);
+
+      writeImage(gifFrame, frames[gifFrame], *gf.quantized,
+                 // Only the last frame in the animation needs the fix
+                 (fix_last_frame_duration && gifFrame == nframes-1));
+      gf.quantized.reset();
+
+      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+    };
+
+    renderAhead(maxFramesAhead);
 
+    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
+      // Previous and next images are used to decide the best disposal
+      // method (e.g. if it's more convenient to restore the background
+      // color or to restore the previous frame to reach the next one).
       if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
+        m_nextImage = takeRenderedImage(gifFrame);
       else
         std::swap(m_previousImage, m_currentImage);
 
-      // Render next frame
+      // Get the next rendered frame
       std::swap(m_currentImage, m_nextImage);
       if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+        m_nextImage = takeRenderedImage(gifFrame+1);
 
       gfx::Rect frameBounds = m_spriteBounds;
       DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
@@ -1140,22 +1188,66 @@ public:
 
       calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
+      // Quantize the delta image in a worker thread
+      EncoderFrame& gf = gifFrames[gifFrame];
+      gf.deltaImage = std::move(m_deltaImage);
+      gf.quantizeJob = jobs.add([this, &gf, frameBounds, disposal]{
+        try {
+          gf.quantized = quantizeFrame(gf.deltaImage.get(),
+                                       frameBounds, disposal);
+        }
+        catch (...) {
+          gf.error = std::current_exception();
+        }
+        gf.deltaImage.reset();
+      });
+
+      // Write the frames that are already quantized, or wait them if
+      // we are too far ahead (to limit the used memory).
+      while (nextWrite < gifFrame &&
+             (jobs.isDone(gifFrames[nextWrite].quantizeJob) ||
+              gifFrame - nextWrite >= maxFramesAhead)) {
+        writeNextFrame();
+      }
 
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      renderAhead(gifFrame+2+maxFramesAhead);
     }
+
+    while (nextWrite < nframes)
+      writeNextFrame();
+
     return true;
   }
 
 private:
 
+  // A frame ready to be written in the GIF file.
+  struct QuantizedFrame {
+    gfx::Rect frameBounds;
+    DisposalMethod disposal;
+    ImageRef frameImage;
+    // Palette for the local colormap of this frame (nullptr if we
+    // use the global colormap).
+    std::unique_ptr<Palette> localPalette;
+    int localTransparent;
+    Remap remap = Remap(256);
+  };
+
+  // Data of each GIF frame through the encoding pipeline.
+  struct EncoderFrame {
+    int renderJob = -1;
+    ImageRef image;
+    int quantizeJob = -1;
+    std::unique_ptr<Image> deltaImage;
+    std::unique_ptr<QuantizedFrame> quantized;
+    std::exception_ptr error;
+  };
+
   void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
                                               gfx::Rect& frameBounds,
                                               DisposalMethod& disposal) {
     if (gifFrame == 0) {
-      m_deltaImage.reset(Image::createCopy(m_currentImage));
+      m_deltaImage.reset(Image::createCopy(m_currentImage.get()));
       frameBounds = m_spriteBounds;
 
       // The first frame (frame 0) is good to force to disposal = DO_NOT_DISPOSE,
@@ -1164,8 +1256,8 @@ private:
 
       // "Pixel clearing" detection:
       if (!m_hasBackground && !m_preservePaletteOrder) {
-        const LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
+        const LockImageBits<RgbTraits> bits2(m_currentImage.get());
+        const LockImageBits<RgbTraits> bits3(m_nextImage.get());
         typename LockImageBits<RgbTraits>::const_iterator it2, it3, end2, end3;
         for (it2 = bits2.begin(), end2 = bits2.end(),
              it3 = bits3.begin(), end3 = bits3.end();
@@ -1205,9 +1297,9 @@ private:
 
         int i = 0;
         int x, y;
-        const LockImageBits<RgbTraits> bits1(m_previousImage);
-        LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
+        const LockImageBits<RgbTraits> bits1(m_previousImage.get());
+        LockImageBits<RgbTraits> bits2(m_currentImage.get());
+        const LockImageBits<RgbTraits> bits3(m_nextImage.get());
         m_deltaImage.reset(Image::create(PixelFormat::IMAGE_RGB, m_spriteBounds.w, m_spriteBounds.h));
         clear_image(m_deltaImage.get(), 0);
         LockImageBits<RgbTraits> deltaBits(m_deltaImage.get());
@@ -1257,7 +1349,7 @@ private:
       // In the other hand, if disposal is still DO_NOT_DISPOSAL, delta image will be a cropped image
       // from itself in frameBounds.
       if (disposal == DisposalMethod::RESTORE_BGCOLOR || m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-        m_deltaImage.reset(crop_image(m_currentImage, frameBounds, 0));
+        m_deltaImage.reset(crop_image(m_currentImage.get(), frameBounds, 0));
       }
       else {
         m_deltaImage.reset(crop_image(m_deltaImage.get(), frameBounds, 0));
@@ -1366,35 +1458,39 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Converts the delta image of a frame to the indexed image (and
+  // the palette) to write in the GIF file. It's called from worker
+  // threads, so it cannot modify the encoder state.
+  std::unique_ptr<QuantizedFrame> quantizeFrame(const Image* deltaImage,
+                                                const gfx::Rect& frameBounds,
+                                                const DisposalMethod disposal) const {
+    auto result = std::make_unique<QuantizedFrame>();
+    result->frameBounds = frameBounds;
+    result->disposal = disposal;
+
+    int transparentIndex = m_transparentIndex;
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(deltaImage, transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
+    octree.regenerateMap(&framePalette, transparentIndex);
     ImageRef frameImage(Image::create(IMAGE_INDEXED,
                                       frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+                                      frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = result->remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
+      const LockImageBits<RgbTraits> srcBits(deltaImage);
       LockImageBits<IndexedTraits> dstBits(frameImage.get());
 
       auto srcIt = srcBits.begin();
@@ -1414,13 +1510,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1443,34 +1539,53 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
-        Palette reducedPalette(0, usedNColors);
+      if (!m_globalColormap) {
+        auto reducedPalette = std::make_unique<Palette>(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
           if (usedColors[i]) {
-            reducedPalette.setEntry(j, framePalette.getEntry(i));
+            reducedPalette->setEntry(j, framePalette.getEntry(i));
             remap.map(i, j);
             ++j;
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
+        result->localPalette = std::move(reducedPalette);
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      frameImage.reset(Image::createCopy(deltaImage));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    result->frameImage = frameImage;
+    result->localTransparent = localTransparent;
+    return result;
+  }
+
+  void writeImage(const gifframe_t gifFrame,
+                  const frame_t frame,
+                  const QuantizedFrame& quantized,
+                  const bool fixDuration) {
+    const gfx::Rect& frameBounds = quantized.frameBounds;
+    const Image* frameImage = quantized.frameImage.get();
+    const Remap& remap = quantized.remap;
+
+    // The colormap is created in this thread (the color space
+    // conversion of createColorMap() uses the OS color spaces).
+    ColorMapObject* colormap = m_globalColormap;
+    if (quantized.localPalette)
+      colormap = createColorMap(quantized.localPalette.get());
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, frame, quantized.localTransparent,
+                   quantized.disposal, fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1516,9 +1631,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1650,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,12 +1660,18 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
 
-  void renderFrame(frame_t frame, Image* dst) {
+  Image* createFrameImage() const {
+    return Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                         m_spriteBounds.w,
+                         m_spriteBounds.h);
+  }
+
+  void renderFrame(frame_t frame, Image* dst) const {
     if (m_preservePaletteOrder)
       clear_image(dst, m_bgIndex);
     else
@@ -1602,11 +1724,9 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
-  Image* m_previousImage;
-  Image* m_currentImage;
-  Image* m_nextImage;
+  ImageRef m_previousImage;
+  ImageRef m_currentImage;
+  ImageRef m_nextImage;
   std::unique_ptr<Image> m_deltaImage;
 };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,11 +22,13 @@
 #include "base/file_handle.h"
 #include "base/memory.h"
 #include "doc/doc.h"
+#include "doc/ordered_jobs.h"
 
 #include <algorithm>
 #include <csetjmp>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
 
 #include "jpeg_options.xml.h"
 
@@ -131,13 +133,226 @@ static bool is_icc_marker(jpeg_marker_struct* marker)
     return !memcmp(marker->data, kICCSig, sizeof(kICCSig));
 }
 
+static constexpr uint32_t kExifMarker = JPEG_APP0 + 1;
+static constexpr uint8_t kExifSig[] = { 'E', 'x', 'i', 'f', '\0', '\0' };
+
+// Finds the JPEG thumbnail stored in the IFD1 of the EXIF data (TIFF
+// structure) of the given marker.
+static bool find_exif_thumbnail(const jpeg_marker_struct* marker,
+                                const uint8_t*& thumbnailData,
+                                size_t& thumbnailSize)
+{
+  if (marker->marker != kExifMarker ||
+      marker->data_length < sizeof(kExifSig) + 8 ||
+      memcmp(marker->data, kExifSig, sizeof(kExifSig)) != 0)
+    return false;
+
+  const uint8_t* tiff = marker->data + sizeof(kExifSig);
+  const size_t size = marker->data_length - sizeof(kExifSig);
+  const bool le = (tiff[0] == 'I' && tiff[1] == 'I');
+  if (!le && !(tiff[0] == 'M' && tiff[1] == 'M'))
+    return false;
+
+  auto fits = [size](const size_t pos, const size_t n) {
+    return (pos <= size && n <= size - pos);
+  };
+  auto read16 = [tiff, le](const size_t pos) -> uint32_t {
+    return (le ? (tiff[pos] | (tiff[pos+1] << 8)):
+                 ((tiff[pos] << 8) | tiff[pos+1]));
+  };
+  auto read32 = [tiff, le](const size_t pos) -> uint32_t {
+    return (le ? (tiff[pos] | (tiff[pos+1] << 8) |
+                  (tiff[pos+2] << 16) | (uint32_t(tiff[pos+3]) << 24)):
+                 ((uint32_t(tiff[pos]) << 24) | (tiff[pos+1] << 16) |
+                  (tiff[pos+2] << 8) | tiff[pos+3]));
+  };
+
+  if (read16(2) != 42)
+    return false;
+
+  // Skip the IFD0 (main image) to get the IFD1 (thumbnail)
+  size_t ifd = read32(4);
+  if (!fits(ifd, 2))
+    return false;
+  ifd += 2 + 12*size_t(read16(ifd));
+  if (!fits(ifd, 4))
+    return false;
+  ifd = read32(ifd);
+  if (ifd == 0 || !fits(ifd, 2))
+    return false;
+
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  const uint32_t entries = read16(ifd);
+  for (uint32_t i=0; i<entries; ++i) {
+    const size_t entry = ifd + 2 + 12*size_t(i);
+    if (!fits(entry, 12))
+      return false;
+    switch (read16(entry)) {
+      case 0x0201: offset = read32(entry+8); break; // JPEGInterchangeFormat
+      case 0x0202: length = read32(entry+8); break; // JPEGInterchangeFormatLength
+    }
+  }
+  if (offset == 0 || length == 0 || !fits(offset, length))
+    return false;
+
+  thumbnailData = tiff + offset;
+  thumbnailSize = length;
+  return true;
+}
+
+static void output_exif_thumbnail_message(j_common_ptr cinfo)
+{
+  char buffer[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, buffer);
+
+  // Errors in the EXIF thumbnail are not errors of the file (the
+  // whole image is decoded instead)
+  LOG(VERBOSE, "JPEG: EXIF thumbnail \"%s\"\n", buffer);
+}
+
+static void set_out_color_space(jpeg_decompress_struct* dinfo)
+{
+  if (dinfo->jpeg_color_space == JCS_GRAYSCALE)
+    dinfo->out_color_space = JCS_GRAYSCALE;
+  else {
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo can decode the pixels directly in our RGBA format
+    dinfo->out_color_space = JCS_EXT_RGBA;
+#else
+    dinfo->out_color_space = JCS_RGB;
+#endif
+  }
+}
+
+// Reads the scanlines of a started decompression in the given image
+// (of dinfo->output_width/output_height size).
+static void read_image(FileOp* fop, jpeg_decompress_struct* dinfo, Image* image)
+{
+  // The scanlines are decoded directly in the rows of the image (the
+  // decoded pixels use less or the same bytes than the image pixels).
+  // The buffer of rows is an array because jpeg_read_scanlines() can
+  // longjmp() and the destructor of a std::vector wouldn't be called.
+  JSAMPROW buffer[16];
+  const JDIMENSION buffer_height =
+    std::clamp<JDIMENSION>(dinfo->rec_outbuf_height, 1, 16);
+
+  // Read each scan line.
+  while (dinfo->output_scanline < dinfo->output_height) {
+    const JDIMENSION y = dinfo->output_scanline;
+    const JDIMENSION num_scanlines = std::min(buffer_height, dinfo->output_height - y);
+    for (JDIMENSION i=0; i<num_scanlines; ++i)
+      buffer[i] = (JSAMPROW)image->getPixelAddress(0, y+i);
+
+    jpeg_read_scanlines(dinfo, buffer, num_scanlines);
+
+    fop->setProgress((float)(dinfo->output_scanline+1) / (float)(dinfo->output_height));
+    if (fop->isStop())
+      break;
+  }
+
+  // Expand the decoded pixels to the image pixel format in place
+  // (from the end of each row to its beginning).
+  if (dinfo->output_components < image->bytesPerPixel()) {
+    const int w = image->width();
+
+    doc::for_each_row_band(
+      image->height(), image->rowBytes(),
+      [image, w](const int y0, const int y1) {
+        for (int y=y0; y<y1; ++y) {
+          uint8_t* row = image->getPixelAddress(0, y);
+
+          // RGB
+          if (image->pixelFormat() == IMAGE_RGB) {
+            const uint8_t* src_address = row + 3*w;
+            uint32_t* dst_address = ((uint32_t*)row) + w;
+            for (int x=0; x<w; ++x) {
+              src_address -= 3;
+              *(--dst_address) = rgba(src_address[0],
+                                      src_address[1],
+                                      src_address[2], 255);
+            }
+          }
+          // Grayscale
+          else {
+            const uint8_t* src_address = row + w;
+            uint16_t* dst_address = ((uint16_t*)row) + w;
+            for (int x=0; x<w; ++x)
+              *(--dst_address) = graya(*(--src_address), 255);
+          }
+        }
+      });
+  }
+}
+
+// Decodes the JPEG thumbnail embedded in the EXIF data if it's big
+// enough to generate a thumbnail of fop->thumbnailSize() and has the
+// aspect ratio of the image (some cameras add black bars to fit the
+// thumbnail in 160x120).
+//
+// The thumbnail is returned in an ImageRef of the caller because
+// libjpeg errors longjmp() to this function, and the destructor of a
+// local ImageRef wouldn't be called.
+static bool load_exif_thumbnail(FileOp* fop, jpeg_decompress_struct* dinfo,
+                                ImageRef& thumbnail)
+{
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  for (jpeg_marker_struct* marker = dinfo->marker_list; marker; marker = marker->next) {
+    if (find_exif_thumbnail(marker, data, size))
+      break;
+  }
+  if (!data)
+    return false;
+
+  struct jpeg_decompress_struct tinfo;
+  struct error_mgr jerr;
+  jerr.fop = fop;
+  tinfo.err = jpeg_std_error(&jerr.head);
+  jerr.head.error_exit = error_exit;
+  jerr.head.output_message = output_exif_thumbnail_message;
+
+  if (setjmp(jerr.setjmp_buffer)) {
+    jpeg_destroy_decompress(&tinfo);
+    thumbnail.reset();
+    return false;
+  }
+
+  jpeg_create_decompress(&tinfo);
+  jpeg_mem_src(&tinfo, (unsigned char*)data, (unsigned long)size);
+  jpeg_read_header(&tinfo, true);
+
+  const int64_t iw = dinfo->image_width;
+  const int64_t ih = dinfo->image_height;
+  const int64_t tw = tinfo.image_width;
+  const int64_t th = tinfo.image_height;
+  if (std::max(tw, th) < fop->thumbnailSize() ||
+      std::max(tw, th) >= std::max(iw, ih) ||
+      std::abs(tw*ih - th*iw) > std::max(iw, ih)) {
+    jpeg_destroy_decompress(&tinfo);
+    return false;
+  }
+
+  set_out_color_space(&tinfo);
+  tinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&tinfo);
+
+  thumbnail.reset(
+    Image::create((tinfo.out_color_space == JCS_GRAYSCALE ? IMAGE_GRAYSCALE:
+                                                            IMAGE_RGB),
+                  tinfo.output_width,
+                  tinfo.output_height));
+  read_image(fop, &tinfo, thumbnail.get());
+
+  jpeg_finish_decompress(&tinfo);
+  jpeg_destroy_decompress(&tinfo);
+  return true;
+}
+
 bool JpegFormat::onLoad(FileOp* fop)
 {
   struct jpeg_decompress_struct dinfo;
   struct error_mgr jerr;
-  JDIMENSION num_scanlines;
-  JSAMPARRAY buffer;
-  JDIMENSION buffer_height;
   int c;
 
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
@@ -150,6 +365,11 @@ bool JpegFormat::onLoad(FileOp* fop)
   jerr.head.error_exit = error_exit;
   jerr.head.output_message = output_message;
 
+  // Images used after setjmp() are declared here, so they are
+  // destroyed when we return after a libjpeg error.
+  ImageRef thumbnail;
+  ImageRef image;
+
   // Establish the setjmp return context for error_exit to use.
   if (setjmp(jerr.setjmp_buffer)) {
     jpeg_destroy_decompress(&dinfo);
@@ -166,113 +386,85 @@ bool JpegFormat::onLoad(FileOp* fop)
   // step on rewinds.
   jpeg_save_markers(&dinfo, kICCMarker, 0xFFFF);
 
+  // EXIF data to get the embedded thumbnail.
+  if (fop->thumbnailSize() > 0)
+    jpeg_save_markers(&dinfo, kExifMarker, 0xFFFF);
+
   // Read file header, set default decompression parameters.
   jpeg_read_header(&dinfo, true);
 
-  if (dinfo.jpeg_color_space == JCS_GRAYSCALE)
-    dinfo.out_color_space = JCS_GRAYSCALE;
-  else
-    dinfo.out_color_space = JCS_RGB;
+  // Use the thumbnail embedded in the EXIF data (if it's big enough)
+  // to avoid decoding the whole image.
+  if (fop->thumbnailSize() > 0)
+    load_exif_thumbnail(fop, &dinfo, thumbnail);
+
+  if (!thumbnail) {
+    set_out_color_space(&dinfo);
+
+    // Decode a reduced image (1/2, 1/4, or 1/8 of the original size)
+    // to generate thumbnails, which is a lot faster than decoding the
+    // whole image.
+    if (fop->thumbnailSize() > 0) {
+      const JDIMENSION size = std::max(dinfo.image_width, dinfo.image_height);
+      dinfo.scale_num = 1;
+      dinfo.scale_denom = 1;
+      while (dinfo.scale_denom < 8 &&
+             size / (dinfo.scale_denom*2) >= JDIMENSION(fop->thumbnailSize())) {
+        dinfo.scale_denom *= 2;
+      }
+      dinfo.dct_method = JDCT_IFAST;
+    }
 
-  // Start decompressor.
-  jpeg_start_decompress(&dinfo);
+    // Start decompressor.
+    jpeg_start_decompress(&dinfo);
+  }
 
   // Create the image.
-  ImageRef image = fop->sequenceImageToLoad(
-    (dinfo.out_color_space == JCS_RGB ? IMAGE_RGB:
-                                        IMAGE_GRAYSCALE),
-    dinfo.output_width,
-    dinfo.output_height);
-  if (!image) {
-    jpeg_destroy_decompress(&dinfo);
-    return false;
+  if (thumbnail) {
+    image = fop->sequenceImageToLoad(thumbnail->pixelFormat(),
+                                     thumbnail->width(),
+                                     thumbnail->height());
   }
-
-  // Create the buffer.
-  buffer_height = dinfo.rec_outbuf_height;
-  buffer = (JSAMPARRAY)base_malloc(sizeof(JSAMPROW) * buffer_height);
-  if (!buffer) {
+  else {
+    image = fop->sequenceImageToLoad(
+      (dinfo.out_color_space == JCS_GRAYSCALE ? IMAGE_GRAYSCALE:
+                                                IMAGE_RGB),
+      dinfo.output_width,
+      dinfo.output_height);
+  }
+  if (!image) {
     jpeg_destroy_decompress(&dinfo);
     return false;
   }
 
-  for (c=0; c<(int)buffer_height; c++) {
-    buffer[c] = (JSAMPROW)base_malloc(sizeof(JSAMPLE) *
-                                      dinfo.output_width * dinfo.output_components);
-    if (!buffer[c]) {
-      for (c--; c>=0; c--)
-        base_free(buffer[c]);
-      base_free(buffer);
-      jpeg_destroy_decompress(&dinfo);
-      return false;
-    }
-  }
-
   // Generate a grayscale palette if is necessary.
   if (image->pixelFormat() == IMAGE_GRAYSCALE)
     for (c=0; c<256; c++)
       fop->sequenceSetColor(c, c, c, c);
 
-  // Read each scan line.
-  while (dinfo.output_scanline < dinfo.output_height) {
-    num_scanlines = jpeg_read_scanlines(&dinfo, buffer, buffer_height);
-
-    // RGB
-    if (image->pixelFormat() == IMAGE_RGB) {
-      uint8_t* src_address;
-      uint32_t* dst_address;
-      int x, y, r, g, b;
-
-      for (y=0; y<(int)num_scanlines; y++) {
-        src_address = ((uint8_t**)buffer)[y];
-        dst_address = (uint32_t*)image->getPixelAddress(0, dinfo.output_scanline-1+y);
-
-        for (x=0; x<image->width(); x++) {
-          r = *(src_address++);
-          g = *(src_address++);
-          b = *(src_address++);
-          *(dst_address++) = rgba(r, g, b, 255);
-        }
-      }
+  if (thumbnail)
+    image->copy(thumbnail.get(), gfx::Clip(0, 0, thumbnail->bounds()));
+  else
+    read_image(fop, &dinfo, image.get());
+
+  // Read color space (in its own scope, so colorSpace is destroyed
+  // before calling libjpeg functions that can longjmp())
+  {
+    gfx::ColorSpaceRef colorSpace = loadColorSpace(fop, &dinfo);
+    if (colorSpace)
+      fop->setEmbeddedColorProfile();
+    else { // sRGB is the default JPG color space.
+      colorSpace = gfx::ColorSpace::MakeSRGB();
     }
-    // Grayscale
-    else {
-      uint8_t* src_address;
-      uint16_t* dst_address;
-      int x, y;
-
-      for (y=0; y<(int)num_scanlines; y++) {
-        src_address = ((uint8_t**)buffer)[y];
-        dst_address = (uint16_t*)image->getPixelAddress(0, dinfo.output_scanline-1+y);
-
-        for (x=0; x<image->width(); x++)
-          *(dst_address++) = graya(*(src_address++), 255);
-      }
+    if (colorSpace &&
+        fop->document()->sprite()->colorSpace()->type() == gfx::ColorSpace::None) {
+      fop->document()->sprite()->setColorSpace(colorSpace);
+      fop->document()->notifyColorSpaceChanged();
     }
-
-    fop->setProgress((float)(dinfo.output_scanline+1) / (float)(dinfo.output_height));
-    if (fop->isStop())
-      break;
   }
 
-  // Read color space
-  gfx::ColorSpaceRef colorSpace = loadColorSpace(fop, &dinfo);
-  if (colorSpace)
-    fop->setEmbeddedColorProfile();
-  else { // sRGB is the default JPG color space.
-    colorSpace = gfx::ColorSpace::MakeSRGB();
-  }
-  if (colorSpace &&
-      fop->document()->sprite()->colorSpace()->type() == gfx::ColorSpace::None) {
-    fop->document()->sprite()->setColorSpace(colorSpace);
-    fop->document()->notifyColorSpaceChanged();
-  }
-
-  for (c=0; c<(int)buffer_height; c++)
-    base_free(buffer[c]);
-  base_free(buffer);
-
-  jpeg_finish_decompress(&dinfo);
+  if (!thumbnail)
+    jpeg_finish_decompress(&dinfo);
   jpeg_destroy_decompress(&dinfo);
 
   return true;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,8 +16,11 @@
 #include "app/file/format_options.h"
 #include "base/cfile.h"
 #include "base/file_handle.h"
+#include "dio/file_interface.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace base;
@@ -117,26 +120,35 @@ bool PcxFormat::onLoad(FileOp* fop)
   if (bpp == 24)
     clear_image(image.get(), rgba(0, 0, 0, 255));
 
+  // The rest of the file (RLE data and palette) is read directly from
+  // memory.
+  dio::MappedFileInterface fi(f);
+  const size_t data_size = fi.size() - fi.tell();
+  const uint8_t* data = fi.readSpan(data_size);
+  const uint8_t* data_end = (data ? data + data_size: nullptr);
+  auto next_byte = [&data, data_end]() -> int {
+    return (data < data_end ? *(data++): EOF);
+  };
+
   for (y=0; y<height; y++) {       /* read RLE encoded PCX data */
     x = xx = 0;
     po = rgba_r_shift;
 
     while (x < bytes_per_line*bpp/8) {
-      ch = fgetc(f);
+      ch = next_byte();
       if ((ch & 0xC0) == 0xC0) {
         c = (ch & 0x3F);
-        ch = fgetc(f);
+        ch = next_byte();
       }
       else
         c = 1;
 
       if (bpp == 8) {
-        while (c--) {
-          if (x < image->width())
-            put_pixel_fast<IndexedTraits>(image.get(), x, y, ch);
-
-          x++;
+        if (x < image->width()) {
+          auto dst = (IndexedTraits::address_t)image->getPixelAddress(x, y);
+          std::fill_n(dst, std::min(c, image->width() - x), ch);
         }
+        x += c;
       }
       else {
         while (c--) {
@@ -166,12 +178,12 @@ bool PcxFormat::onLoad(FileOp* fop)
 
   if (!fop->isStop()) {
     if (bpp == 8) {                  /* look for a 256 color palette */
-      while ((c = fgetc(f)) != EOF) {
+      while ((c = next_byte()) != EOF) {
         if (c == 12) {
           for (c=0; c<256; c++) {
-            r = fgetc(f);
-            g = fgetc(f);
-            b = fgetc(f);
+            r = next_byte();
+            g = next_byte();
+            b = next_byte();
             fop->sequenceSetColor(c, r, g, b);
           }
           break;
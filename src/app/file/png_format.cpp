@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,20 +10,27 @@
 #endif
 
 #include "app/app.h"
+#include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
 #include "app/file/png_format.h"
 #include "app/file/png_options.h"
+#include "app/pref/preferences.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/ordered_jobs.h"
 #include "gfx/color_space.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -55,6 +62,7 @@ class PngFormat : public FileFormat {
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA |
+      FILE_SUPPORT_GET_FORMAT_OPTIONS |
       FILE_ENCODE_ABSTRACT_IMAGE;
   }
 
@@ -64,6 +72,7 @@ class PngFormat : public FileFormat {
   bool onSave(FileOp* fop) override;
   void saveColorSpace(png_structp png, png_infop info, const gfx::ColorSpace* colorSpace);
 #endif
+  FormatOptionsPtr onAskUserForFormatOptions(FileOp* fop) override;
 };
 
 FileFormat* CreatePngFormat()
@@ -523,6 +532,423 @@ gfx::ColorSpaceRef PngFormat::loadColorSpace(png_structp png_ptr, png_infop info
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// Images with more bytes than this are compressed in several threads.
+constexpr size_t kParallelSaveMinBytes = 4*1024*1024;
+
+// Approximated number of bytes of each band of rows compressed by one
+// thread.
+constexpr size_t kBandBytes = 1024*1024;
+
+// Size of the deflate window, the last bytes of the previous band are
+// used as the dictionary of the next band to compress it better.
+constexpr size_t kDeflateWindowSize = 32*1024;
+
+// Filter types (first byte of each filtered row)
+enum {
+  kFilterNone,
+  kFilterSub,
+  kFilterUp,
+  kFilterAverage,
+  kFilterPaeth,
+  kFilterCount
+};
+
+// Converts the rows of the image to save to the PNG color type, it
+// can be used from several threads at the same time.
+class PngRowConverter {
+public:
+  PngRowConverter(const FileOp* fop,
+                  const FileAbstractImage* img,
+                  const int color_type)
+    : m_fop(fop)
+    , m_img(img)
+    , m_colorMode(img->spec().colorMode())
+    , m_colorType(color_type)
+    , m_width(img->spec().width())
+    , m_height(img->spec().height()) {
+  }
+
+  void convert(const png_uint_32 y, uint8_t* dst_address) const {
+    const png_uint_32 width = m_width;
+    const png_uint_32 height = m_height;
+
+    if (m_colorType == PNG_COLOR_TYPE_RGB_ALPHA) {
+      unsigned int x, c, a;
+      bool opaque = true;
+
+      if (m_colorMode == ColorMode::RGB) {
+        auto src_address = (const uint32_t*)m_img->getScanline(y);
+
+        for (x=0; x<width; ++x) {
+          c = *(src_address++);
+          a = rgba_geta(c);
+
+          if (opaque) {
+            if (a < 255)
+              opaque = false;
+            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+              a = 254;
+          }
+
+          *(dst_address++) = rgba_getr(c);
+          *(dst_address++) = rgba_getg(c);
+          *(dst_address++) = rgba_getb(c);
+          *(dst_address++) = a;
+        }
+      }
+      // In case that we are converting an indexed image to RGB just
+      // to convert one pixel with alpha=254.
+      else if (m_colorMode == ColorMode::INDEXED) {
+        auto src_address = (const uint8_t*)m_img->getScanline(y);
+        unsigned int x, c;
+        int r, g, b, a;
+        bool opaque = true;
+
+        for (x=0; x<width; ++x) {
+          c = *(src_address++);
+          m_fop->sequenceGetColor(c, &r, &g, &b);
+          m_fop->sequenceGetAlpha(c, &a);
+
+          if (opaque) {
+            if (a < 255)
+              opaque = false;
+            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+              a = 254;
+          }
+
+          *(dst_address++) = r;
+          *(dst_address++) = g;
+          *(dst_address++) = b;
+          *(dst_address++) = a;
+        }
+      }
+    }
+    else if (m_colorType == PNG_COLOR_TYPE_RGB) {
+      auto src_address = (const uint32_t*)m_img->getScanline(y);
+      unsigned int x, c;
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+      }
+    }
+    else if (m_colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+      auto src_address = (const uint16_t*)m_img->getScanline(y);
+      unsigned int x, c, a;
+      bool opaque = true;
+
+      for (x=0; x<width; x++) {
+        c = *(src_address++);
+        a = graya_geta(c);
+
+        if (opaque) {
+          if (a < 255)
+            opaque = false;
+          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+            a = 254;
+        }
+
+        *(dst_address++) = graya_getv(c);
+        *(dst_address++) = a;
+      }
+    }
+    else if (m_colorType == PNG_COLOR_TYPE_GRAY) {
+      auto src_address = (const uint16_t*)m_img->getScanline(y);
+      unsigned int x, c;
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        *(dst_address++) = graya_getv(c);
+      }
+    }
+    else if (m_colorType == PNG_COLOR_TYPE_PALETTE) {
+      auto src_address = (const uint8_t*)m_img->getScanline(y);
+      unsigned int x;
+
+      for (x=0; x<width; ++x)
+        *(dst_address++) = *(src_address++);
+    }
+  }
+
+private:
+  const FileOp* m_fop;
+  const FileAbstractImage* m_img;
+  ColorMode m_colorMode;
+  int m_colorType;
+  png_uint_32 m_width;
+  png_uint_32 m_height;
+};
+
+int png_filter_flags(const PngOptions::Filter filter)
+{
+  switch (filter) {
+    case PngOptions::Filter::None:     return PNG_FILTER_NONE;
+    case PngOptions::Filter::Sub:      return PNG_FILTER_SUB;
+    case PngOptions::Filter::Up:       return PNG_FILTER_UP;
+    case PngOptions::Filter::Average:  return PNG_FILTER_AVG;
+    case PngOptions::Filter::Paeth:    return PNG_FILTER_PAETH;
+    case PngOptions::Filter::Adaptive: return PNG_ALL_FILTERS;
+    case PngOptions::Filter::Default:  break;
+  }
+  return 0;
+}
+
+inline int paeth_predictor(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Filters the given "row" using "prev" (the previous unfiltered row,
+// or zeros for the first row). "bpp" is the number of bytes per
+// pixel, and "dst" must have space for rowbytes+1 bytes.
+void filter_row(const int type,
+                const uint8_t* row,
+                const uint8_t* prev,
+                const size_t rowbytes,
+                const size_t bpp,
+                uint8_t* dst)
+{
+  *(dst++) = type;
+
+  size_t i;
+  switch (type) {
+    case kFilterNone:
+      std::copy(row, row+rowbytes, dst);
+      break;
+    case kFilterSub:
+      for (i=0; i<bpp; ++i)
+        dst[i] = row[i];
+      for (; i<rowbytes; ++i)
+        dst[i] = row[i] - row[i-bpp];
+      break;
+    case kFilterUp:
+      for (i=0; i<rowbytes; ++i)
+        dst[i] = row[i] - prev[i];
+      break;
+    case kFilterAverage:
+      for (i=0; i<bpp; ++i)
+        dst[i] = row[i] - (prev[i] >> 1);
+      for (; i<rowbytes; ++i)
+        dst[i] = row[i] - ((row[i-bpp] + prev[i]) >> 1);
+      break;
+    case kFilterPaeth:
+      for (i=0; i<bpp; ++i)
+        dst[i] = row[i] - prev[i];
+      for (; i<rowbytes; ++i)
+        dst[i] = row[i] - paeth_predictor(row[i-bpp], prev[i], prev[i-bpp]);
+      break;
+  }
+}
+
+// Uses the filter with the minimum sum of absolute differences, the
+// same heuristic used by libpng.
+void filter_row_adaptive(const uint8_t* row,
+                         const uint8_t* prev,
+                         const size_t rowbytes,
+                         const size_t bpp,
+                         uint8_t* dst,
+                         std::vector<uint8_t>& tmp)
+{
+  uint64_t bestSum = UINT64_MAX;
+  tmp.resize(rowbytes+1);
+  for (int type=kFilterNone; type<kFilterCount; ++type) {
+    filter_row(type, row, prev, rowbytes, bpp, tmp.data());
+
+    uint64_t sum = 0;
+    for (size_t i=1; i<=rowbytes; ++i)
+      sum += std::abs(int(int8_t(tmp[i])));
+
+    if (sum < bestSum) {
+      bestSum = sum;
+      std::copy(tmp.begin(), tmp.end(), dst);
+    }
+  }
+}
+
+bool write_png_chunk(FILE* fp, const char* name,
+                     const uint8_t* data, const size_t size)
+{
+  const uint8_t header[8] = {
+    uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size),
+    uint8_t(name[0]), uint8_t(name[1]), uint8_t(name[2]), uint8_t(name[3])
+  };
+  uLong crc = crc32(0, header+4, 4);
+  if (size > 0)
+    crc = crc32(crc, data, uInt(size));
+  const uint8_t footer[4] = {
+    uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc)
+  };
+  return (fwrite(header, 1, 8, fp) == 8 &&
+          (size == 0 || fwrite(data, 1, size, fp) == size) &&
+          fwrite(footer, 1, 4, fp) == 4);
+}
+
+// Writes the IDAT chunks using several threads. The image is divided
+// in bands of rows, each band is filtered and compressed as an
+// independent raw deflate stream ended with a sync flush (so all
+// bands can be concatenated in one zlib stream), and the adler32
+// checksums of all bands are combined for the zlib trailer.
+//
+// After this, the remaining chunks must be written manually too
+// (libpng doesn't know about the IDAT chunks written here).
+bool write_png_rows_in_parallel(FileOp* fop,
+                                const PngRowConverter& converter,
+                                const png_uint_32 height,
+                                const size_t rowbytes,
+                                const size_t bpp,
+                                const int color_type,
+                                const PngOptions& opts,
+                                const int nthreads,
+                                FILE* fp)
+{
+  int filter = -1;              // -1 = adaptive filter
+  switch (opts.filter()) {
+    case PngOptions::Filter::Default:
+      // libpng doesn't filter palette images by default
+      if (color_type == PNG_COLOR_TYPE_PALETTE)
+        filter = kFilterNone;
+      break;
+    case PngOptions::Filter::None:     filter = kFilterNone; break;
+    case PngOptions::Filter::Sub:      filter = kFilterSub; break;
+    case PngOptions::Filter::Up:       filter = kFilterUp; break;
+    case PngOptions::Filter::Average:  filter = kFilterAverage; break;
+    case PngOptions::Filter::Paeth:    filter = kFilterPaeth; break;
+    case PngOptions::Filter::Adaptive: break;
+  }
+
+  const int level = (opts.compressionLevel() >= 0 ?
+                     std::min(opts.compressionLevel(), 9):
+                     Z_DEFAULT_COMPRESSION);
+  const int strategy = (filter == kFilterNone ? Z_DEFAULT_STRATEGY:
+                                                Z_FILTERED);
+
+  const size_t filteredRowBytes = rowbytes+1;
+  const png_uint_32 bandRows =
+    png_uint_32(std::max<size_t>(1, kBandBytes / rowbytes));
+  const png_uint_32 dictRows =
+    png_uint_32((kDeflateWindowSize + filteredRowBytes - 1) / filteredRowBytes);
+
+  struct Band {
+    std::vector<uint8_t> data;  // Compressed rows
+    uLong adler = 0;
+    size_t size = 0;            // Size of the filtered rows
+    bool ok = false;
+  };
+  const int nbands = int((height + bandRows - 1) / bandRows);
+  std::vector<Band> bands(nbands);
+
+  doc::OrderedJobs jobs(nthreads);
+  for (int i=0; i<nbands; ++i) {
+    jobs.add([&, i]{
+      Band& band = bands[i];
+      const png_uint_32 y0 = i*bandRows;
+      const png_uint_32 y1 = std::min(y0+bandRows, height);
+      // The last rows of the previous band are filtered again to be
+      // used as the deflate dictionary.
+      const png_uint_32 yd = y0 - std::min(y0, dictRows);
+
+      std::vector<uint8_t> row(rowbytes), prev(rowbytes, 0), tmp;
+      std::vector<uint8_t> filtered((y1-yd)*filteredRowBytes);
+      if (yd > 0)
+        converter.convert(yd-1, prev.data());
+      for (png_uint_32 y=yd; y<y1; ++y) {
+        uint8_t* dst = filtered.data() + (y-yd)*filteredRowBytes;
+        converter.convert(y, row.data());
+        if (filter < 0)
+          filter_row_adaptive(row.data(), prev.data(), rowbytes, bpp, dst, tmp);
+        else
+          filter_row(filter, row.data(), prev.data(), rowbytes, bpp, dst);
+        std::swap(row, prev);
+      }
+
+      const size_t dictSize = (y0-yd)*filteredRowBytes;
+      const uint8_t* input = filtered.data() + dictSize;
+      band.size = (y1-y0)*filteredRowBytes;
+      band.adler = adler32(adler32(0, nullptr, 0), input, uInt(band.size));
+
+      z_stream z;
+      z.zalloc = Z_NULL;
+      z.zfree = Z_NULL;
+      z.opaque = Z_NULL;
+      if (deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS, 8, strategy) != Z_OK)
+        return;
+
+      if (dictSize > 0) {
+        const size_t n = std::min(dictSize, kDeflateWindowSize);
+        deflateSetDictionary(&z, input-n, uInt(n));
+      }
+
+      // Extra space for the sync flush marker
+      band.data.resize(deflateBound(&z, uLong(band.size)) + 16);
+      z.next_in = (Bytef*)input;
+      z.avail_in = uInt(band.size);
+      z.next_out = band.data.data();
+      z.avail_out = uInt(band.data.size());
+
+      const bool last = (i == nbands-1);
+      const int ret = deflate(&z, last ? Z_FINISH: Z_SYNC_FLUSH);
+      band.ok = (last ? ret == Z_STREAM_END:
+                        ret == Z_OK && z.avail_in == 0 && z.avail_out > 0);
+      band.data.resize(z.total_out);
+      deflateEnd(&z);
+    });
+  }
+
+  // zlib header (32K window, compression level hint)
+  const int flevel = (level == Z_DEFAULT_COMPRESSION ? 2:
+                      level < 2 ? 0:
+                      level < 6 ? 1:
+                      level == 6 ? 2: 3);
+  int header = (0x78 << 8) | (flevel << 6);
+  header += 31 - (header % 31);
+
+  uLong adler = adler32(0, nullptr, 0);
+  for (int i=0; i<nbands; ++i) {
+    jobs.wait(i);
+
+    Band& band = bands[i];
+    if (!band.ok) {
+      fop->setError("Error compressing PNG rows\n");
+      return false;
+    }
+
+    adler = adler32_combine(adler, band.adler, z_off_t(band.size));
+    if (i == 0) {
+      band.data.insert(band.data.begin(),
+                       { uint8_t(header >> 8), uint8_t(header) });
+    }
+    if (i == nbands-1) {
+      band.data.insert(band.data.end(),
+                       { uint8_t(adler >> 24), uint8_t(adler >> 16),
+                         uint8_t(adler >> 8), uint8_t(adler) });
+    }
+
+    if (!write_png_chunk(fp, "IDAT", band.data.data(), band.data.size())) {
+      fop->setError("Error writing PNG file\n");
+      return false;
+    }
+    band.data = std::vector<uint8_t>();
+
+    fop->setProgress(double(i+1) / double(nbands));
+  }
+  return true;
+}
+
+} // anonymous namespace
+
 bool PngFormat::onSave(FileOp* fop)
 {
   png_infop info;
@@ -660,121 +1086,62 @@ bool PngFormat::onSave(FileOp* fop)
     png_free(png, trans);
   }
 
+  // Compression options
+  auto saveOpts = fop->formatOptionsForSaving<PngOptions>();
+  if (saveOpts->compressionLevel() >= 0)
+    png_set_compression_level(png, std::min(saveOpts->compressionLevel(), 9));
+  if (const int filters = png_filter_flags(saveOpts->filter()))
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, filters);
+
   png_write_info(png, info);
   png_set_packing(png);
 
-  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
-
-  for (png_uint_32 y=0; y<height; ++y) {
-    uint8_t* dst_address = row_pointer;
-
-    if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      if (spec.colorMode() == ColorMode::RGB) {
-        auto src_address = (const uint32_t*)img->getScanline(y);
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          a = rgba_geta(c);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = a;
-        }
-      }
-      // In case that we are converting an indexed image to RGB just
-      // to convert one pixel with alpha=254.
-      else if (spec.colorMode() == ColorMode::INDEXED) {
-        auto src_address = (const uint8_t*)img->getScanline(y);
-        unsigned int x, c;
-        int r, g, b, a;
-        bool opaque = true;
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          fop->sequenceGetColor(c, &r, &g, &b);
-          fop->sequenceGetAlpha(c, &a);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
+  const PngRowConverter converter(fop, img, color_type);
+  const size_t rowbytes = png_get_rowbytes(png, info);
+  const size_t imageBytes = rowbytes * height;
+  const int nthreads =
+    (imageBytes >= kParallelSaveMinBytes ?
+     doc::OrderedJobs::calcThreads(int(imageBytes / kBandBytes)): 1);
+
+  if (nthreads > 1) {
+    if (!write_png_rows_in_parallel(fop, converter, height, rowbytes,
+                                    png_get_channels(png, info),
+                                    color_type, *saveOpts, nthreads, fp))
+      return false;
 
-          *(dst_address++) = r;
-          *(dst_address++) = g;
-          *(dst_address++) = b;
-          *(dst_address++) = a;
+    // As libpng didn't write the IDAT chunks, we cannot use
+    // png_write_end(), so we write the user chunks that go after
+    // the image data and the IEND chunk.
+    png_unknown_chunkp unknowns = nullptr;
+    const int num_unknowns = png_get_unknown_chunks(png, info, &unknowns);
+    for (int i=0; i<num_unknowns; ++i) {
+      if (unknowns[i].location & PNG_AFTER_IDAT) {
+        if (!write_png_chunk(fp, (const char*)unknowns[i].name,
+                             unknowns[i].data, unknowns[i].size)) {
+          fop->setError("Error writing PNG file\n");
+          return false;
         }
       }
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB) {
-      auto src_address = (const uint32_t*)img->getScanline(y);
-      unsigned int x, c;
-
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = rgba_getr(c);
-        *(dst_address++) = rgba_getg(c);
-        *(dst_address++) = rgba_getb(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      for (x=0; x<width; x++) {
-        c = *(src_address++);
-        a = graya_geta(c);
-
-        if (opaque) {
-          if (a < 255)
-            opaque = false;
-          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-            a = 254;
-        }
-
-        *(dst_address++) = graya_getv(c);
-        *(dst_address++) = a;
-      }
+    if (!write_png_chunk(fp, "IEND", nullptr, 0)) {
+      fop->setError("Error writing PNG file\n");
+      return false;
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c;
+  }
+  else {
+    row_pointer = (png_bytep)png_malloc(png, rowbytes);
 
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = graya_getv(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE) {
-      auto src_address = (const uint8_t*)img->getScanline(y);
-      unsigned int x;
+    for (png_uint_32 y=0; y<height; ++y) {
+      converter.convert(y, row_pointer);
+      png_write_rows(png, &row_pointer, 1);
 
-      for (x=0; x<width; ++x)
-        *(dst_address++) = *(src_address++);
+      fop->setProgress((double)(y+1) / (double)(height));
     }
 
-    png_write_rows(png, &row_pointer, 1);
-
-    fop->setProgress((double)(y+1) / (double)(height));
+    png_free(png, row_pointer);
+    png_write_end(png, info);
   }
 
-  png_free(png, row_pointer);
-  png_write_end(png, info);
-
   if (spec.colorMode() == ColorMode::INDEXED) {
     png_free(png, palette);
     palette = nullptr;
@@ -832,4 +1199,20 @@ void PngFormat::saveColorSpace(png_structp png_ptr, png_infop info_ptr,
 
 #endif  // ENABLE_SAVE
 
+// There is no dialog for the PNG options, the compression options are
+// taken from the preferences.
+FormatOptionsPtr PngFormat::onAskUserForFormatOptions(FileOp* fop)
+{
+  auto opts = fop->formatOptionsOfDocument<PngOptions>();
+  if (fop->context() && fop->context()->isUIAvailable()) {
+    auto& pref = Preferences::instance();
+    opts->compressionLevel(std::clamp(pref.png.compressionLevel(), -1, 9));
+    opts->filter(PngOptions::Filter(
+                   std::clamp(pref.png.filter(),
+                              int(PngOptions::Filter::Default),
+                              int(PngOptions::Filter::Adaptive))));
+  }
+  return opts;
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -25,6 +25,18 @@ namespace app {
 
     using Chunks = std::vector<Chunk>;
 
+    // Filter applied to each row before the compression (see
+    // png_set_filter()).
+    enum class Filter {
+      Default,                  // libpng default filter for each color type
+      None,
+      Sub,
+      Up,
+      Average,
+      Paeth,
+      Adaptive,                 // Best filter for each row
+    };
+
     void addChunk(Chunk&& chunk) {
       m_userChunks.emplace_back(std::move(chunk));
     }
@@ -39,8 +51,17 @@ namespace app {
 
     const Chunks& chunks() const { return m_userChunks; }
 
+    // zlib compression level (0-9), or -1 to use the default level.
+    int compressionLevel() const { return m_compressionLevel; }
+    Filter filter() const { return m_filter; }
+
+    void compressionLevel(const int level) { m_compressionLevel = level; }
+    void filter(const Filter filter) { m_filter = filter; }
+
   private:
     Chunks m_userChunks;
+    int m_compressionLevel = -1;
+    Filter m_filter = Filter::Default;
   };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,6 +12,8 @@
 #include "app/file/file_format.h"
 #include "base/file_handle.h"
 
+#include <vector>
+
 #define QOI_NO_STDIO
 #define QOI_IMPLEMENTATION
 #include "qoi.h"
@@ -54,6 +56,92 @@ FileFormat* CreateQoiFormat()
   return new QoiFormat;
 }
 
+// Reads the QOI header, returns false if it's invalid.
+static bool read_qoi_header(const uint8_t* bytes, const int size, qoi_desc& desc)
+{
+  if (size < QOI_HEADER_SIZE + (int)sizeof(qoi_padding))
+    return false;
+
+  int p = 0;
+  const unsigned int magic = qoi_read_32(bytes, &p);
+  desc.width = qoi_read_32(bytes, &p);
+  desc.height = qoi_read_32(bytes, &p);
+  desc.channels = bytes[p++];
+  desc.colorspace = bytes[p++];
+
+  return (magic == QOI_MAGIC &&
+          desc.width > 0 && desc.height > 0 &&
+          desc.channels >= 3 && desc.channels <= 4 &&
+          desc.colorspace <= 1 &&
+          desc.height < QOI_PIXELS_MAX / desc.width);
+}
+
+// Same algorithm as qoi_decode(), but the pixels are decoded
+// directly in the rows of the given RGB image (instead of a temporary
+// buffer that should be converted to our RGBA format).
+static void decode_qoi_pixels(const uint8_t* bytes, const int size,
+                              const qoi_desc& desc, Image* image)
+{
+  qoi_rgba_t index[64] = { };
+  qoi_rgba_t px;
+  px.rgba.r = 0;
+  px.rgba.g = 0;
+  px.rgba.b = 0;
+  px.rgba.a = 255;
+
+  const int chunks_len = size - (int)sizeof(qoi_padding);
+  const uint8_t alpha_mask = (desc.channels == 4 ? 0: 255);
+  int p = QOI_HEADER_SIZE;
+  int run = 0;
+
+  for (int y=0; y<int(desc.height); ++y) {
+    auto dst = (uint32_t*)image->getPixelAddress(0, y);
+    for (int x=0; x<int(desc.width); ++x, ++dst) {
+      if (run > 0) {
+        --run;
+      }
+      else if (p < chunks_len) {
+        const int b1 = bytes[p++];
+
+        if (b1 == QOI_OP_RGB) {
+          px.rgba.r = bytes[p++];
+          px.rgba.g = bytes[p++];
+          px.rgba.b = bytes[p++];
+        }
+        else if (b1 == QOI_OP_RGBA) {
+          px.rgba.r = bytes[p++];
+          px.rgba.g = bytes[p++];
+          px.rgba.b = bytes[p++];
+          px.rgba.a = bytes[p++];
+        }
+        else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+          px = index[b1];
+        }
+        else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+          px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+          px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+          px.rgba.b += ( b1       & 0x03) - 2;
+        }
+        else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+          const int b2 = bytes[p++];
+          const int vg = (b1 & 0x3f) - 32;
+          px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+          px.rgba.g += vg;
+          px.rgba.b += vg - 8 +  (b2       & 0x0f);
+        }
+        else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+          run = (b1 & 0x3f);
+        }
+
+        index[QOI_COLOR_HASH(px) % 64] = px;
+      }
+
+      *dst = doc::rgba(px.rgba.r, px.rgba.g, px.rgba.b,
+                       px.rgba.a | alpha_mask);
+    }
+  }
+}
+
 bool QoiFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
@@ -65,15 +153,10 @@ bool QoiFormat::onLoad(FileOp* fop)
     return false;
   fseek(f, 0, SEEK_SET);
 
-  auto data = QOI_MALLOC(size);
-  if (!data)
-    return false;
-
+  std::vector<uint8_t> data(size);
   qoi_desc desc;
-  auto bytes_read = fread(data, 1, size, f);
-  auto pixels = qoi_decode(data, bytes_read, &desc, 0);
-  QOI_FREE(data);
-  if (!pixels)
+  const int bytes_read = int(fread(data.data(), 1, size, f));
+  if (!read_qoi_header(data.data(), bytes_read, desc))
     return false;
 
   ImageRef image = fop->sequenceImageToLoad(
@@ -83,26 +166,7 @@ bool QoiFormat::onLoad(FileOp* fop)
   if (!image)
     return false;
 
-  auto src = (const uint8_t*)pixels;
-  for (int y=0; y<desc.height; ++y) {
-    auto dst = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], src[3]);
-          src += 4;
-        }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], 255);
-          src += 3;
-        }
-        break;
-    }
-  }
-
-  QOI_FREE(pixels);
+  decode_qoi_pixels(data.data(), bytes_read, desc, image.get());
 
   if (desc.channels == 4)
     fop->sequenceSetHasAlpha(true);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2023  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -15,26 +15,28 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/file/svg_options.h"
 #include "app/pref/preferences.h"
 #include "base/cfile.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "fmt/format.h"
+#include "ui/combobox.h"
 #include "ui/window.h"
 
 #include "svg_options.xml.h"
 
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace app {
 
 using namespace base;
 
 class SvgFormat : public FileFormat {
-  // Data for SVG files
-  class SvgOptions : public FormatOptions {
-  public:
-    SvgOptions() : pixelScale(1) { }
-    int pixelScale;
-  };
-
   const char* onGetName() const override {
     return "svg";
   }
@@ -79,83 +81,278 @@ bool SvgFormat::onLoad(FileOp* fop)
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// Writes the SVG elements in a memory buffer that is written to the
+// file in big blocks (instead of one fprintf() for each element).
+class SvgWriter {
+public:
+  static constexpr size_t kBufferSize = 64*1024;
+
+  SvgWriter(FILE* f, const int pixelScale)
+    : m_f(f), m_scale(pixelScale) {
+    m_buf.reserve(kBufferSize + 256);
+  }
+
+  ~SvgWriter() {
+    flush();
+  }
+
+  void text(const char* text) {
+    m_buf += text;
+    check();
+  }
+
+  void header(const int w, const int h) {
+    fmt::format_to(std::back_inserter(m_buf),
+                   "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+                   "<svg version=\"1.1\" width=\"{}\" height=\"{}\" "
+                   "xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n",
+                   w*m_scale, h*m_scale);
+  }
+
+  // Rectangle in pixel units
+  void rect(const int x, const int y, const int w, const int h,
+            const color_t color) {
+    fmt::format_to(std::back_inserter(m_buf),
+                   "<rect x=\"{}\" y=\"{}\" width=\"{}\" height=\"{}\" ",
+                   x*m_scale, y*m_scale, w*m_scale, h*m_scale);
+    fill(color);
+    m_buf += "/>\n";
+    check();
+  }
+
+  // Path with the given list of rectangles (in pixel units)
+  void path(const std::vector<gfx::Rect>& rects, const color_t color) {
+    m_buf += "<path ";
+    fill(color);
+    m_buf += "d=\"";
+    for (const gfx::Rect& rc : rects) {
+      fmt::format_to(std::back_inserter(m_buf),
+                     "M{} {}h{}v{}h-{}z",
+                     rc.x*m_scale, rc.y*m_scale,
+                     rc.w*m_scale, rc.h*m_scale, rc.w*m_scale);
+      check();
+    }
+    m_buf += "\"/>\n";
+    check();
+  }
+
+  void flush() {
+    if (!m_buf.empty()) {
+      fwrite(m_buf.data(), 1, m_buf.size(), m_f);
+      m_buf.clear();
+    }
+  }
+
+private:
+  void fill(const color_t color) {
+    fmt::format_to(std::back_inserter(m_buf),
+                   "fill=\"#{:02X}{:02X}{:02X}\" ",
+                   rgba_getr(color), rgba_getg(color), rgba_getb(color));
+    const int a = rgba_geta(color);
+    if (a != 255) {
+      fmt::format_to(std::back_inserter(m_buf),
+                     "opacity=\"{:f}\" ", (float)a / 255.0);
+    }
+  }
+
+  void check() {
+    if (m_buf.size() >= kBufferSize)
+      flush();
+  }
+
+  FILE* m_f;
+  int m_scale;
+  std::string m_buf;
+};
+
+// Reads rows of the image as RGBA colors, where 0 is a transparent
+// pixel (that is not written in the file), so we don't need a copy of
+// the whole image.
+class SvgPixels {
+public:
+  SvgPixels(FileOp* fop, const Image* image) : m_image(image) {
+    if (image->pixelFormat() == IMAGE_INDEXED) {
+      for (int i=0; i<256; ++i) {
+        int r, g, b, a;
+        fop->sequenceGetColor(i, &r, &g, &b);
+        fop->sequenceGetAlpha(i, &a);
+        m_palette[i] = rgba(r, g, b, a);
+      }
+      const Sprite* sprite = fop->document()->sprite();
+      if (sprite->backgroundLayer() == NULL ||
+          !sprite->backgroundLayer()->isVisible()) {
+        m_maskColor = sprite->transparentColor();
+      }
+    }
+  }
+
+  // Reads the pixels [x1, x2) of the row "y" in "dst"
+  void read(const int y, const int x1, const int x2, color_t* dst) const {
+    switch (m_image->pixelFormat()) {
+
+      case IMAGE_RGB: {
+        auto src = (const RgbTraits::address_t)m_image->getPixelAddress(x1, y);
+        for (int x=x1; x<x2; ++x, ++src, ++dst)
+          *dst = (rgba_geta(*src) != 0x00 ? *src: 0);
+        break;
+      }
+
+      case IMAGE_GRAYSCALE: {
+        auto src = (const GrayscaleTraits::address_t)m_image->getPixelAddress(x1, y);
+        for (int x=x1; x<x2; ++x, ++src, ++dst) {
+          const int v = graya_getv(*src);
+          const int alpha = graya_geta(*src);
+          *dst = (alpha != 0x00 ? rgba(v, v, v, alpha): 0);
+        }
+        break;
+      }
+
+      case IMAGE_INDEXED: {
+        auto src = (const IndexedTraits::address_t)m_image->getPixelAddress(x1, y);
+        for (int x=x1; x<x2; ++x, ++src, ++dst)
+          *dst = (*src != m_maskColor ? m_palette[*src]: 0);
+        break;
+      }
+
+      default:
+        std::fill(dst, dst+(x2-x1), 0);
+        break;
+    }
+  }
+
+private:
+  const Image* m_image;
+  color_t m_palette[256];
+  color_t m_maskColor = -1;
+};
+
+} // anonymous namespace
+
 bool SvgFormat::onSave(FileOp* fop)
 {
   const ImageRef image = fop->sequenceImageToSave();
-  int x, y, c, r, g, b, a, alpha;
   const auto svg_options = std::static_pointer_cast<SvgOptions>(fop->formatOptions());
   const int pixelScaleValue = std::clamp(svg_options->pixelScale, 0, 10000);
+  const SvgOptions::Shapes shapes = svg_options->shapes;
   FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
   FILE* f = handle.get();
-  auto printcol = [f](int x, int y,int r, int g, int b, int a, int pxScale) {
-    fprintf(f, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02X%02X%02X\" ",
-            x*pxScale, y*pxScale, pxScale, pxScale, r, g, b);
-    if (a != 255)
-      fprintf(f, "opacity=\"%f\" ", (float)a / 255.0);
-    fprintf(f, "/>\n");
-  };
-  fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
-  fprintf(f, "<svg version=\"1.1\" width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n",
-          image->width()*pixelScaleValue, image->height()*pixelScaleValue);
-
-  switch (image->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<RgbTraits>(image.get(), x, y);
-          alpha = rgba_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, rgba_getr(c), rgba_getg(c), rgba_getb(c), alpha, pixelScaleValue);
+
+  const int w = image->width();
+  const int h = image->height();
+  const SvgPixels pixels(fop, image.get());
+  std::vector<color_t> row(w);
+
+  SvgWriter writer(f, pixelScaleValue);
+  writer.header(w, h);
+
+  switch (shapes) {
+
+    case SvgOptions::Shapes::Pixels:
+      for (int y=0; y<h; ++y) {
+        pixels.read(y, 0, w, row.data());
+        for (int x=0; x<w; ++x) {
+          const color_t c = row[x];
+          if (rgba_geta(c))
+            writer.rect(x, y, 1, 1, c);
         }
-        fop->setProgress((float)y / (float)(image->height()));
+        fop->setProgress((float)y / (float)h);
       }
       break;
-    }
-    case IMAGE_GRAYSCALE: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<GrayscaleTraits>(image.get(), x, y);
-          auto v = graya_getv(c);
-          alpha = graya_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, v, v, v, alpha, pixelScaleValue);
+
+    case SvgOptions::Shapes::Runs:
+      for (int y=0; y<h; ++y) {
+        pixels.read(y, 0, w, row.data());
+        for (int x=0; x<w; ) {
+          const color_t c = row[x];
+          int x2 = x+1;
+          while (x2 < w && row[x2] == c)
+            ++x2;
+          if (rgba_geta(c))
+            writer.rect(x, y, x2-x, 1, c);
+          x = x2;
         }
-        fop->setProgress((float)y / (float)(image->height()));
+        fop->setProgress((float)y / (float)h);
       }
       break;
-    }
-    case IMAGE_INDEXED: {
-      unsigned char image_palette[256][4];
-      for (y=0; y<256; y++) {
-        fop->sequenceGetColor(y, &r, &g, &b);
-        image_palette[y][0] = r;
-        image_palette[y][1] = g;
-        image_palette[y][2] = b;
-        fop->sequenceGetAlpha(y, &a);
-        image_palette[y][3] = a;
+
+    case SvgOptions::Shapes::Rects:
+    case SvgOptions::Shapes::Paths: {
+      // Greedy rectangles: each horizontal run is extended to the
+      // bottom while the rows below contain the same run. Pixels
+      // already used by a rectangle are marked in "used" (and then
+      // they are like transparent pixels).
+      std::vector<gfx::Rect> rects;
+      std::vector<color_t> rectColors;
+      std::vector<color_t> row2(w);
+      std::vector<bool> used(size_t(w)*h, false);
+      for (int y=0; y<h; ++y) {
+        pixels.read(y, 0, w, row.data());
+        for (int x=0; x<w; ++x) {
+          if (used[size_t(y)*w+x])
+            row[x] = 0;
+        }
+        for (int x=0; x<w; ) {
+          const color_t c = row[x];
+          if (!rgba_geta(c)) {
+            ++x;
+            continue;
+          }
+          int x2 = x+1;
+          while (x2 < w && row[x2] == c)
+            ++x2;
+
+          int y2 = y+1;
+          for (; y2<h; ++y2) {
+            pixels.read(y2, x, x2, row2.data());
+            bool same = true;
+            for (int u=x; u<x2 && same; ++u)
+              same = (row2[u-x] == c && !used[size_t(y2)*w+u]);
+            if (!same)
+              break;
+          }
+          for (int v=y+1; v<y2; ++v)
+            std::fill(used.begin()+size_t(v)*w+x,
+                      used.begin()+size_t(v)*w+x2, true);
+
+          rects.push_back(gfx::Rect(x, y, x2-x, y2-y));
+          rectColors.push_back(c);
+          x = x2;
+        }
+        fop->setProgress((float)y / (float)h);
       }
-      color_t mask_color = -1;
-      if (fop->document()->sprite()->backgroundLayer() == NULL ||
-          !fop->document()->sprite()->backgroundLayer()->isVisible()) {
-        mask_color = fop->document()->sprite()->transparentColor();
+
+      if (shapes == SvgOptions::Shapes::Rects) {
+        for (size_t i=0; i<rects.size(); ++i) {
+          const gfx::Rect& rc = rects[i];
+          writer.rect(rc.x, rc.y, rc.w, rc.h, rectColors[i]);
+        }
       }
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<IndexedTraits>(image.get(), x, y);
-          if (c != mask_color)
-            printcol(x, y, image_palette[c][0] & 0xff,
-                     image_palette[c][1] & 0xff,
-                     image_palette[c][2] & 0xff,
-                     image_palette[c][3] & 0xff,
-                     pixelScaleValue);
+      else {
+        // Group rectangles by color (in order of appearance)
+        std::unordered_map<color_t, size_t> colorIndex;
+        std::vector<color_t> pathColors;
+        std::vector<std::vector<gfx::Rect>> paths;
+        for (size_t i=0; i<rects.size(); ++i) {
+          auto it = colorIndex.find(rectColors[i]);
+          if (it == colorIndex.end()) {
+            it = colorIndex.insert({ rectColors[i], paths.size() }).first;
+            pathColors.push_back(rectColors[i]);
+            paths.emplace_back();
+          }
+          paths[it->second].push_back(rects[i]);
         }
-        fop->setProgress((float)y / (float)(image->height()));
+        for (size_t i=0; i<paths.size(); ++i)
+          writer.path(paths[i], pathColors[i]);
       }
       break;
     }
   }
-  fprintf(f, "</svg>");
+
+  writer.text("</svg>");
+  writer.flush();
+
   if (ferror(f)) {
     fop->setError("Error writing file.\n");
     return false;
@@ -176,17 +373,24 @@ FormatOptionsPtr SvgFormat::onAskUserForFormatOptions(FileOp* fop)
 
       if (pref.isSet(pref.svg.pixelScale))
         opts->pixelScale = pref.svg.pixelScale();
+      opts->shapes = SvgOptions::Shapes(
+        std::clamp(pref.svg.shapes(),
+                   int(SvgOptions::Shapes::Pixels),
+                   int(SvgOptions::Shapes::Paths)));
 
      if (pref.svg.showAlert()) {
         app::gen::SvgOptions win;
         win.pxsc()->setTextf("%d", opts->pixelScale);
+        win.shapes()->setSelectedItemIndex(int(opts->shapes));
         win.openWindowInForeground();
 
         if (win.closer() == win.ok()) {
           pref.svg.pixelScale((int)win.pxsc()->textInt());
+          pref.svg.shapes(win.shapes()->getSelectedItemIndex());
           pref.svg.showAlert(!win.dontShow()->isSelected());
 
           opts->pixelScale = pref.svg.pixelScale();
+          opts->shapes = SvgOptions::Shapes(pref.svg.shapes());
         }
         else {
           opts.reset();
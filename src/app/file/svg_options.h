@@ -0,0 +1,32 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_SVG_OPTIONS_H_INCLUDED
+#define APP_FILE_SVG_OPTIONS_H_INCLUDED
+#pragma once
+
+#include "app/file/format_options.h"
+
+namespace app {
+
+  // Data for SVG files
+  class SvgOptions : public FormatOptions {
+  public:
+    // How pixels are converted to SVG elements
+    enum class Shapes {
+      Pixels,                   // One <rect> for each pixel
+      Runs,                     // One <rect> for each horizontal run of pixels
+      Rects,                    // One <rect> for each rectangle of pixels
+      Paths,                    // One <path> for each color
+    };
+    SvgOptions() : pixelScale(1), shapes(Shapes::Runs) { }
+    int pixelScale;
+    Shapes shapes;
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,7 +19,7 @@
 #include "base/convert_to.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
-#include "doc/image_bits.h"
+#include "doc/ordered_jobs.h"
 #include "tga/tga.h"
 #include "ui/combobox.h"
 #include "ui/listitem.h"
@@ -190,10 +190,17 @@ bool TgaFormat::onLoad(FileOp* fop)
   // Post process gray image pixels (because we use grayscale images
   // with alpha).
   if (header.isGray()) {
-    doc::LockImageBits<GrayscaleTraits> bits(image.get());
-    for (auto it=bits.begin(), end=bits.end(); it != end; ++it) {
-      *it = doc::graya(*it, 255);
-    }
+    Image* img = image.get();
+    doc::for_each_row_band(
+      img->height(), img->rowBytes(),
+      [img](const int y0, const int y1) {
+        for (int y=y0; y<y1; ++y) {
+          auto it = (uint16_t*)img->getPixelAddress(0, y);
+          auto end = it + img->width();
+          for (; it != end; ++it)
+            *it = doc::graya(*it, 255);
+        }
+      });
   }
 
   if (decoder.hasAlpha())
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -91,6 +91,19 @@ const char* getDecoderErrorMessage(VP8StatusCode statusCode)
   }
 }
 
+static bool has_transparent_pixels(const Image* image)
+{
+  const int w = image->width();
+  for (int y=0; y<image->height(); ++y) {
+    auto src = (const uint32_t*)image->getPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++src) {
+      if (rgba_geta(*src) < 255)
+        return true;
+    }
+  }
+  return false;
+}
+
 bool WebPFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
@@ -121,6 +134,7 @@ bool WebPFormat::onLoad(FileOp* fop)
   WebPAnimDecoderOptions dec_options;
   WebPAnimDecoderOptionsInit(&dec_options);
   dec_options.color_mode = MODE_RGBA;
+  dec_options.use_threads = 1;
 
   WebPAnimDecoder* dec = WebPAnimDecoderNew(&webp_data, &dec_options);
   if (dec == nullptr) {
@@ -153,8 +167,25 @@ bool WebPFormat::onLoad(FileOp* fop)
     config.input.has_alpha = false;
   }
 
-  const int w = anim_info.canvas_width;
-  const int h = anim_info.canvas_height;
+  // Still images are decoded directly in the cel image (instead of
+  // the WebPAnimDecoder canvas that must be copied to the cel).
+  const bool stillImage =
+    (anim_info.frame_count == 1 && !config.input.has_animation);
+
+  int w = anim_info.canvas_width;
+  int h = anim_info.canvas_height;
+
+  // Decode a reduced image to generate thumbnails (only for still
+  // images, WebPAnimDecoder cannot scale frames).
+  const int thumbnailSize = fop->thumbnailSize();
+  const bool useScaling =
+    (stillImage && thumbnailSize > 0 &&
+     std::max(w, h) > thumbnailSize);
+  if (useScaling) {
+    const int size = std::max(w, h);
+    w = std::max(1, w * thumbnailSize / size);
+    h = std::max(1, h * thumbnailSize / size);
+  }
 
   Sprite* sprite = new Sprite(ImageSpec(ColorMode::RGB, w, h), 256);
   LayerImage* layer = new LayerImage(sprite);
@@ -168,46 +199,68 @@ bool WebPFormat::onLoad(FileOp* fop)
   }
 
   bool has_alpha = config.input.has_alpha;
-  frame_t f = 0;
-  int prev_timestamp = 0;
-  while (WebPAnimDecoderHasMoreFrames(dec)) {
-    uint8_t* frame_rgba;
-    int frame_timestamp = 0;
-    if (!WebPAnimDecoderGetNext(dec, &frame_rgba, &frame_timestamp)) {
-      fop->setError("Error loading WebP frame\n");
+
+  if (stillImage) {
+    Image* image = layer->cel(0)->image();
+
+    config.options.use_threads = 1;
+    if (useScaling) {
+      config.options.use_scaling = 1;
+      config.options.scaled_width = w;
+      config.options.scaled_height = h;
+    }
+    config.output.colorspace = MODE_RGBA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = image->getPixelAddress(0, 0);
+    config.output.u.RGBA.stride = image->rowBytes();
+    config.output.u.RGBA.size = size_t(image->rowBytes()) * h;
+
+    const VP8StatusCode status = WebPDecode(&buf[0], buf.size(), &config);
+    WebPFreeDecBuffer(&config.output);
+    if (status != VP8_STATUS_OK) {
+      fop->setError("Error loading WebP image: %s\n",
+                    getDecoderErrorMessage(status));
+      WebPAnimDecoderDelete(dec);
       return false;
     }
 
-    Cel* cel = layer->cel(f);
-    if (cel) {
-      const uint32_t* src = (const uint32_t*)frame_rgba;
-      for (int y=0; y<h; ++y, src+=w) {
-        memcpy(cel->image()->getPixelAddress(0, y),
-               src, w*sizeof(uint32_t));
+    if (!has_alpha)
+      has_alpha = has_transparent_pixels(image);
+
+    fop->setProgress(1.0);
+  }
+  else {
+    frame_t f = 0;
+    int prev_timestamp = 0;
+    while (WebPAnimDecoderHasMoreFrames(dec)) {
+      uint8_t* frame_rgba;
+      int frame_timestamp = 0;
+      if (!WebPAnimDecoderGetNext(dec, &frame_rgba, &frame_timestamp)) {
+        fop->setError("Error loading WebP frame\n");
+        return false;
       }
 
-      if (!has_alpha) {
+      Cel* cel = layer->cel(f);
+      if (cel) {
         const uint32_t* src = (const uint32_t*)frame_rgba;
-        const uint32_t* src_end = src + w*h;
-        while (src < src_end) {
-          const uint8_t alpha = (*src >> 24) & 0xff;
-          if (alpha < 255) {
-            has_alpha = true;
-            break;
-          }
-          ++src;
+        for (int y=0; y<h; ++y, src+=w) {
+          memcpy(cel->image()->getPixelAddress(0, y),
+                 src, w*sizeof(uint32_t));
         }
+
+        if (!has_alpha)
+          has_alpha = has_transparent_pixels(cel->image());
       }
-    }
 
-    sprite->setFrameDuration(f, frame_timestamp - prev_timestamp);
+      sprite->setFrameDuration(f, frame_timestamp - prev_timestamp);
 
-    prev_timestamp = frame_timestamp;
-    fop->setProgress(double(f) / double(anim_info.frame_count));
-    if (fop->isStop())
-      break;
+      prev_timestamp = frame_timestamp;
+      fop->setProgress(double(f) / double(anim_info.frame_count));
+      if (fop->isStop())
+        break;
 
-    ++f;
+      ++f;
+    }
   }
   WebPAnimDecoderReset(dec);
 
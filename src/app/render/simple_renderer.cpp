@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -102,10 +102,16 @@ void SimpleRenderer::renderSprite(os::Surface* dstSurface,
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
-  m_render.renderSprite(dstImage.get(), sprite, frame, area);
+
+  // Render the "area.src" in the temporary image, and then copy it to
+  // "area.dst" position in the surface.
+  m_render.renderSprite(dstImage.get(), sprite, frame,
+                        gfx::ClipF(0, 0, area.src.x, area.src.y,
+                                   area.size.w, area.size.h));
 
   convert_image_to_surface(dstImage.get(), sprite->palette(frame),
-                           dstSurface, 0, 0, 0, 0, area.size.w, area.size.h);
+                           dstSurface, 0, 0, area.dst.x, area.dst.y,
+                           area.size.w, area.size.h);
 }
 
 void SimpleRenderer::renderCheckeredBackground(os::Surface* dstSurface,
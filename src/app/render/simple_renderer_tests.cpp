@@ -0,0 +1,53 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#define TEST_GUI
+#include "tests/app_test.h"
+
+#include "app/render/simple_renderer.h"
+#include "doc/doc.h"
+#include "gfx/clip.h"
+#include "gfx/color.h"
+#include "os/surface.h"
+#include "os/system.h"
+#include "render/bg_type.h"
+
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+// Renders a strip of the sprite in a surface position different
+// than (0, 0) (e.g. to render only a part of the Editor render cache).
+TEST(SimpleRenderer, RenderSpriteAtDstPosition)
+{
+  std::unique_ptr<Sprite> sprite(
+    Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8)));
+  Image* image = sprite->root()->firstLayer()->cel(0)->image();
+  for (int y=0; y<8; ++y)
+    for (int x=0; x<8; ++x)
+      put_pixel(image, x, y, rgba(x*30, y*30, 0, 255));
+
+  os::SurfaceRef surface = os::instance()->makeRgbaSurface(8, 8);
+  surface->clear();
+
+  SimpleRenderer renderer;
+  renderer.setBgOptions(render::BgOptions::MakeNone());
+  renderer.setProjection(render::Projection());
+
+  // Render the 4x2 strip at (3, 5) in the same position of the surface
+  renderer.renderSprite(surface.get(), sprite.get(), 0,
+                        gfx::ClipF(3, 5, 3, 5, 4, 2));
+
+  for (int y=0; y<8; ++y) {
+    for (int x=0; x<8; ++x) {
+      if (gfx::Rect(3, 5, 4, 2).contains(gfx::Point(x, y)))
+        EXPECT_EQ(gfx::rgba(x*30, y*30, 0, 255), surface->getPixel(x, y));
+      else
+        EXPECT_EQ(0, gfx::geta(surface->getPixel(x, y)));
+    }
+  }
+}
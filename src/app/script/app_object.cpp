@@ -75,6 +75,8 @@ int load_sprite_from_file(lua_State* L, const char* filename,
   if (param == LoadSpriteFromFileParam::OneFrameAsSprite ||
       param == LoadSpriteFromFileParam::OneFrameAsImage)
     params.set("oneframe", "true");
+  else if (param == LoadSpriteFromFileParam::MetadataAsSprite)
+    params.set("metadataonly", "true");
   ctx->executeCommand(openCommand, params);
 
   Doc* newDoc = ctx->activeDocument();
@@ -95,10 +95,12 @@ int Sprite_new(lua_State* L)
             lua_pop(L, 1);
 
             bool oneFrame = (lua_is_key_true(L, -1, "oneFrame"));
+            bool metadataOnly = (lua_is_key_true(L, -1, "metadataOnly"));
 
             return load_sprite_from_file(
               L, fn.c_str(),
-              (oneFrame ? LoadSpriteFromFileParam::OneFrameAsSprite:
+              (metadataOnly ? LoadSpriteFromFileParam::MetadataAsSprite:
+               oneFrame ? LoadSpriteFromFileParam::OneFrameAsSprite:
                           LoadSpriteFromFileParam::FullAniAsSprite));
           }
         }
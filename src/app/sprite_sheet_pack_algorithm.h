@@ -0,0 +1,24 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SPRITE_SHEET_PACK_ALGORITHM_H_INCLUDED
+#define APP_SPRITE_SHEET_PACK_ALGORITHM_H_INCLUDED
+#pragma once
+
+namespace app {
+
+  // Algorithm used to layout the samples of a SpriteSheetType::Packed
+  // sprite sheet.
+  enum class SpriteSheetPackAlgorithm {
+    BestFit,                    // gfx::PackingRects
+    MaxRects,                   // app::AtlasPacker::Algorithm::MaxRects
+    Skyline,                    // app::AtlasPacker::Algorithm::Skyline
+    Default = BestFit
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,325 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "base/debug.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/time.h"
+#include "doc/hash64.h"
+#include "doc/image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <tuple>
+#include <vector>
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+constexpr uint32_t kMagic = 0x31435454; // "TTC1"
+constexpr uint32_t kIndexMagic = 0x31495454; // "TTI1"
+constexpr const char* kExtension = "thumb";
+constexpr const char* kIndexFilename = "index";
+
+template<typename T>
+void feed(Hash64& h, const T& value)
+{
+  h.update(&value, sizeof(value));
+}
+
+bool less_than(const base::Time& a, const base::Time& b)
+{
+  return
+    std::make_tuple(a.year, a.month, a.day, a.hour, a.minute, a.second) <
+    std::make_tuple(b.year, b.month, b.day, b.hour, b.minute, b.second);
+}
+
+} // anonymous namespace
+
+ThumbnailCache::ThumbnailCache(const std::string& dir,
+                               const size_t maxSize)
+  : m_dir(dir)
+  , m_maxSize(maxSize)
+{
+  // Position of each key in the index of the previous session (0 =
+  // the most recently used)
+  std::unordered_map<uint64_t, int> positions;
+  {
+    std::ifstream f(FSTREAM_PATH(indexFilename()), std::ios::binary);
+    uint32_t magic = 0;
+    f.read((char*)&magic, sizeof(magic));
+    uint64_t key;
+    while (f && magic == kIndexMagic &&
+           f.read((char*)&key, sizeof(key))) {
+      positions.insert(std::make_pair(key, int(positions.size())));
+    }
+  }
+
+  // Load the existing entries, the least recently used ones are the
+  // first candidates to be removed.
+  struct Item {
+    uint64_t key;
+    size_t size;
+    base::Time time;
+    int position;               // -1 if it's not in the index
+  };
+  std::vector<Item> items;
+
+  for (const auto& fn : base::list_files(m_dir, base::ItemType::Files)) {
+    if (base::get_file_extension(fn) != kExtension) {
+      // Temporary file of a save() that was interrupted
+      if (base::get_file_extension(fn) == "tmp") {
+        try { base::delete_file(base::join_path(m_dir, fn)); }
+        catch (const std::exception&) { }
+      }
+      continue;
+    }
+
+    const std::string title = base::get_file_title(fn);
+    char* end = nullptr;
+    const uint64_t key = std::strtoull(title.c_str(), &end, 16);
+    if (!end || *end != 0)
+      continue;
+
+    const std::string path = base::join_path(m_dir, fn);
+    auto it = positions.find(key);
+    items.push_back(Item{ key,
+                          base::file_size(path),
+                          base::get_modification_time(path),
+                          (it != positions.end() ? it->second: -1) });
+  }
+
+  // From the least to the most recently used (thumbnails that aren't
+  // in the index were saved after it)
+  std::sort(items.begin(), items.end(),
+            [](const Item& a, const Item& b){
+              if (a.position != b.position)
+                return (a.position > b.position);
+              return less_than(a.time, b.time);
+            });
+
+  for (const Item& item : items)
+    touch(item.key, item.size);
+  shrink();
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+  const std::lock_guard lock(m_mutex);
+  saveIndex();
+}
+
+ImageRef ThumbnailCache::load(const std::string& filename,
+                              const int thumbnailSize)
+{
+  const uint64_t key = makeKey(filename, thumbnailSize);
+  if (!key)
+    return nullptr;
+
+  const std::string fn = entryFilename(key);
+  {
+    const std::lock_guard lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+      return nullptr;
+    touch(key, it->second.size);
+  }
+
+  std::ifstream f(FSTREAM_PATH(fn), std::ios::binary);
+  auto read = [&f](auto& value) {
+    f.read((char*)&value, sizeof(value));
+  };
+
+  uint32_t magic = 0;
+  int32_t w = 0, h = 0;
+  if (f) {
+    read(magic);
+    read(w);
+    read(h);
+  }
+  if (!f || magic != kMagic ||
+      w < 1 || w > thumbnailSize ||
+      h < 1 || h > thumbnailSize) {
+    const std::lock_guard lock(m_mutex);
+    remove(key);
+    return nullptr;
+  }
+
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  const int widthBytes = image->widthBytes();
+  for (int y=0; y<h; ++y)
+    f.read((char*)image->getPixelAddress(0, y), widthBytes);
+
+  if (!f) {
+    const std::lock_guard lock(m_mutex);
+    remove(key);
+    return nullptr;
+  }
+  return image;
+}
+
+void ThumbnailCache::save(const std::string& filename,
+                          const int thumbnailSize,
+                          const Image* image)
+{
+  ASSERT(image->pixelFormat() == IMAGE_RGB);
+
+  const uint64_t key = makeKey(filename, thumbnailSize);
+  if (!key)
+    return;
+
+  // Write in a temporary file and then rename it, so other threads
+  // (or another instance of the program) cannot read a partial file.
+  const std::string fn = entryFilename(key);
+  const std::string tmp = fn + ".tmp";
+  {
+    std::ofstream f(FSTREAM_PATH(tmp), std::ios::binary);
+    if (!f)
+      return;
+
+    auto write = [&f](const auto& value) {
+      f.write((const char*)&value, sizeof(value));
+    };
+
+    write(kMagic);
+    write(int32_t(image->width()));
+    write(int32_t(image->height()));
+    const int widthBytes = image->widthBytes();
+    for (int y=0; y<image->height(); ++y)
+      f.write((const char*)image->getPixelAddress(0, y), widthBytes);
+    if (!f)
+      return;
+  }
+
+  const std::lock_guard lock(m_mutex);
+  try {
+    if (base::is_file(fn))
+      base::delete_file(fn);
+    base::move_file(tmp, fn);
+  }
+  catch (const std::exception&) {
+    // Ignore errors, the thumbnail will be generated again
+    remove(key);
+    return;
+  }
+
+  touch(key, base::file_size(fn));
+  shrink();
+}
+
+// static
+uint64_t ThumbnailCache::makeKey(const std::string& filename,
+                                 const int thumbnailSize)
+{
+  if (!base::is_file(filename))
+    return 0;
+
+  const std::string path = base::get_absolute_path(filename);
+  const base::Time time = base::get_modification_time(path);
+  const uint64_t size = base::file_size(path);
+
+  Hash64 h;
+  h.update(path.c_str(), path.size());
+  feed(h, size);
+  feed(h, time.year);
+  feed(h, time.month);
+  feed(h, time.day);
+  feed(h, time.hour);
+  feed(h, time.minute);
+  feed(h, time.second);
+  feed(h, thumbnailSize);
+  // Zero is used as "no key"
+  return std::max<uint64_t>(h.digest(), 1);
+}
+
+std::string ThumbnailCache::entryFilename(const uint64_t key) const
+{
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%016llx.%s",
+                (unsigned long long)key, kExtension);
+  return base::join_path(m_dir, buf);
+}
+
+std::string ThumbnailCache::indexFilename() const
+{
+  return base::join_path(m_dir, kIndexFilename);
+}
+
+void ThumbnailCache::saveIndex()
+{
+  const std::string fn = indexFilename();
+  const std::string tmp = fn + ".tmp";
+  {
+    std::ofstream f(FSTREAM_PATH(tmp), std::ios::binary);
+    if (!f)
+      return;
+
+    f.write((const char*)&kIndexMagic, sizeof(kIndexMagic));
+    for (const uint64_t key : m_lru)
+      f.write((const char*)&key, sizeof(key));
+    if (!f)
+      return;
+  }
+
+  try {
+    if (base::is_file(fn))
+      base::delete_file(fn);
+    base::move_file(tmp, fn);
+  }
+  catch (const std::exception&) {
+    // Ignore errors, thumbnails will be ordered by modification time
+  }
+}
+
+void ThumbnailCache::touch(const uint64_t key, const size_t size)
+{
+  auto it = m_entries.find(key);
+  if (it != m_entries.end()) {
+    m_totalSize -= it->second.size;
+    m_lru.erase(it->second.lru);
+  }
+  m_lru.push_front(key);
+  m_entries[key] = Entry{ m_lru.begin(), size };
+  m_totalSize += size;
+}
+
+void ThumbnailCache::remove(const uint64_t key)
+{
+  auto it = m_entries.find(key);
+  if (it != m_entries.end()) {
+    m_totalSize -= it->second.size;
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+  }
+
+  try {
+    const std::string fn = entryFilename(key);
+    if (base::is_file(fn))
+      base::delete_file(fn);
+  }
+  catch (const std::exception&) {
+    // Ignore errors
+  }
+}
+
+void ThumbnailCache::shrink()
+{
+  while (m_totalSize > m_maxSize && !m_lru.empty())
+    remove(m_lru.back());
+}
+
+} // namespace app
@@ -0,0 +1,81 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/ints.h"
+#include "doc/image_ref.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Disk cache of file selector thumbnails. Each thumbnail is stored
+  // in its own file in the given directory, identified by a hash of
+  // the original file path, its size and modification time, and the
+  // thumbnail size (so modified files generate a new thumbnail).
+  //
+  // When the total size of the cache exceeds the given limit, the
+  // least recently used thumbnails are deleted. The order of use is
+  // saved in an index file when the cache is destroyed, so it's kept
+  // between sessions (thumbnails that aren't in the index, e.g. saved
+  // by other instance of the program, are ordered by modification
+  // time).
+  //
+  // It can be used from several threads at the same time.
+  class ThumbnailCache {
+  public:
+    ThumbnailCache(const std::string& dir,
+                   const size_t maxSize);
+    ~ThumbnailCache();
+
+    // Returns the cached thumbnail (an IMAGE_RGB image in sRGB color
+    // space) of the given file, or nullptr if it's not in the cache.
+    doc::ImageRef load(const std::string& filename,
+                       const int thumbnailSize);
+
+    // Saves the thumbnail of the given file. The image must be an
+    // IMAGE_RGB image in sRGB color space.
+    void save(const std::string& filename,
+              const int thumbnailSize,
+              const doc::Image* image);
+
+  private:
+    struct Entry {
+      std::list<uint64_t>::iterator lru;
+      size_t size;
+    };
+
+    static uint64_t makeKey(const std::string& filename,
+                            const int thumbnailSize);
+    std::string entryFilename(const uint64_t key) const;
+    std::string indexFilename() const;
+    void saveIndex();
+    void touch(const uint64_t key, const size_t size);
+    void remove(const uint64_t key);
+    void shrink();
+
+    std::mutex m_mutex;
+    std::string m_dir;
+    size_t m_maxSize;
+    size_t m_totalSize = 0;
+    // Keys of cached thumbnails, the most recently used first
+    std::list<uint64_t> m_lru;
+    std::unordered_map<uint64_t, Entry> m_entries;
+  };
+
+} // namespace app
+
+#endif
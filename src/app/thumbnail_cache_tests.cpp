@@ -0,0 +1,112 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <fstream>
+
+using namespace app;
+using namespace doc;
+
+static void write_file(const std::string& fn, const std::string& content)
+{
+  std::ofstream f(fn, std::ios::binary);
+  f << content;
+}
+
+static void clear_dir(const std::string& dir)
+{
+  if (!base::is_directory(dir))
+    base::make_directory(dir);
+  for (const auto& fn : base::list_files(dir, base::ItemType::Files))
+    base::delete_file(base::join_path(dir, fn));
+}
+
+TEST(ThumbnailCache, SaveAndLoad)
+{
+  const std::string dir = "_test_thumbnails";
+  clear_dir(dir);
+  write_file("_test_thumbnail.txt", "a");
+
+  ImageRef image(Image::create(IMAGE_RGB, 4, 3));
+  clear_image(image.get(), rgba(255, 0, 0, 255));
+  put_pixel(image.get(), 1, 2, rgba(0, 0, 255, 128));
+
+  {
+    ThumbnailCache cache(dir, 1024*1024);
+    EXPECT_EQ(nullptr, cache.load("_test_thumbnail.txt", 128));
+    cache.save("_test_thumbnail.txt", 128, image.get());
+  }
+
+  // A new cache (e.g. next session) finds the saved thumbnail
+  ThumbnailCache cache(dir, 1024*1024);
+  EXPECT_EQ(nullptr, cache.load("_test_thumbnail.txt", 64));
+  ImageRef cached = cache.load("_test_thumbnail.txt", 128);
+  ASSERT_NE(nullptr, cached);
+  EXPECT_EQ(0, count_diff_between_images(image.get(), cached.get()));
+
+  // The file is modified, so the thumbnail is invalid
+  write_file("_test_thumbnail.txt", "bc");
+  EXPECT_EQ(nullptr, cache.load("_test_thumbnail.txt", 128));
+}
+
+TEST(ThumbnailCache, RemoveLeastRecentlyUsed)
+{
+  const std::string dir = "_test_thumbnails";
+  clear_dir(dir);
+  write_file("_test_thumbnail_a.txt", "a");
+  write_file("_test_thumbnail_b.txt", "b");
+  write_file("_test_thumbnail_c.txt", "c");
+
+  ImageRef image(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(image.get(), rgba(0, 0, 0, 255));
+
+  // Space for two thumbnails only
+  ThumbnailCache cache(dir, 2*(16*16*4 + 64));
+  cache.save("_test_thumbnail_a.txt", 128, image.get());
+  cache.save("_test_thumbnail_b.txt", 128, image.get());
+  EXPECT_NE(nullptr, cache.load("_test_thumbnail_a.txt", 128));
+
+  // "b" is the least recently used thumbnail
+  cache.save("_test_thumbnail_c.txt", 128, image.get());
+  EXPECT_NE(nullptr, cache.load("_test_thumbnail_a.txt", 128));
+  EXPECT_EQ(nullptr, cache.load("_test_thumbnail_b.txt", 128));
+  EXPECT_NE(nullptr, cache.load("_test_thumbnail_c.txt", 128));
+}
+
+TEST(ThumbnailCache, KeepUseOrderBetweenSessions)
+{
+  const std::string dir = "_test_thumbnails";
+  clear_dir(dir);
+  write_file("_test_thumbnail_a.txt", "a");
+  write_file("_test_thumbnail_b.txt", "b");
+  write_file("_test_thumbnail_c.txt", "c");
+
+  ImageRef image(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(image.get(), rgba(0, 0, 0, 255));
+
+  const size_t thumbnailSize = 16*16*4 + 64;
+  {
+    ThumbnailCache cache(dir, 3*thumbnailSize);
+    cache.save("_test_thumbnail_a.txt", 128, image.get());
+    cache.save("_test_thumbnail_b.txt", 128, image.get());
+    cache.save("_test_thumbnail_c.txt", 128, image.get());
+    // "a" is used again (its file isn't modified)
+    EXPECT_NE(nullptr, cache.load("_test_thumbnail_a.txt", 128));
+  }
+
+  // Next session with space for two thumbnails only, "b" is the
+  // least recently used thumbnail
+  ThumbnailCache cache(dir, 2*thumbnailSize);
+  EXPECT_NE(nullptr, cache.load("_test_thumbnail_a.txt", 128));
+  EXPECT_EQ(nullptr, cache.load("_test_thumbnail_b.txt", 128));
+  EXPECT_NE(nullptr, cache.load("_test_thumbnail_c.txt", 128));
+}
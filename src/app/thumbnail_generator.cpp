@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,9 +16,14 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/pref/preferences.h"
+#include "app/resource_finder.h"
+#include "app/thumbnail_cache.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/fs.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
+#include "doc/color.h"
 #include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -30,6 +35,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <thread>
 
@@ -38,10 +44,42 @@
 
 namespace app {
 
+// Thumbnails are cached/converted to surfaces as RGB images
+static Image* convert_thumbnail_to_rgb(const Image* image,
+                                       const Palette* palette)
+{
+  if (image->pixelFormat() == IMAGE_RGB)
+    return Image::createCopy(image);
+
+  Image* rgb = Image::create(IMAGE_RGB, image->width(), image->height());
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      color_t c = get_pixel(image, x, y);
+      switch (image->pixelFormat()) {
+        case IMAGE_GRAYSCALE: {
+          const int v = graya_getv(c);
+          c = rgba(v, v, v, graya_geta(c));
+          break;
+        }
+        case IMAGE_INDEXED:
+          c = (c == image->maskColor() ? 0: palette->getEntry(c));
+          break;
+        default:
+          c = 0;
+          break;
+      }
+      put_pixel(rgb, x, y, c);
+    }
+  }
+  return rgb;
+}
+
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
-    : m_queue(queue)
+  Worker(ThumbnailGenerator* generator,
+         ThumbnailCache* cache)
+    : m_generator(generator)
+    , m_cache(cache)
     , m_fop(nullptr)
     , m_isDone(false)
     , m_thread([this]{ loadBgThread(); }) {
@@ -62,6 +100,16 @@ public:
       m_fop->stop();
   }
 
+  // Stops the generation of the current thumbnail if its file-item
+  // isn't in the given set of visible items.
+  void stopIfNotVisible(const std::unordered_map<IFileItem*, int>& visible) const {
+    const std::lock_guard lock(m_mutex);
+    if (m_item.fileitem && m_item.fop &&
+        visible.find(m_item.fileitem) == visible.end()) {
+      m_item.fop->stop();
+    }
+  }
+
   bool isDone() const {
     return m_isDone;
   }
@@ -85,75 +133,26 @@ private:
         ASSERT(m_fop);
       }
 
-      THUMB_TRACE("FOP loading thumbnail: %s\n",
-                  m_item.fileitem->fileName().c_str());
-
-      // Load the file
-      m_fop->operate(nullptr);
-
-      // Don't call post-load because postLoad() needs user interaction.
-      //m_fop->postLoad();
-
-      // Convert the loaded document into the os::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
-      std::unique_ptr<Image> thumbnailImage;
-      std::unique_ptr<Palette> palette;
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Special case for indexed images:
-        // If the sprite is transparent -> set the transparent color index alpha = 0
-        if (sprite->colorMode() == ColorMode::INDEXED &&
-            !sprite->backgroundLayer()) {
-          int i = sprite->transparentColor();
-          if (i >= 0 && i < int(palette->size()))
-            palette->setEntry(i, doc::rgba(0, 0, 0, 0));
-        }
+      const std::string filename = m_item.fileitem->fileName();
 
-        const int w = sprite->width()*sprite->pixelRatio().w;
-        const int h = sprite->height()*sprite->pixelRatio().h;
+      // Try to use the thumbnail from the disk cache
+      ImageRef thumbnailImage;
+      if (m_cache)
+        thumbnailImage = m_cache->load(filename, MAX_THUMBNAIL_SIZE);
 
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
-        int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
-        if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
-          thumb_w = w;
-          thumb_h = h;
-        }
-        thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
-        thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        thumbnailImage.reset(
-          Image::create(
-            sprite->pixelFormat(), thumb_w, thumb_h));
-
-        render::Projection proj(sprite->pixelRatio(),
-                                render::Zoom(thumb_w, w));
-        render::Render render;
-        render.setBgOptions(render::BgOptions::MakeTransparent());
-        render.setProjection(proj);
-        render.renderSprite(
-          thumbnailImage.get(), sprite, frame_t(0),
-          gfx::Clip(0, 0, 0, 0, w, h));
-
-        // Convert the image to sRGB color space
-        auto cs = sprite->colorSpace();
-        if (m_fop->preserveColorProfile() &&
-            cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
-          app::cmd::convert_color_profile(
-            thumbnailImage.get(), palette.get(),
-            cs, gfx::ColorSpace::MakeSRGB());
-        }
-      }
+      if (!thumbnailImage) {
+        THUMB_TRACE("FOP loading thumbnail: %s\n", filename.c_str());
+
+        // Load the file
+        m_fop->operate(nullptr);
+        thumbnailImage = renderThumbnail();
 
-      // Close file
-      delete m_fop->releaseDocument();
+        if (thumbnailImage && m_cache && !m_fop->isStop())
+          m_cache->save(filename, MAX_THUMBNAIL_SIZE, thumbnailImage.get());
+
+        // Close file
+        delete m_fop->releaseDocument();
+      }
 
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
@@ -163,7 +162,7 @@ private:
             thumbnailImage->height());
 
         convert_image_to_surface(
-          thumbnailImage.get(), palette.get(), thumbnail.get(),
+          thumbnailImage.get(), nullptr, thumbnail.get(),
           0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
 
         {
@@ -173,7 +172,7 @@ private:
       }
 
       THUMB_TRACE("FOP done with thumbnail: %s %s\n",
-                  m_item.fileitem->fileName().c_str(),
+                  filename.c_str(),
                   (m_fop->isStop() ? " (stop)": ""));
     }
     catch (const std::exception& e) {
@@ -192,6 +191,10 @@ private:
     // associated to this fileitem anymore, and then the FileOp).
     {
       const std::lock_guard lock(m_mutex);
+      // If the generation was cancelled, reset the progress so the
+      // thumbnail can be generated again when it's needed.
+      if (m_fop->isStop() && m_item.fileitem->needThumbnail())
+        m_item.fileitem->setThumbnailProgress(0.0);
       m_item.fileitem = nullptr;
     }
 
@@ -205,25 +208,87 @@ private:
     ASSERT(!m_fop);
   }
 
+  // Renders the first frame of the loaded document in a RGB image
+  // (in sRGB color space).
+  ImageRef renderThumbnail() {
+    // Don't call post-load because postLoad() needs user interaction.
+    //m_fop->postLoad();
+
+    const Sprite* sprite =
+      (m_fop->document() &&
+       m_fop->document()->sprite() ?
+       m_fop->document()->sprite(): nullptr);
+    if (m_fop->isStop() || !sprite)
+      return nullptr;
+
+    // The palette to convert the Image
+    std::unique_ptr<Palette> palette(new Palette(*sprite->palette(frame_t(0))));
+
+    // Special case for indexed images:
+    // If the sprite is transparent -> set the transparent color index alpha = 0
+    if (sprite->colorMode() == ColorMode::INDEXED &&
+        !sprite->backgroundLayer()) {
+      int i = sprite->transparentColor();
+      if (i >= 0 && i < int(palette->size()))
+        palette->setEntry(i, doc::rgba(0, 0, 0, 0));
+    }
+
+    const int w = sprite->width()*sprite->pixelRatio().w;
+    const int h = sprite->height()*sprite->pixelRatio().h;
+
+    // Calculate the thumbnail size
+    int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
+    int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
+    if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
+      thumb_w = w;
+      thumb_h = h;
+    }
+    thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
+    thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
+
+    // Stretch the 'image'
+    std::unique_ptr<Image> thumbnailImage(
+      Image::create(
+        sprite->pixelFormat(), thumb_w, thumb_h));
+
+    render::Projection proj(sprite->pixelRatio(),
+                            render::Zoom(thumb_w, w));
+    render::Render render;
+    render.setBgOptions(render::BgOptions::MakeTransparent());
+    render.setProjection(proj);
+    render.renderSprite(
+      thumbnailImage.get(), sprite, frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+
+    // Convert the image to sRGB color space
+    auto cs = sprite->colorSpace();
+    if (m_fop->preserveColorProfile() &&
+        cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
+      app::cmd::convert_color_profile(
+        thumbnailImage.get(), palette.get(),
+        cs, gfx::ColorSpace::MakeSRGB());
+    }
+
+    return ImageRef(convert_thumbnail_to_rgb(thumbnailImage.get(),
+                                             palette.get()));
+  }
+
   void loadBgThread() {
     base::this_thread::set_name("thumbnails");
 
-    while (!m_queue.empty()) {
-      bool success = true;
-      while (success) {
-        {
-          const std::lock_guard lock(m_mutex); // To access m_item
-          success = m_queue.try_pop(m_item);
-        }
-        if (success)
-          loadItem();
+    Item item;
+    while (m_generator->popItem(item)) {
+      {
+        const std::lock_guard lock(m_mutex); // To access m_item
+        m_item = item;
       }
-      base::this_thread::yield();
+      loadItem();
     }
     m_isDone = true;
   }
 
-  base::concurrent_queue<Item>& m_queue;
+  ThumbnailGenerator* m_generator;
+  ThumbnailCache* m_cache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
@@ -249,24 +314,65 @@ ThumbnailGenerator::ThumbnailGenerator()
   int n = std::thread::hardware_concurrency()-1;
   if (n < 1) n = 1;
   m_maxWorkers = n;
+
+  // Size of the disk cache in MB
+  const int cacheSize = Preferences::instance().fileSelector.thumbnailCacheSize();
+  if (cacheSize > 0) {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+    m_cache = std::make_unique<ThumbnailCache>(
+      rf.getFirstOrCreateDefault(),
+      size_t(cacheSize) * 1024 * 1024);
+  }
 }
 
-bool ThumbnailGenerator::checkWorkers()
+ThumbnailGenerator::~ThumbnailGenerator()
 {
+  {
+    const std::lock_guard lock(m_remainingItemsAccess);
+    for (Item& item : m_remainingItems)
+      delete item.fop;
+    m_remainingItems.clear();
+    m_exit = true;
+  }
+  m_remainingItemsCV.notify_all();
+
+  // Join all workers before the queue is destroyed
   const std::lock_guard lock(m_workersAccess);
-  bool doingWork = (!m_workers.empty());
+  m_workers.clear();
+}
 
-  for (WorkerList::iterator
-         it=m_workers.begin(); it != m_workers.end(); ) {
-    (*it)->updateProgress();
-    if ((*it)->isDone()) {
-      it = m_workers.erase(it);
-    }
-    else {
-      ++it;
+bool ThumbnailGenerator::checkWorkers()
+{
+  bool doingWork;
+  {
+    const std::lock_guard lock(m_workersAccess);
+    doingWork = (!m_workers.empty());
+
+    for (WorkerList::iterator
+           it=m_workers.begin(); it != m_workers.end(); ) {
+      (*it)->updateProgress();
+      if ((*it)->isDone()) {
+        it = m_workers.erase(it);
+      }
+      else {
+        ++it;
+      }
     }
   }
 
+  // Workers finish after a while without work, so it's possible that
+  // the last ones finished just when a new item was queued (and it
+  // wasn't possible to start a new worker because we were at the
+  // m_maxWorkers limit).
+  bool pendingItems;
+  {
+    const std::lock_guard lock(m_remainingItemsAccess);
+    pendingItems = !m_remainingItems.empty();
+  }
+  if (pendingItems)
+    startWorker();
+
   return doingWork;
 }
 
@@ -275,29 +381,10 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
   if (!fileitem->needThumbnail())
     return;
 
-  if (fileitem->getThumbnailProgress() > 0.0) {
-    if (fileitem->getThumbnailProgress() == 0.00001) {
-      m_remainingItems.prioritize(
-        [fileitem](const Item& item) {
-          return (item.fileitem == fileitem);
-        });
-
-      // If there is no more workers running, we have to start a new
-      // one to process the m_remainingItems queue. How is it possible
-      // that a IFileItem has a thumbnail progress == 0.00001 but
-      // there is no workers?  This is an edge case where:
-      // 1. The Worker::loadBgThread() asks for the queue of remaining items
-      //    and it's empty, so the thread is going to be closed
-      // 2. We've just created a FOP for this IFileItem and ask for
-      //    available workers and we've already launch the max quantity
-      //    of possible workers (m_maxWorkers)
-      // 3. All worker threads are just closed so there is no more
-      //    worker for the remaining item in the queue.
-      if (m_workers.empty())
-        startWorker();
-    }
+  // The item is already queued (its priority is updated in
+  // setVisibleItems()) or its thumbnail is being generated.
+  if (fileitem->getThumbnailProgress() > 0.0)
     return;
-  }
 
   // Set a starting progress so we don't enqueue the same item two times.
   fileitem->setThumbnailProgress(0.00001);
@@ -311,6 +398,8 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
       fileitem->fileName().c_str(),
       FILE_LOAD_SEQUENCE_NONE |
       FILE_LOAD_ONE_FRAME));
+  if (fop)
+    fop->setThumbnailSize(MAX_THUMBNAIL_SIZE);
   if (!fop || fop->hasError()) {
     // Set a nullptr thumbnail so we don't try to generate a thumbnail
     // for this fileitem again.
@@ -318,37 +407,104 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
     return;
   }
 
-  m_remainingItems.push(Item(fileitem, fop.get()));
+  {
+    const std::lock_guard lock(m_remainingItemsAccess);
+    auto it = m_priorities.find(fileitem);
+    const int priority = (it != m_priorities.end() ? it->second:
+                                                     int(m_priorities.size()));
+    m_remainingItems.push_back(Item(fileitem, fop.get(), priority));
+    sortRemainingItems();
+  }
   fop.release();
+  m_remainingItemsCV.notify_one();
 
   startWorker();
 }
 
 void ThumbnailGenerator::stopAllWorkers()
 {
-  Item item;
-  while (!m_remainingItems.empty()) {
-    while (m_remainingItems.try_pop(item)) {
-      if (!item.fileitem->getThumbnail()) {
-        // Reset progress to 0.0 because the FileOp wasn't used and we
-        // will need to create it again if we require this FileItem
-        // thumbnail again.
-        item.fileitem->setThumbnailProgress(0.0);
+  {
+    const std::lock_guard lock(m_remainingItemsAccess);
+    for (Item& item : m_remainingItems)
+      cancelItem(item);
+    m_remainingItems.clear();
+  }
+
+  const std::lock_guard lock(m_workersAccess);
+  for (const auto& worker : m_workers)
+    worker->stop();
+}
+
+void ThumbnailGenerator::setVisibleItems(const std::vector<IFileItem*>& items)
+{
+  m_priorities.clear();
+  for (int i=0; i<int(items.size()); ++i)
+    m_priorities.emplace(items[i], i); // Keeps the first index
+
+  {
+    const std::lock_guard lock(m_remainingItemsAccess);
+    for (auto it=m_remainingItems.begin(); it!=m_remainingItems.end(); ) {
+      auto p = m_priorities.find(it->fileitem);
+      if (p == m_priorities.end()) {
+        cancelItem(*it);
+        it = m_remainingItems.erase(it);
+      }
+      else {
+        it->priority = p->second;
+        ++it;
       }
-      delete item.fop;
     }
+    sortRemainingItems();
   }
 
   const std::lock_guard lock(m_workersAccess);
   for (const auto& worker : m_workers)
-    worker->stop();
+    worker->stopIfNotVisible(m_priorities);
+}
+
+void ThumbnailGenerator::cancelItem(Item& item)
+{
+  if (!item.fileitem->getThumbnail()) {
+    // Reset progress to 0.0 because the FileOp wasn't used and we
+    // will need to create it again if we require this FileItem
+    // thumbnail again.
+    item.fileitem->setThumbnailProgress(0.0);
+  }
+  delete item.fop;
+  item.fop = nullptr;
+}
+
+void ThumbnailGenerator::sortRemainingItems()
+{
+  std::stable_sort(m_remainingItems.begin(), m_remainingItems.end(),
+                   [](const Item& a, const Item& b){
+                     return a.priority < b.priority;
+                   });
+}
+
+bool ThumbnailGenerator::popItem(Item& item)
+{
+  std::unique_lock lock(m_remainingItemsAccess);
+
+  // Wait for new items, the worker finishes after one second without
+  // work.
+  if (!m_remainingItemsCV.wait_for(
+        lock, std::chrono::seconds(1),
+        [this]{ return m_exit || !m_remainingItems.empty(); }) ||
+      m_exit) {
+    return false;
+  }
+
+  item = m_remainingItems.front();
+  m_remainingItems.erase(m_remainingItems.begin());
+  return true;
 }
 
 void ThumbnailGenerator::startWorker()
 {
   const std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(this, m_cache.get()));
   }
 }
 
@@ -9,23 +9,22 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
-#include "base/concurrent_queue.h"
-
+#include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
-namespace base {
-  class thread;
-}
-
 namespace app {
   class FileOp;
   class IFileItem;
+  class ThumbnailCache;
 
   class ThumbnailGenerator {
     ThumbnailGenerator();
   public:
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
@@ -43,9 +42,14 @@ namespace app {
     // thread.
     void stopAllWorkers();
 
-  private:
-    void startWorker();
+    // Sets the file-items that are visible on the screen, sorted by
+    // importance (e.g. the selected item first). Their thumbnails are
+    // generated first in the same order, and thumbnails of any other
+    // file-item (queued or being generated) are cancelled. It must be
+    // called from the GUI thread.
+    void setVisibleItems(const std::vector<IFileItem*>& items);
 
+  private:
     class Worker;
     using WorkerPtr = std::unique_ptr<Worker>;
     using WorkerList = std::vector<WorkerPtr>;
@@ -53,17 +57,37 @@ namespace app {
     struct Item {
       IFileItem* fileitem;
       FileOp* fop;
-      Item() : fileitem(nullptr), fop(nullptr) { }
-      Item(const Item& item) : fileitem(item.fileitem), fop(item.fop) { }
-      Item(IFileItem* fileitem, FileOp* fop)
-        : fileitem(fileitem), fop(fop) {
+      int priority;             // Lower values are generated first
+      Item() : fileitem(nullptr), fop(nullptr), priority(0) { }
+      Item(IFileItem* fileitem, FileOp* fop, int priority)
+        : fileitem(fileitem), fop(fop), priority(priority) {
       }
     };
 
+    void startWorker();
+    void cancelItem(Item& item);
+    void sortRemainingItems();
+
+    // Called from workers to get the next item to generate. It blocks
+    // until there is an item available, returning false if there is
+    // nothing to do after a while.
+    bool popItem(Item& item);
+
     int m_maxWorkers;
+    // Disk cache of thumbnails (nullptr if it's disabled)
+    std::unique_ptr<ThumbnailCache> m_cache;
     WorkerList m_workers;
     std::mutex m_workersAccess;
-    base::concurrent_queue<Item> m_remainingItems;
+
+    // Items waiting for a worker, sorted by priority
+    std::vector<Item> m_remainingItems;
+    std::mutex m_remainingItemsAccess;
+    std::condition_variable m_remainingItemsCV;
+    bool m_exit = false;
+
+    // Priority of each visible file-item (the index in the last
+    // setVisibleItems() call)
+    std::unordered_map<IFileItem*, int> m_priorities;
   };
 
 } // namespace app
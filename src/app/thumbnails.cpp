@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2016  Carlo Caputo
 //
@@ -10,29 +10,76 @@
 #include "config.h"
 #endif
 
+#include "app/thumbnails.h"
+
 #include "app/util/conversion_to_surface.h"
+#include "base/thread.h"
+#include "doc/algorithm/resize_image.h"
 #include "doc/blend_mode.h"
 #include "doc/cel.h"
+#include "doc/hash64.h"
 #include "doc/layer.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/pixel_ratio.h"
 #include "doc/sprite.h"
 #include "os/surface.h"
 #include "os/system.h"
 #include "render/render.h"
+#include "ui/system.h"
+
+#include <algorithm>
 
 namespace app {
 namespace thumb {
 
-os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
-                                 const gfx::Size& fitInSize)
+namespace {
+
+// Maximum number of thumbnails in a CelThumbnailCache
+constexpr size_t kMaxEntries = 4096;
+
+// Maximum number of thumbnails waiting to be generated (older
+// requests are discarded, e.g. cels that are not visible anymore
+// after scrolling the timeline)
+constexpr size_t kMaxJobs = 512;
+
+template<typename T>
+void feed(doc::Hash64& h, const T& value)
 {
-  gfx::Size newSize;
+  h.update(&value, sizeof(value));
+}
 
-  if (cel->bounds().w > fitInSize.w ||
-      cel->bounds().h > fitInSize.h)
-    newSize = gfx::Rect(cel->bounds()).fitIn(gfx::Rect(fitInSize)).size();
+gfx::Size calc_thumbnail_size(const gfx::Rect& celBounds,
+                              const gfx::Size& fitInSize)
+{
+  if (celBounds.w > fitInSize.w ||
+      celBounds.h > fitInSize.h)
+    return gfx::Rect(celBounds).fitIn(gfx::Rect(fitInSize)).size();
   else
-    newSize = cel->bounds().size();
+    return celBounds.size();
+}
+
+os::SurfaceRef make_surface(const doc::Image* thumbnailImage,
+                            const doc::Palette* palette)
+{
+  if (os::SurfaceRef thumbnail = os::instance()->makeRgbaSurface(
+        thumbnailImage->width(),
+        thumbnailImage->height())) {
+    convert_image_to_surface(
+      thumbnailImage, palette, thumbnail.get(),
+      0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
+    return thumbnail;
+  }
+  else
+    return nullptr;
+}
+
+} // anonymous namespace
 
+os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
+                                 const gfx::Size& fitInSize)
+{
+  gfx::Size newSize = calc_thumbnail_size(cel->bounds(), fitInSize);
   if (newSize.w < 1 ||
       newSize.h < 1)
     return nullptr;
@@ -58,16 +105,204 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
     gfx::Clip(gfx::Rect(gfx::Point(0, 0), newSize)),
     255, doc::BlendMode::NORMAL);
 
-  if (os::SurfaceRef thumbnail = os::instance()->makeRgbaSurface(
-        thumbnailImage->width(),
-        thumbnailImage->height())) {
-    convert_image_to_surface(
-      thumbnailImage.get(), palette, thumbnail.get(),
-      0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
-    return thumbnail;
+  return make_surface(thumbnailImage.get(), palette);
+}
+
+// Everything needed to generate a thumbnail in a background thread
+// (copies of the palette and of the cel image reduced to the thumbnail
+// size, so the cel can be modified in the meantime).
+struct CelThumbnailCache::Job {
+  uint64_t key;
+  doc::ImageRef image;
+  std::unique_ptr<doc::Palette> palette;
+  doc::PixelRatio pixelRatio;
+  gfx::Size size;
+};
+
+CelThumbnailCache::CelThumbnailCache()
+  : m_alive(std::make_shared<bool>(true))
+{
+}
+
+CelThumbnailCache::~CelThumbnailCache()
+{
+  {
+    const std::lock_guard lock(m_mutex);
+    m_exit = true;
+    m_jobs.clear();
   }
-  else
+  m_cv.notify_all();
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+os::SurfaceRef CelThumbnailCache::getCelThumbnail(const doc::Cel* cel,
+                                                  const gfx::Size& fitInSize)
+{
+  const doc::Image* image = cel->image();
+
+  // Tilemaps depend on the tileset, they are generated directly
+  if (image->pixelFormat() == doc::IMAGE_TILEMAP)
+    return get_cel_thumbnail(cel, fitInSize);
+
+  const gfx::Size newSize = calc_thumbnail_size(cel->bounds(), fitInSize);
+  if (newSize.w < 1 ||
+      newSize.h < 1)
     return nullptr;
+
+  const doc::Sprite* sprite = cel->sprite();
+  const doc::Palette* palette = sprite->palette(cel->frame());
+
+  doc::Hash64 h;
+  feed(h, image->id());
+  feed(h, image->version());
+  feed(h, image->pixelFormat());
+  feed(h, image->maskColor());
+  feed(h, cel->bounds().w);
+  feed(h, cel->bounds().h);
+  if (image->pixelFormat() == doc::IMAGE_INDEXED) {
+    feed(h, palette->id());
+    feed(h, palette->getModifications());
+  }
+  feed(h, sprite->pixelRatio().w);
+  feed(h, sprite->pixelRatio().h);
+  feed(h, newSize.w);
+  feed(h, newSize.h);
+  const uint64_t key = h.digest();
+
+  auto it = m_entries.find(key);
+  if (it != m_entries.end()) {
+    it->second.lastUse = ++m_useCounter;
+    return it->second.surface;
+  }
+
+  auto job = std::make_unique<Job>();
+  job->key = key;
+  // Only the pixels that will be used in the thumbnail are copied
+  // (nearest neighbor, as the zoomed out render), so big cels don't
+  // need a full copy in the UI thread.
+  if (image->width() > newSize.w ||
+      image->height() > newSize.h) {
+    job->image.reset(
+      doc::Image::create(image->pixelFormat(),
+                         std::min(image->width(), newSize.w),
+                         std::min(image->height(), newSize.h)));
+    job->image->setMaskColor(image->maskColor());
+    doc::algorithm::resize_image(
+      image, job->image.get(),
+      doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+      palette, nullptr, image->maskColor());
+  }
+  else
+    job->image.reset(doc::Image::createCopy(image));
+  job->palette = std::make_unique<doc::Palette>(*palette);
+  job->pixelRatio = sprite->pixelRatio();
+  job->size = newSize;
+
+  m_entries[key].lastUse = ++m_useCounter;
+  {
+    const std::lock_guard lock(m_mutex);
+    m_jobs.push_front(std::move(job));
+    while (m_jobs.size() > kMaxJobs) {
+      m_entries.erase(m_jobs.back()->key);
+      m_jobs.pop_back();
+    }
+  }
+
+  // Start worker threads the first time they are needed
+  if (m_threads.empty()) {
+    const int n = std::clamp(int(std::thread::hardware_concurrency())/2, 1, 4);
+    for (int i=0; i<n; ++i)
+      m_threads.emplace_back([this]{ workerThread(); });
+  }
+  m_cv.notify_one();
+
+  removeOldEntries();
+  return nullptr;
+}
+
+void CelThumbnailCache::workerThread()
+{
+  base::this_thread::set_name("cel-thumbnails");
+
+  std::unique_lock lock(m_mutex);
+  while (true) {
+    m_cv.wait(lock, [this]{ return m_exit || !m_jobs.empty(); });
+    if (m_exit)
+      break;
+
+    std::unique_ptr<Job> job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    lock.unlock();
+
+    const doc::Image* image = job->image.get();
+    doc::ImageRef thumbnailImage(
+      doc::Image::create(
+        doc::IMAGE_RGB, job->size.w, job->size.h));
+
+    render::Render render;
+    render.setProjection(
+      render::Projection(job->pixelRatio,
+                         render::Zoom(job->size.w, image->width())));
+    render.renderImage(
+      thumbnailImage.get(), image, job->palette.get(),
+      0, 0, 255, doc::BlendMode::NORMAL);
+
+    os::SurfaceRef surface =
+      make_surface(thumbnailImage.get(), job->palette.get());
+
+    lock.lock();
+    m_results.emplace_back(job->key, surface);
+    if (m_results.size() == 1) {
+      ui::execute_from_ui_thread(
+        [this, alive = std::weak_ptr<bool>(m_alive)]{
+          if (!alive.expired())
+            processResults();
+        });
+    }
+  }
+}
+
+void CelThumbnailCache::processResults()
+{
+  std::vector<std::pair<uint64_t, os::SurfaceRef>> results;
+  {
+    const std::lock_guard lock(m_mutex);
+    std::swap(results, m_results);
+  }
+
+  for (auto& result : results) {
+    // The entry could be removed in the meantime
+    auto it = m_entries.find(result.first);
+    if (it != m_entries.end())
+      it->second.surface = result.second;
+  }
+
+  if (!results.empty())
+    ThumbnailReady();
+}
+
+void CelThumbnailCache::removeOldEntries()
+{
+  if (m_entries.size() <= kMaxEntries)
+    return;
+
+  // Remove the least recently used quarter of the entries
+  std::vector<uint32_t> uses;
+  uses.reserve(m_entries.size());
+  for (const auto& entry : m_entries)
+    uses.push_back(entry.second.lastUse);
+
+  auto nth = uses.begin() + uses.size()/4;
+  std::nth_element(uses.begin(), nth, uses.end());
+  const uint32_t limit = *nth;
+
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    if (it->second.lastUse < limit)
+      it = m_entries.erase(it);
+    else
+      ++it;
+  }
 }
 
 } // thumb
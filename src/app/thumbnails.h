@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016  Carlo Caputo
 //
 // This program is distributed under the terms of
@@ -9,9 +9,19 @@
 #define APP_THUMBNAILS_H_INCLUDED
 #pragma once
 
+#include "base/ints.h"
 #include "gfx/size.h"
+#include "obs/signal.h"
 #include "os/surface.h"
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 namespace doc {
   class Cel;
 }
@@ -26,6 +36,53 @@ namespace thumb {
   os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
                                    const gfx::Size& fitInSize);
 
+  // Cache of cel thumbnails that are generated in background threads
+  // (used by the Timeline so it doesn't render each visible cel in
+  // each paint). Thumbnails are identified by the cel image ID and
+  // version, the palette, and the thumbnail size, so a modified cel
+  // gets a new thumbnail.
+  class CelThumbnailCache {
+  public:
+    CelThumbnailCache();
+    ~CelThumbnailCache();
+
+    // Returns the thumbnail of the cel if it's ready. In other case
+    // it starts generating the thumbnail in a background thread and
+    // returns nullptr; ThumbnailReady is emitted (from the UI thread)
+    // when it's ready. It must be called from the UI thread.
+    os::SurfaceRef getCelThumbnail(const doc::Cel* cel,
+                                   const gfx::Size& fitInSize);
+
+    obs::signal<void()> ThumbnailReady;
+
+  private:
+    struct Entry {
+      os::SurfaceRef surface;   // nullptr while it's being generated
+      uint32_t lastUse = 0;
+    };
+    struct Job;
+
+    void workerThread();
+    void processResults();
+    void removeOldEntries();
+
+    std::unordered_map<uint64_t, Entry> m_entries;
+    uint32_t m_useCounter = 0;
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // Thumbnails to generate (the last requested ones first)
+    std::deque<std::unique_ptr<Job>> m_jobs;
+    // Generated thumbnails to be added to m_entries
+    std::vector<std::pair<uint64_t, os::SurfaceRef>> m_results;
+    bool m_exit = false;
+
+    // Used to know if the cache is still alive when we process the
+    // results from the UI thread
+    std::shared_ptr<bool> m_alive;
+  };
+
 } // thumb
 } // app
 
@@ -0,0 +1,79 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#define TEST_GUI
+#include "tests/app_test.h"
+
+#include "app/cmd/clear_rect.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/thumbnails.h"
+#include "base/time.h"
+#include "doc/doc.h"
+#include "gfx/color.h"
+#include "os/event.h"
+#include "os/event_queue.h"
+
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+// Waits the cel thumbnail generated in a background thread,
+// processing the callbacks queued for the UI thread in the meantime.
+static os::SurfaceRef wait_thumbnail(thumb::CelThumbnailCache& cache,
+                                     const Cel* cel)
+{
+  const base::tick_t t0 = base::current_tick();
+  while (base::current_tick() - t0 < 10000) {
+    if (os::SurfaceRef surface = cache.getCelThumbnail(cel, gfx::Size(4, 4)))
+      return surface;
+
+    os::Event ev;
+    os::EventQueue::instance()->getEvent(ev, 0.01);
+    if (ev.type() == os::Event::Callback)
+      ev.execCallback();
+  }
+  return nullptr;
+}
+
+TEST(CelThumbnailCache, RegenerateModifiedCel)
+{
+  Context ctx;
+  std::unique_ptr<Doc> doc(
+    new Doc(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4))));
+  doc->setContext(&ctx);
+
+  Cel* cel = doc->sprite()->root()->firstLayer()->cel(0);
+  clear_image(cel->image(), rgba(255, 0, 0, 255));
+
+  thumb::CelThumbnailCache cache;
+  os::SurfaceRef surface = wait_thumbnail(cache, cel);
+  ASSERT_TRUE(surface != nullptr);
+  EXPECT_EQ(gfx::rgba(255, 0, 0, 255), surface->getPixel(0, 0));
+
+  // Same thumbnail for the same cel content
+  EXPECT_EQ(surface, wait_thumbnail(cache, cel));
+
+  // Clear the cel, a new thumbnail must be generated
+  cmd::ClearRect clear(cel, gfx::Rect(0, 0, 4, 4));
+  clear.execute(&ctx);
+  EXPECT_EQ(nullptr, cache.getCelThumbnail(cel, gfx::Size(4, 4)));
+
+  surface = wait_thumbnail(cache, cel);
+  ASSERT_TRUE(surface != nullptr);
+  EXPECT_EQ(0, gfx::geta(surface->getPixel(0, 0)));
+
+  // Undo, the pixels are restored and a new thumbnail is generated
+  clear.undo();
+  EXPECT_EQ(nullptr, cache.getCelThumbnail(cel, gfx::Size(4, 4)));
+
+  surface = wait_thumbnail(cache, cel);
+  ASSERT_TRUE(surface != nullptr);
+  EXPECT_EQ(gfx::rgba(255, 0, 0, 255), surface->getPixel(0, 0));
+
+  doc->close();
+}
@@ -399,6 +399,7 @@ bool DocView::onProcessMessage(Message* msg)
 
 void DocView::onGeneralUpdate(DocEvent& ev)
 {
+  m_editor->invalidateRenderCache();
   if (m_editor->isVisible())
     m_editor->updateEditor(true);
 }
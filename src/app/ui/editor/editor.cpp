@@ -58,6 +58,7 @@
 #include "base/chrono.h"
 #include "base/convert_to.h"
 #include "doc/doc.h"
+#include "doc/hash64.h"
 #include "doc/mask_boundaries.h"
 #include "doc/slice.h"
 #include "fmt/format.h"
@@ -664,12 +665,47 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   // Convert the render to a os::Surface
   static os::SurfaceRef rendered = nullptr; // TODO move this to other centralized place
   const auto& renderProperties = m_renderEngine->properties();
-  try {
-    // Generate a "expose sprite pixels" notification. This is used by
-    // tool managers that need to validate this region (copy pixels from
-    // the original cel) before it can be used by the RenderEngine.
-    m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
 
+  // The extra cel (e.g. brush preview) can change on each paint
+  // without notifications, so its area is always rendered again
+  // (and its previous area too, in case that it was moved/removed).
+  ExtraCelRef extraCel = m_document->extraCel();
+  gfx::Rect extraBounds;
+  if (extraCel &&
+      extraCel->type() != render::ExtraType::NONE) {
+    extraBounds = (extraCel->cel() ? extraCel->cel()->bounds():
+                                     m_sprite->bounds());
+  }
+  m_renderCache.invalidate(gfx::Region(m_renderCacheExtraBounds | extraBounds));
+  m_renderCacheExtraBounds = extraBounds;
+
+  // With the new engine the sprite is rendered without zoom, so we
+  // can keep the rendered pixels to draw them again (e.g. when the
+  // editor is scrolled/zoomed, or the mouse cursor is moved) until
+  // the sprite is modified.
+  const bool useCache =
+    (newEngine &&
+     // Onionskin depends on other frames
+     !((m_flags & kShowOnionskin) == kShowOnionskin &&
+       m_docPref.onionskin.active()) &&
+     m_renderCache.prepare(renderCacheStamp(),
+                           m_sprite->bounds(),
+                           // In tiled mode all the sprite can be visible
+                           (m_docPref.tiled.mode() == filters::TiledMode::NONE ?
+                            getVisibleSpriteBounds(): m_sprite->bounds()),
+                           rc2,
+                           m_document->osColorSpace()));
+  if (!useCache)
+    m_renderCache.invalidate();
+
+  // Sprite area that must be rendered (in sprite coordinates when
+  // the cache is used)
+  const gfx::Region toRender =
+    (useCache ? m_renderCache.validate(rc2): gfx::Region(rc2));
+  os::Surface* surface = nullptr;
+  gfx::Point surfaceOrigin(0, 0);
+
+  try {
     m_renderEngine->setNewBlendMethod(pref.experimental.newBlend());
     m_renderEngine->setRefLayersVisiblity(true);
     m_renderEngine->setSelectedLayer(m_layer);
@@ -702,17 +738,6 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       }
     }
 
-    ExtraCelRef extraCel = m_document->extraCel();
-    if (extraCel &&
-        extraCel->type() != render::ExtraType::NONE) {
-      m_renderEngine->setExtraImage(
-        extraCel->type(),
-        extraCel->cel(),
-        extraCel->image(),
-        extraCel->blendMode(),
-        m_layer, m_frame);
-    }
-
     // Render background first (e.g. new ShaderRenderer will paint the
     // background on the screen first and then composite the rendered
     // sprite on it.)
@@ -726,23 +751,53 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
                   m_proj.apply(rc2)));
     }
 
-    // Create a temporary surface to draw the sprite on it
-    if (!rendered ||
-        rendered->width() < rc2.w ||
-        rendered->height() < rc2.h ||
-        rendered->colorSpace() != m_document->osColorSpace()) {
-      const int maxw = std::max(rc2.w, rendered ? rendered->width(): 0);
-      const int maxh = std::max(rc2.h, rendered ? rendered->height(): 0);
-      rendered = os::instance()->makeRgbaSurface(
-        maxw, maxh, m_document->osColorSpace());
+    if (useCache) {
+      surface = m_renderCache.surface();
+      surfaceOrigin = m_renderCache.bounds().origin();
+    }
+    else {
+      // Create a temporary surface to draw the sprite on it
+      if (!rendered ||
+          rendered->width() < rc2.w ||
+          rendered->height() < rc2.h ||
+          rendered->colorSpace() != m_document->osColorSpace()) {
+        const int maxw = std::max(rc2.w, rendered ? rendered->width(): 0);
+        const int maxh = std::max(rc2.h, rendered ? rendered->height(): 0);
+        rendered = os::instance()->makeRgbaSurface(
+          maxw, maxh, m_document->osColorSpace());
+      }
+      surface = rendered.get();
+      surfaceOrigin = rc2.origin();
     }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    if (!toRender.isEmpty()) {
+      // Generate a "expose sprite pixels" notification. This is used by
+      // tool managers that need to validate this region (copy pixels from
+      // the original cel) before it can be used by the RenderEngine.
+      m_document->notifyExposeSpritePixels(
+        m_sprite, (newEngine ? toRender: gfx::Region(expose)));
+
+      if (extraCel &&
+          extraCel->type() != render::ExtraType::NONE) {
+        m_renderEngine->setExtraImage(
+          extraCel->type(),
+          extraCel->cel(),
+          extraCel->image(),
+          extraCel->blendMode(),
+          m_layer, m_frame);
+      }
 
-    m_renderEngine->removeExtraImage();
+      m_renderEngine->setProjection(
+        newEngine ? render::Projection(): m_proj);
+      for (const gfx::Rect& rc : toRender) {
+        m_renderEngine->renderSprite(
+          surface, m_sprite, m_frame,
+          gfx::Clip(rc.x - surfaceOrigin.x,
+                    rc.y - surfaceOrigin.y, rc));
+      }
+
+      m_renderEngine->removeExtraImage();
+    }
 
     // If the checkered background is visible in this sprite, we save
     // all settings of the background for this document.
@@ -750,10 +805,11 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       m_docPref.bg.forceSection();
   }
   catch (const std::exception& e) {
+    m_renderCache.invalidate();
     Console::showException(e);
   }
 
-  if (rendered && rendered->nativeHandle()) {
+  if (surface && surface->nativeHandle()) {
     os::Paint p;
     if (newEngine) {
       os::Sampling sampling;
@@ -783,14 +839,16 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       else
         p.blendMode(os::BlendMode::Src);
 
-      g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, rc2.w, rc2.h),
+      g->drawSurface(surface,
+                     gfx::Rect(rc2.x - surfaceOrigin.x,
+                               rc2.y - surfaceOrigin.y,
+                               rc2.w, rc2.h),
                      dest,
                      sampling,
                      &p);
     }
     else {
-      g->drawSurface(rendered.get(),
+      g->drawSurface(surface,
                      gfx::Rect(0, 0, dest.w, dest.h),
                      gfx::Rect(dest.x, dest.y, dest.w, dest.h),
                      os::Sampling(os::Sampling::Filter::Nearest),
@@ -993,6 +1051,9 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
 
 void Editor::drawSpriteClipped(const gfx::Region& updateRegion)
 {
+  // The given region was modified
+  m_renderCache.invalidate(updateRegion);
+
   Region screenRegion;
   getDrawableRegion(screenRegion, kCutTopWindows);
 
@@ -2992,6 +3053,11 @@ void Editor::invalidateCanvas()
     invalidate();
 }
 
+void Editor::invalidateRenderCache()
+{
+  m_renderCache.invalidate();
+}
+
 void Editor::invalidateIfActive()
 {
 
@@ -3044,6 +3110,70 @@ int Editor::otherLayersOpacity() const
     return Preferences::instance().experimental.nonactiveLayersOpacity();
 }
 
+uint64_t Editor::renderCacheStamp() const
+{
+  doc::Hash64 h;
+  auto feed = [&h](const auto& value) {
+    h.update(&value, sizeof(value));
+  };
+
+  // Render options
+  feed(m_sprite);
+  feed(m_frame);
+  feed(m_layer);
+  feed(otherLayersOpacity());
+  feed(Preferences::instance().experimental.newBlend());
+  feed(m_docPref.bg.type());
+  feed(m_docPref.bg.size());
+  feed(m_docPref.bg.zoom());
+  const std::string bgColors =
+    m_docPref.bg.color1().toString() +
+    m_docPref.bg.color2().toString();
+  h.update(bgColors.c_str(), bgColors.size());
+
+  // Sprite structure
+  feed(m_sprite->bounds());
+  feed(m_sprite->pixelFormat());
+  feed(m_sprite->transparentColor());
+  feed(m_sprite->version());
+  for (const Layer* layer : m_sprite->allLayers()) {
+    feed(layer);
+    feed(layer->flags());
+    if (!layer->isImage())
+      continue;
+
+    const auto layerImage = static_cast<const LayerImage*>(layer);
+    feed(layerImage->blendMode());
+    feed(layerImage->opacity());
+
+    if (const Cel* cel = layer->cel(m_frame)) {
+      feed(cel);
+      feed(cel->bounds());
+      feed(cel->opacity());
+      if (const Image* image = cel->image()) {
+        feed(image);
+        feed(image->version());
+      }
+    }
+  }
+  if (m_sprite->hasTilesets()) {
+    for (const Tileset* tileset : *m_sprite->tilesets()) {
+      if (tileset)
+        feed(tileset->version());
+    }
+  }
+  if (m_sprite->pixelFormat() == IMAGE_INDEXED) {
+    const Palette* palette = m_sprite->palette(m_frame);
+    for (int i=0; i<palette->size(); ++i)
+      feed(palette->getEntry(i));
+  }
+
+  // Preview image of filters, color mode conversion, or the stroke
+  // being drawn
+  feed(m_renderEngine->previewImageStamp());
+  return h.digest();
+}
+
 // static
 void Editor::registerCommands()
 {
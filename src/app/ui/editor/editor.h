@@ -19,6 +19,7 @@
 #include "app/ui/editor/brush_preview.h"
 #include "app/ui/editor/editor_hit.h"
 #include "app/ui/editor/editor_observers.h"
+#include "app/ui/editor/editor_render_cache.h"
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
 #include "app/ui/tile_source.h"
@@ -175,6 +176,10 @@ namespace app {
     // Draws the sprite taking care of the whole clipping region.
     void drawSpriteClipped(const gfx::Region& updateRegion);
 
+    // Discards the rendered pixels of the sprite that are kept to
+    // redraw the editor (e.g. when the sprite is modified).
+    void invalidateRenderCache();
+
     void flashCurrentLayer();
 
     // Convert ui::Display coordinates (pixel relative to the top-left
@@ -406,6 +411,10 @@ namespace app {
 
     int otherLayersOpacity() const;
 
+    // Hash of everything that affects the sprite render in this
+    // editor (used to discard the render cache automatically).
+    uint64_t renderCacheStamp() const;
+
     // Stack of states. The top element in the stack is the current state (m_state).
     EditorStatesHistory m_statesHistory;
     EditorStatesHistory m_deletedStates;
@@ -429,6 +438,12 @@ namespace app {
     // Brush preview
     BrushPreview m_brushPreview;
 
+    // Rendered pixels of the sprite to redraw the editor
+    EditorRenderCache m_renderCache;
+    // Bounds of the extra cel in the last render (in sprite
+    // coordinates)
+    gfx::Rect m_renderCacheExtraBounds;
+
     tools::ToolLoopModifiers m_toolLoopModifiers;
 
     // Extra space around the sprite.
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,12 @@
 #include "app/pref/preferences.h"
 #include "app/render/shader_renderer.h"
 #include "app/render/simple_renderer.h"
+#include "doc/hash64.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/tileset.h"
+
+#include <algorithm>
 
 namespace app {
 
@@ -142,11 +148,37 @@ void EditorRender::setPreviewImage(const doc::Layer* layer,
 {
   m_renderer->setPreviewImage(layer, frame, image, tileset,
                               pos, blendMode);
+  m_preview = Preview{ layer, frame, image, tileset, pos, blendMode };
 }
 
 void EditorRender::removePreviewImage()
 {
   m_renderer->removePreviewImage();
+  m_preview = Preview();
+}
+
+uint64_t EditorRender::previewImageStamp() const
+{
+  if (!m_preview.image && !m_preview.tileset)
+    return 0;
+
+  doc::Hash64 h;
+  auto feed = [&h](const auto& value) {
+    h.update(&value, sizeof(value));
+  };
+  feed(m_preview.layer ? m_preview.layer->id(): doc::NullId);
+  feed(m_preview.frame);
+  feed(m_preview.pos);
+  feed(m_preview.blendMode);
+  if (m_preview.image) {
+    feed(m_preview.image->id());
+    feed(m_preview.image->version());
+  }
+  if (m_preview.tileset) {
+    feed(m_preview.tileset->id());
+    feed(m_preview.tileset->version());
+  }
+  return std::max<uint64_t>(1, h.digest());
 }
 
 void EditorRender::setExtraImage(
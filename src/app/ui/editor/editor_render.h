@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -73,6 +73,11 @@ namespace app {
                          const doc::BlendMode blendMode);
     void removePreviewImage();
 
+    // Returns a value that changes when the preview image (or its
+    // version) changes, or 0 if there is no preview image. Used to
+    // discard the cached renders of the sprite (see EditorRenderCache).
+    uint64_t previewImageStamp() const;
+
     void setExtraImage(
       render::ExtraType type,
       const doc::Cel* cel,
@@ -106,7 +111,18 @@ namespace app {
     static doc::ImageBufferPtr getRenderImageBuffer();
 
   private:
+    // Parameters of setPreviewImage()
+    struct Preview {
+      const doc::Layer* layer = nullptr;
+      doc::frame_t frame = 0;
+      const doc::Image* image = nullptr;
+      const doc::Tileset* tileset = nullptr;
+      gfx::Point pos;
+      doc::BlendMode blendMode = doc::BlendMode::NORMAL;
+    };
+
     std::unique_ptr<Renderer> m_renderer;
+    Preview m_preview;
   };
 
 } // namespace app
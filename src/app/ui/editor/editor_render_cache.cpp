@@ -0,0 +1,88 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/editor_render_cache.h"
+
+#include "gfx/border.h"
+#include "os/system.h"
+
+namespace app {
+
+bool EditorRenderCache::prepare(const uint64_t stamp,
+                                const gfx::Rect& spriteBounds,
+                                const gfx::Rect& visible,
+                                const gfx::Rect& expose,
+                                const os::ColorSpaceRef& colorSpace)
+{
+  if (m_stamp != stamp ||
+      (m_surface && m_surface->colorSpace() != colorSpace)) {
+    m_stamp = stamp;
+    m_valid.clear();
+  }
+
+  if (m_surface && m_bounds.contains(expose))
+    return true;
+
+  // Cache the visible area plus some margin (so small scrolls don't
+  // need a new surface).
+  gfx::Rect bounds = (visible | expose);
+  bounds.enlarge(gfx::Border(bounds.w/4, bounds.h/4,
+                             bounds.w/4, bounds.h/4));
+  bounds &= spriteBounds;
+  if (!bounds.contains(expose) ||
+      int64_t(bounds.w) * bounds.h > kMaxPixels) {
+    // Too big, the cache is not used
+    m_surface.reset();
+    m_bounds = gfx::Rect();
+    m_valid.clear();
+    return false;
+  }
+
+  os::SurfaceRef surface =
+    os::instance()->makeRgbaSurface(bounds.w, bounds.h, colorSpace);
+
+  // Keep the valid pixels of the old surface
+  gfx::Region valid;
+  if (m_surface && !m_valid.isEmpty()) {
+    valid.createIntersection(m_valid, gfx::Region(bounds));
+    for (const gfx::Rect& rc : valid) {
+      m_surface->blitTo(surface.get(),
+                        rc.x - m_bounds.x, rc.y - m_bounds.y,
+                        rc.x - bounds.x, rc.y - bounds.y,
+                        rc.w, rc.h);
+    }
+  }
+
+  m_surface = surface;
+  m_bounds = bounds;
+  m_valid = valid;
+  return true;
+}
+
+gfx::Region EditorRenderCache::validate(const gfx::Rect& rc)
+{
+  gfx::Region missing(rc & m_bounds);
+  missing.createSubtraction(missing, m_valid);
+  if (!missing.isEmpty())
+    m_valid.createUnion(m_valid, missing);
+  return missing;
+}
+
+void EditorRenderCache::invalidate()
+{
+  m_valid.clear();
+}
+
+void EditorRenderCache::invalidate(const gfx::Region& spriteRgn)
+{
+  m_valid.createSubtraction(m_valid, spriteRgn);
+}
+
+} // namespace app
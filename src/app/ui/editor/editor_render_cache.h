@@ -0,0 +1,59 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_RENDER_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_RENDER_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/ints.h"
+#include "gfx/rect.h"
+#include "gfx/region.h"
+#include "os/color_space.h"
+#include "os/surface.h"
+
+namespace app {
+
+  // Rendered pixels of the sprite (in sprite coordinates, so they can
+  // be reused when the editor is scrolled or zoomed) that are still
+  // valid to be drawn on the screen. The cache is discarded when the
+  // "stamp" (a hash of all the render parameters and sprite
+  // structure) changes, and modified areas of the sprite must be
+  // invalidated explicitly with invalidate().
+  class EditorRenderCache {
+  public:
+    // Maximum number of pixels in the cache surface.
+    static constexpr int kMaxPixels = 4096*4096;
+
+    // Prepares the cache to draw the "expose" rectangle of a sprite
+    // with the given bounds, "visible" is the visible area of the
+    // sprite in the editor (used as the cached area). Returns false
+    // if the cache cannot be used for this rectangle.
+    bool prepare(const uint64_t stamp,
+                 const gfx::Rect& spriteBounds,
+                 const gfx::Rect& visible,
+                 const gfx::Rect& expose,
+                 const os::ColorSpaceRef& colorSpace);
+
+    // Returns the part of "rc" (in sprite coordinates) that must be
+    // rendered in the surface (it's considered valid after this call).
+    gfx::Region validate(const gfx::Rect& rc);
+
+    void invalidate();
+    void invalidate(const gfx::Region& spriteRgn);
+
+    os::Surface* surface() const { return m_surface.get(); }
+    const gfx::Rect& bounds() const { return m_bounds; }
+
+  private:
+    os::SurfaceRef m_surface;
+    gfx::Rect m_bounds;         // Sprite area cached in m_surface
+    gfx::Region m_valid;        // Valid area (in sprite coordinates)
+    uint64_t m_stamp = 0;
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,141 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#define TEST_GUI
+#include "tests/app_test.h"
+
+#include "app/ui/editor/editor_render_cache.h"
+#include "gfx/color.h"
+#include "gfx/color_space.h"
+#include "os/surface.h"
+#include "os/system.h"
+
+using namespace app;
+
+namespace {
+
+os::ColorSpaceRef srgb()
+{
+  return os::instance()->makeColorSpace(gfx::ColorSpace::MakeSRGB());
+}
+
+} // anonymous namespace
+
+TEST(EditorRenderCache, ValidateOnlyOnce)
+{
+  const os::ColorSpaceRef cs = srgb();
+  const gfx::Rect sprite(0, 0, 100, 100);
+  const gfx::Rect visible(0, 0, 50, 50);
+  const gfx::Rect expose(10, 10, 20, 20);
+
+  EditorRenderCache cache;
+  ASSERT_TRUE(cache.prepare(1, sprite, visible, expose, cs));
+  ASSERT_TRUE(cache.surface() != nullptr);
+  EXPECT_TRUE(cache.bounds().contains(visible));
+  EXPECT_TRUE(sprite.contains(cache.bounds()));
+
+  gfx::Region rgn = cache.validate(expose);
+  EXPECT_EQ(expose, rgn.bounds());
+  EXPECT_EQ(1, int(rgn.size()));
+
+  // Already rendered
+  ASSERT_TRUE(cache.prepare(1, sprite, visible, expose, cs));
+  EXPECT_TRUE(cache.validate(expose).isEmpty());
+
+  // Only the new part must be rendered
+  rgn = cache.validate(gfx::Rect(10, 10, 30, 20));
+  EXPECT_EQ(gfx::Rect(30, 10, 10, 20), rgn.bounds());
+}
+
+TEST(EditorRenderCache, NewStampInvalidatesAll)
+{
+  const os::ColorSpaceRef cs = srgb();
+  const gfx::Rect sprite(0, 0, 100, 100);
+  const gfx::Rect expose(0, 0, 40, 40);
+
+  EditorRenderCache cache;
+  ASSERT_TRUE(cache.prepare(1, sprite, expose, expose, cs));
+  cache.validate(expose);
+
+  ASSERT_TRUE(cache.prepare(2, sprite, expose, expose, cs));
+  EXPECT_EQ(expose, cache.validate(expose).bounds());
+
+  // Going back to the previous stamp doesn't restore old pixels
+  ASSERT_TRUE(cache.prepare(1, sprite, expose, expose, cs));
+  EXPECT_EQ(expose, cache.validate(expose).bounds());
+}
+
+TEST(EditorRenderCache, InvalidateRegion)
+{
+  const os::ColorSpaceRef cs = srgb();
+  const gfx::Rect sprite(0, 0, 100, 100);
+  const gfx::Rect expose(0, 0, 40, 40);
+
+  EditorRenderCache cache;
+  ASSERT_TRUE(cache.prepare(1, sprite, expose, expose, cs));
+  cache.validate(expose);
+
+  cache.invalidate(gfx::Region(gfx::Rect(5, 6, 7, 8)));
+  ASSERT_TRUE(cache.prepare(1, sprite, expose, expose, cs));
+  gfx::Region rgn = cache.validate(expose);
+  EXPECT_EQ(gfx::Rect(5, 6, 7, 8), rgn.bounds());
+  EXPECT_EQ(1, int(rgn.size()));
+
+  cache.invalidate();
+  ASSERT_TRUE(cache.prepare(1, sprite, expose, expose, cs));
+  EXPECT_EQ(expose, cache.validate(expose).bounds());
+}
+
+TEST(EditorRenderCache, TooBigArea)
+{
+  const os::ColorSpaceRef cs = srgb();
+  const gfx::Rect sprite(0, 0, 8192, 8192);
+
+  EditorRenderCache cache;
+  EXPECT_FALSE(cache.prepare(1, sprite, sprite, sprite, cs));
+  EXPECT_TRUE(cache.surface() == nullptr);
+
+  // A smaller visible area can be cached
+  EXPECT_TRUE(cache.prepare(1, sprite,
+                            gfx::Rect(0, 0, 256, 256),
+                            gfx::Rect(0, 0, 256, 256), cs));
+}
+
+// When the editor is scrolled outside the cached area, a new
+// surface is created keeping the valid pixels of the old one.
+TEST(EditorRenderCache, KeepPixelsOnScroll)
+{
+  const os::ColorSpaceRef cs = srgb();
+  const gfx::Rect sprite(0, 0, 1000, 1000);
+  const gfx::Rect expose1(0, 0, 100, 100);
+  const gfx::Rect expose2(90, 90, 100, 100);
+  const gfx::Color color = gfx::rgba(255, 0, 0, 255);
+
+  EditorRenderCache cache;
+  ASSERT_TRUE(cache.prepare(1, sprite, expose1, expose1, cs));
+  ASSERT_FALSE(cache.bounds().contains(expose2));
+  cache.validate(expose1);
+
+  // "Render" the pixel (95, 95) of the sprite
+  gfx::Point origin = cache.bounds().origin();
+  cache.surface()->putPixel(color, 95 - origin.x, 95 - origin.y);
+
+  ASSERT_TRUE(cache.prepare(1, sprite, expose2, expose2, cs));
+  ASSERT_TRUE(cache.bounds().contains(expose2));
+
+  origin = cache.bounds().origin();
+  EXPECT_EQ(color, cache.surface()->getPixel(95 - origin.x, 95 - origin.y));
+
+  // Only the area that wasn't rendered before must be rendered
+  gfx::Region expected(expose2);
+  expected.createSubtraction(expected, gfx::Region(expose1));
+  const gfx::Region rgn = cache.validate(expose2);
+  gfx::Region diff;
+  diff.createSubtraction(rgn, expected);
+  EXPECT_TRUE(diff.isEmpty());
+  diff.createSubtraction(expected, rgn);
+  EXPECT_TRUE(diff.isEmpty());
+}
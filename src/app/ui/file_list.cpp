@@ -661,13 +661,19 @@ void FileList::onCurrentFolderChanged()
 
 void FileList::onMonitoringTick()
 {
+  // Thumbnails of visible items are generated first, and the ones
+  // that aren't visible anymore are cancelled.
+  const std::vector<IFileItem*> visibleItems = thumbnailItemsOnScreen();
+  ThumbnailGenerator::instance()->setVisibleItems(visibleItems);
+
   auto start = base::current_tick();
   while (!m_generateThumbnailsForTheseItems.empty() &&
          // No more than 200ms launching thumbnail generators
          base::current_tick() - start < 200) {
     auto fi = m_generateThumbnailsForTheseItems.front();
     m_generateThumbnailsForTheseItems.pop_front();
-    ThumbnailGenerator::instance()->generateThumbnail(fi);
+    if (std::find(visibleItems.begin(), visibleItems.end(), fi) != visibleItems.end())
+      ThumbnailGenerator::instance()->generateThumbnail(fi);
   }
 
   if (ThumbnailGenerator::instance()->checkWorkers())
@@ -919,6 +925,33 @@ void FileList::generateThumbnailForFileItem(IFileItem* fi)
   }
 }
 
+std::vector<IFileItem*> FileList::thumbnailItemsOnScreen()
+{
+  std::vector<IFileItem*> items;
+
+  // The selected item is the most important one
+  if (m_selected && !m_selected->isFolder())
+    items.push_back(m_selected);
+
+  // Only the selected item has a thumbnail in the list view
+  View* view = View::getView(this);
+  if (!view || !hasThumbnailsPerItem())
+    return items;
+
+  const gfx::Rect vp = view->viewportBounds();
+  for (int i=0; i<int(m_list.size()); ++i) {
+    IFileItem* fi = m_list[i];
+    if (fi == m_selected || fi->isFolder())
+      continue;
+
+    gfx::Rect itemBounds = getFileItemInfo(i).bounds;
+    itemBounds.offset(bounds().origin());
+    if (vp.intersects(itemBounds))
+      items.push_back(fi);
+  }
+  return items;
+}
+
 void FileList::delayThumbnailGenerationForSelectedItem()
 {
   if (m_selected &&
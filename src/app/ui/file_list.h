@@ -90,6 +90,8 @@ namespace app {
     int selectedIndex() const;
     void selectIndex(int index);
     void generateThumbnailForFileItem(IFileItem* fi);
+    // Items with a visible thumbnail (the selected item first)
+    std::vector<IFileItem*> thumbnailItemsOnScreen();
     void delayThumbnailGenerationForSelectedItem();
     bool hasThumbnailsPerItem() const { return m_zoom > 1.0; }
     bool isListView() const { return !hasThumbnailsPerItem(); }
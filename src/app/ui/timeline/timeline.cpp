@@ -256,9 +256,13 @@ Timeline::Timeline(TooltipManager* tooltipManager)
   , m_scroll(false)
   , m_fromTimeline(false)
   , m_aniControls(tooltipManager)
+  , m_celThumbnails(std::make_unique<thumb::CelThumbnailCache>())
 {
   enableFlags(CTRL_RIGHT_CLICK);
 
+  // Repaint when new cel thumbnails are generated
+  m_celThumbnails->ThumbnailReady.connect([this]{ invalidate(); });
+
   m_ctxConn1 = m_context->BeforeCommandExecution.connect(
     &Timeline::onBeforeCommandExecution, this);
   m_ctxConn2 = m_context->AfterCommandExecution.connect(
@@ -2485,10 +2489,12 @@ void Timeline::drawCel(ui::Graphics* g,
         skinTheme()->calcBorder(this, style));
 
     if (!thumb_bounds.isEmpty()) {
-      if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, thumb_bounds.size())) {
-        const int t = std::clamp(thumb_bounds.w/8, 4, 16);
-        draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
+      // The checkered background is the placeholder until the
+      // thumbnail is generated
+      const int t = std::clamp(thumb_bounds.w/8, 4, 16);
+      draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
 
+      if (os::SurfaceRef surface = m_celThumbnails->getCelThumbnail(cel, thumb_bounds.size())) {
         g->drawRgbaSurface(surface.get(),
                            thumb_bounds.center().x-surface->width()/2,
                            thumb_bounds.center().y-surface->height()/2);
@@ -2579,14 +2585,13 @@ void Timeline::drawCelOverlay(ui::Graphics* g)
 
   gfx::Rect rc = m_sprite->bounds().fitIn(
     gfx::Rect(m_thumbnailsOverlayBounds).shrink(1));
-  if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, rc.size())) {
-    draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
-
+  draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
+  if (os::SurfaceRef surface = m_celThumbnails->getCelThumbnail(cel, rc.size())) {
     g->drawRgbaSurface(surface.get(),
                        rc.center().x-surface->width()/2,
                        rc.center().y-surface->height()/2);
-    g->drawRect(gfx::rgba(0, 0, 0, 128), m_thumbnailsOverlayBounds);
   }
+  g->drawRect(gfx::rgba(0, 0, 0, 128), m_thumbnailsOverlayBounds);
 }
 
 void Timeline::drawCelLinkDecorators(ui::Graphics* g, const gfx::Rect& bounds,
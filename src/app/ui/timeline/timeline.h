@@ -54,6 +54,10 @@ namespace app {
     class SkinTheme;
   }
 
+  namespace thumb {
+    class CelThumbnailCache;
+  }
+
   using namespace doc;
 
   class CommandExecutionEvent;
@@ -455,6 +459,7 @@ namespace app {
     Hit m_thumbnailsOverlayHit;
     gfx::Point m_thumbnailsOverlayDirection;
     obs::connection m_thumbnailsPrefConn;
+    std::unique_ptr<thumb::CelThumbnailCache> m_celThumbnails;
 
     // Temporal data used to move the range.
     struct MoveRange {
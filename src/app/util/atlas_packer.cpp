@@ -0,0 +1,428 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/atlas_packer.h"
+
+#include "base/task.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+
+namespace app {
+
+namespace {
+
+// Height (or width) of a texture without limits
+constexpr int kUnbounded = std::numeric_limits<int>::max() / 4;
+
+// Maximum number of rectangles packed with MaxRects (each insertion
+// checks and splits all free rectangles, and there are more free
+// rectangles with each packed rectangle, so it's too slow for big
+// sprite sheets, e.g. ~1.3s for 5000 rectangles).
+constexpr int kMaxRectsLimit = 1000;
+
+bool intersects(const gfx::Rect& a, const gfx::Rect& b)
+{
+  return (a.x < b.x+b.w && b.x < a.x+a.w &&
+          a.y < b.y+b.h && b.y < a.y+a.h);
+}
+
+bool contains(const gfx::Rect& a, const gfx::Rect& b)
+{
+  return (b.x >= a.x && b.y >= a.y &&
+          b.x+b.w <= a.x+a.w &&
+          b.y+b.h <= a.y+a.h);
+}
+
+class MaxRectsBin {
+public:
+  MaxRectsBin(const gfx::Size& size) {
+    m_free.push_back(gfx::Rect(0, 0, size.w, size.h));
+  }
+
+  const gfx::Size& usedSize() const { return m_used; }
+
+  bool insert(const gfx::Size& size, gfx::Point& pos) {
+    // Best short side fit. As the bin can be unbounded (when we are
+    // looking for the best texture size), the leftover height of a
+    // free rectangle is measured only in the used area of the bin,
+    // and placements that make the used area taller are the last
+    // option.
+    bool found = false;
+    std::tuple<int, int, int, int, int> best;
+    for (const gfx::Rect& f : m_free) {
+      if (f.w < size.w || f.h < size.h)
+        continue;
+
+      const int grow = std::max(0, f.y + size.h - m_used.h);
+      const int fh = std::max(size.h, std::min(f.h, m_used.h - f.y));
+      const int lw = f.w - size.w;
+      const int lh = fh - size.h;
+      const auto score = std::make_tuple(grow,
+                                         std::min(lw, lh),
+                                         std::max(lw, lh),
+                                         f.y, f.x);
+      if (!found || score < best) {
+        best = score;
+        found = true;
+      }
+    }
+    if (!found)
+      return false;
+
+    pos.x = std::get<4>(best);
+    pos.y = std::get<3>(best);
+    const gfx::Rect used(pos.x, pos.y, size.w, size.h);
+    split(used);
+
+    m_used.w = std::max(m_used.w, used.x+used.w);
+    m_used.h = std::max(m_used.h, used.y+used.h);
+    return true;
+  }
+
+private:
+  // Splits all free rectangles that intersect the "used" area in
+  // (up to) four maximal free rectangles.
+  void split(const gfx::Rect& used) {
+    std::vector<gfx::Rect> newFree;
+    for (size_t i=0; i<m_free.size(); ) {
+      const gfx::Rect f = m_free[i];
+      if (!intersects(f, used)) {
+        ++i;
+        continue;
+      }
+
+      m_free[i] = m_free.back();
+      m_free.pop_back();
+
+      if (used.x > f.x)
+        newFree.push_back(gfx::Rect(f.x, f.y, used.x - f.x, f.h));
+      if (used.x+used.w < f.x+f.w)
+        newFree.push_back(gfx::Rect(used.x+used.w, f.y, f.x+f.w - used.x-used.w, f.h));
+      if (used.y > f.y)
+        newFree.push_back(gfx::Rect(f.x, f.y, f.w, used.y - f.y));
+      if (used.y+used.h < f.y+f.h)
+        newFree.push_back(gfx::Rect(f.x, used.y+used.h, f.w, f.y+f.h - used.y-used.h));
+    }
+
+    // Remove redundant free rectangles (contained in other ones).
+    // Old free rectangles cannot contain each other, so we have to
+    // compare the new ones with all the others only.
+    std::vector<gfx::Rect> kept;
+    kept.reserve(newFree.size());
+    for (size_t i=0; i<newFree.size(); ++i) {
+      const gfx::Rect& n = newFree[i];
+      bool redundant = false;
+      for (size_t j=0; j<newFree.size() && !redundant; ++j) {
+        if (i != j && contains(newFree[j], n) &&
+            (j < i || !contains(n, newFree[j])))
+          redundant = true;
+      }
+      for (size_t j=0; j<m_free.size() && !redundant; ++j) {
+        if (contains(m_free[j], n))
+          redundant = true;
+      }
+      if (!redundant)
+        kept.push_back(n);
+    }
+
+    m_free.erase(
+      std::remove_if(m_free.begin(), m_free.end(),
+                     [&kept](const gfx::Rect& f){
+                       for (const gfx::Rect& n : kept)
+                         if (contains(n, f))
+                           return true;
+                       return false;
+                     }),
+      m_free.end());
+    m_free.insert(m_free.end(), kept.begin(), kept.end());
+  }
+
+  std::vector<gfx::Rect> m_free;
+  gfx::Size m_used;
+};
+
+class SkylineBin {
+public:
+  SkylineBin(const gfx::Size& size) : m_size(size) {
+    m_skyline.push_back(Segment{ 0, 0, size.w });
+  }
+
+  const gfx::Size& usedSize() const { return m_used; }
+
+  bool insert(const gfx::Size& size, gfx::Point& pos) {
+    // Bottom-left: the position where the top of the rectangle is
+    // the lowest one (and then the leftmost one).
+    int bestTop = kUnbounded;
+    int bestIndex = -1;
+    for (int i=0; i<int(m_skyline.size()); ++i) {
+      const int x = m_skyline[i].x;
+      if (x + size.w > m_size.w)
+        break;
+
+      int y = 0;
+      for (int j=i, remaining=size.w; remaining > 0; ++j) {
+        y = std::max(y, m_skyline[j].y);
+        remaining -= m_skyline[j].w;
+      }
+      if (y + size.h > m_size.h)
+        continue;
+
+      if (y + size.h < bestTop) {
+        bestTop = y + size.h;
+        bestIndex = i;
+        pos.x = x;
+        pos.y = y;
+      }
+    }
+    if (bestIndex < 0)
+      return false;
+
+    // Replace the covered segments with the top of the new rectangle
+    m_skyline.insert(m_skyline.begin()+bestIndex,
+                     Segment{ pos.x, bestTop, size.w });
+    const int x2 = pos.x + size.w;
+    for (int i=bestIndex+1; i<int(m_skyline.size()); ) {
+      Segment& seg = m_skyline[i];
+      if (seg.x >= x2)
+        break;
+      if (seg.x + seg.w <= x2) {
+        m_skyline.erase(m_skyline.begin()+i);
+      }
+      else {
+        seg.w -= x2 - seg.x;
+        seg.x = x2;
+        break;
+      }
+    }
+
+    // Merge contiguous segments with the same height
+    for (int i=0; i+1<int(m_skyline.size()); ) {
+      if (m_skyline[i].y == m_skyline[i+1].y) {
+        m_skyline[i].w += m_skyline[i+1].w;
+        m_skyline.erase(m_skyline.begin()+i+1);
+      }
+      else
+        ++i;
+    }
+
+    m_used.w = std::max(m_used.w, x2);
+    m_used.h = std::max(m_used.h, bestTop);
+    return true;
+  }
+
+private:
+  struct Segment {
+    int x, y, w;
+  };
+
+  gfx::Size m_size;
+  std::vector<Segment> m_skyline;
+  gfx::Size m_used;
+};
+
+} // anonymous namespace
+
+AtlasPacker::AtlasPacker(const Algorithm algorithm,
+                         const int borderPadding,
+                         const int shapePadding)
+  : m_algorithm(algorithm)
+  , m_borderPadding(borderPadding)
+  , m_shapePadding(shapePadding)
+{
+}
+
+void AtlasPacker::add(const gfx::Size& size)
+{
+  m_rects.push_back(gfx::Rect(0, 0, size.w, size.h));
+  m_order.clear();
+}
+
+gfx::Size AtlasPacker::bestFit(base::task_token& token,
+                               const int fixedWidth,
+                               const int fixedHeight)
+{
+  if (fixedWidth > 0 && fixedHeight > 0) {
+    const gfx::Size size(fixedWidth, fixedHeight);
+    pack(size, token);
+    return size;
+  }
+
+  sortRects();
+
+  int64_t area = 0;
+  int maxW = 0;
+  for (const gfx::Rect& rc : m_rects) {
+    area += int64_t(rc.w + m_shapePadding) * (rc.h + m_shapePadding);
+    maxW = std::max(maxW, rc.w + m_shapePadding);
+  }
+
+  bool found = false;
+  gfx::Size bestSize;
+  Rects bestRects;
+
+  auto tryBin = [&](const gfx::Size& bin) {
+    gfx::Size used;
+    if (!packBin(bin, used))
+      return;
+
+    gfx::Size size = textureSize(used);
+    size.w = std::max(size.w, fixedWidth);
+    size.h = std::max(size.h, fixedHeight);
+
+    // Smallest area, and then the most squared texture
+    if (!found ||
+        std::make_tuple(int64_t(size.w) * size.h, std::max(size.w, size.h)) <
+        std::make_tuple(int64_t(bestSize.w) * bestSize.h, std::max(bestSize.w, bestSize.h))) {
+      found = true;
+      bestSize = size;
+      bestRects = m_rects;
+    }
+  };
+
+  if (fixedWidth > 0) {
+    tryBin(gfx::Size(binSize(gfx::Size(fixedWidth, 0)).w, kUnbounded));
+  }
+  else if (fixedHeight > 0) {
+    // Try wider textures until all rectangles fit
+    const int binH = binSize(gfx::Size(0, fixedHeight)).h;
+    int w = int(std::max<int64_t>(maxW, area / std::max(1, binH)));
+    for (int i=0; i<16 && !found && !token.canceled(); ++i) {
+      token.set_progress(float(i) / 16);
+      tryBin(gfx::Size(w, binH));
+      w += std::max(1, w/8);
+    }
+  }
+  else {
+    // Try a few widths around the side of a squared texture with
+    // the same area of all rectangles
+    const double side = std::ceil(std::sqrt(double(area)));
+    const double factors[] = { 0.75, 0.875, 1.0, 1.125, 1.25, 1.5, 2.0 };
+    const int n = int(sizeof(factors) / sizeof(factors[0]));
+    int oldW = 0;
+    for (int i=0; i<n; ++i) {
+      if (token.canceled())
+        return gfx::Size(0, 0);
+      token.set_progress(float(i) / n);
+
+      const int w = std::max(maxW, int(side * factors[i]));
+      if (w != oldW)
+        tryBin(gfx::Size(w, kUnbounded));
+      oldW = w;
+    }
+  }
+
+  // Fixed height too small for some rectangles, we ignore it
+  if (!found && !token.canceled())
+    tryBin(gfx::Size(std::max(maxW, int(std::ceil(std::sqrt(double(area))))),
+                     kUnbounded));
+  if (!found)
+    return gfx::Size(0, 0);
+
+  m_rects = bestRects;
+  return bestSize;
+}
+
+bool AtlasPacker::pack(const gfx::Size& textureSize,
+                       base::task_token& token)
+{
+  if (token.canceled())
+    return false;
+
+  sortRects();
+
+  gfx::Size used;
+  return packBin(binSize(textureSize), used);
+}
+
+bool AtlasPacker::packBin(const gfx::Size& binSize,
+                          gfx::Size& usedSize)
+{
+  bool all = true;
+
+  auto place = [&](auto& bin) {
+    for (const int i : m_order) {
+      gfx::Rect& rc = m_rects[i];
+      gfx::Point pos;
+      if (bin.insert(gfx::Size(rc.w + m_shapePadding,
+                               rc.h + m_shapePadding), pos)) {
+        rc.x = pos.x + m_borderPadding;
+        rc.y = pos.y + m_borderPadding;
+      }
+      else
+        all = false;
+    }
+    usedSize = bin.usedSize();
+  };
+
+  switch (binAlgorithm()) {
+    case Algorithm::MaxRects: {
+      MaxRectsBin bin(binSize);
+      place(bin);
+      break;
+    }
+    case Algorithm::Skyline: {
+      SkylineBin bin(binSize);
+      place(bin);
+      break;
+    }
+  }
+  return all;
+}
+
+void AtlasPacker::sortRects()
+{
+  if (m_order.size() == m_rects.size())
+    return;
+
+  m_order.resize(m_rects.size());
+  for (int i=0; i<int(m_order.size()); ++i)
+    m_order[i] = i;
+
+  // Bigger rectangles first. The index is the last criteria to get
+  // the same order (and placement) on all platforms.
+  const Algorithm algorithm = binAlgorithm();
+  auto key = [this, algorithm](const int i) {
+    const gfx::Rect& rc = m_rects[i];
+    if (algorithm == Algorithm::Skyline)
+      return std::make_tuple(-rc.h, -rc.w, i);
+    return std::make_tuple(-std::max(rc.w, rc.h), -std::min(rc.w, rc.h), i);
+  };
+  std::sort(m_order.begin(), m_order.end(),
+            [&key](const int a, const int b){ return key(a) < key(b); });
+}
+
+AtlasPacker::Algorithm AtlasPacker::binAlgorithm() const
+{
+  if (m_algorithm == Algorithm::MaxRects &&
+      int(m_rects.size()) > kMaxRectsLimit)
+    return Algorithm::Skyline;
+  return m_algorithm;
+}
+
+gfx::Size AtlasPacker::binSize(const gfx::Size& textureSize) const
+{
+  // The shape padding is added to each rectangle, so the last
+  // rectangle of each row/column can use that extra space.
+  return gfx::Size(textureSize.w - 2*m_borderPadding + m_shapePadding,
+                   textureSize.h - 2*m_borderPadding + m_shapePadding);
+}
+
+gfx::Size AtlasPacker::textureSize(const gfx::Size& usedSize) const
+{
+  return gfx::Size(
+    std::max(0, usedSize.w - m_shapePadding) + 2*m_borderPadding,
+    std::max(0, usedSize.h - m_shapePadding) + 2*m_borderPadding);
+}
+
+} // namespace app
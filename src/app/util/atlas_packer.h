@@ -0,0 +1,98 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_ATLAS_PACKER_H_INCLUDED
+#define APP_UTIL_ATLAS_PACKER_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <vector>
+
+namespace base {
+  class task_token;
+}
+
+namespace app {
+
+  // Packs rectangles (without rotating them) in one texture. It's like gfx::PackingRects, but instead of trying a
+  // lot of texture sizes, each pack() is just one pass over the
+  // rectangles sorted by size, and bestFit() tries a few widths only.
+  //
+  // The placement is deterministic: the same list of sizes always
+  // generates the same bounds.
+  class AtlasPacker {
+  public:
+    enum class Algorithm {
+      // Keeps a list of maximal free rectangles and places each
+      // rectangle in the free area where the shorter leftover side is
+      // minimal (best short side fit). Generates tighter atlases,
+      // but it's too slow for a lot of rectangles, so Skyline is
+      // used when there are more than 1000 rectangles.
+      MaxRects,
+      // Keeps only the top edge (skyline) of the packed rectangles
+      // and places each rectangle in its lowest position. Faster but
+      // wastes more space.
+      Skyline,
+    };
+
+    typedef std::vector<gfx::Rect> Rects;
+    typedef Rects::const_iterator const_iterator;
+
+    AtlasPacker(const Algorithm algorithm,
+                const int borderPadding = 0,
+                const int shapePadding = 0);
+
+    bool empty() const { return m_rects.empty(); }
+    int size() const { return int(m_rects.size()); }
+    void add(const gfx::Size& size);
+
+    // Bounds of each added rectangle (in the same order they were
+    // added) after pack() or bestFit().
+    const gfx::Rect& operator[](const int i) const { return m_rects[i]; }
+    const_iterator begin() const { return m_rects.begin(); }
+    const_iterator end() const { return m_rects.end(); }
+
+    // Finds a texture size to pack all rectangles.
+    // If fixedWidth or fixedHeight are > 0, the width or height of
+    // the texture is fixed to that value.
+    gfx::Size bestFit(base::task_token& token,
+                      const int fixedWidth = 0,
+                      const int fixedHeight = 0);
+
+    // Packs all rectangles in a texture of the given size. Returns
+    // false if some rectangle didn't fit.
+    bool pack(const gfx::Size& textureSize,
+              base::task_token& token);
+
+  private:
+    // Packs all rectangles in a bin (texture without the border
+    // padding) of the given size. Returns false if some rectangle
+    // didn't fit, and the used area of the bin in "usedSize".
+    bool packBin(const gfx::Size& binSize,
+                 gfx::Size& usedSize);
+
+    // Sorts the rectangles in packing order (m_order)
+    void sortRects();
+
+    // Algorithm used to pack the current rectangles
+    Algorithm binAlgorithm() const;
+
+    gfx::Size binSize(const gfx::Size& textureSize) const;
+    gfx::Size textureSize(const gfx::Size& usedSize) const;
+
+    Algorithm m_algorithm;
+    int m_borderPadding;
+    int m_shapePadding;
+    Rects m_rects;
+    // Indexes of m_rects sorted in packing order
+    std::vector<int> m_order;
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,118 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/util/atlas_packer.h"
+#include "base/task.h"
+
+#include <cstdlib>
+
+using namespace app;
+
+static void expect_valid_packing(const AtlasPacker& packer,
+                                 const gfx::Size& textureSize,
+                                 const int borderPadding,
+                                 const int shapePadding)
+{
+  for (int i=0; i<packer.size(); ++i) {
+    const gfx::Rect& a = packer[i];
+    EXPECT_GE(a.x, borderPadding);
+    EXPECT_GE(a.y, borderPadding);
+    EXPECT_LE(a.x+a.w, textureSize.w-borderPadding);
+    EXPECT_LE(a.y+a.h, textureSize.h-borderPadding);
+
+    for (int j=i+1; j<packer.size(); ++j) {
+      // Rectangles cannot overlap (including the shape padding)
+      const gfx::Rect& b = packer[j];
+      EXPECT_FALSE(a.x < b.x+b.w+shapePadding && b.x < a.x+a.w+shapePadding &&
+                   a.y < b.y+b.h+shapePadding && b.y < a.y+a.h+shapePadding)
+        << "rects " << i << " and " << j << " overlap";
+    }
+  }
+}
+
+TEST(AtlasPacker, BestFit)
+{
+  for (auto algorithm : { AtlasPacker::Algorithm::MaxRects,
+                          AtlasPacker::Algorithm::Skyline }) {
+    std::srand(1);
+    AtlasPacker packer(algorithm, 2, 1);
+    int area = 0;
+    for (int i=0; i<500; ++i) {
+      const gfx::Size size(1 + std::rand() % 40, 1 + std::rand() % 40);
+      packer.add(size);
+      area += size.w * size.h;
+    }
+
+    base::task_token token;
+    const gfx::Size size = packer.bestFit(token);
+    EXPECT_GE(size.w * size.h, area);
+    expect_valid_packing(packer, size, 2, 1);
+
+    // The placement is deterministic
+    AtlasPacker packer2(algorithm, 2, 1);
+    for (const gfx::Rect& rc : packer)
+      packer2.add(gfx::Size(rc.w, rc.h));
+    EXPECT_EQ(size, packer2.bestFit(token));
+    for (int i=0; i<packer.size(); ++i) {
+      EXPECT_EQ(packer[i].x, packer2[i].x);
+      EXPECT_EQ(packer[i].y, packer2[i].y);
+    }
+  }
+}
+
+TEST(AtlasPacker, FixedWidth)
+{
+  AtlasPacker packer(AtlasPacker::Algorithm::MaxRects);
+  for (int i=0; i<16; ++i)
+    packer.add(gfx::Size(8, 8));
+
+  base::task_token token;
+  EXPECT_EQ(gfx::Size(32, 32), packer.bestFit(token, 32, 0));
+  EXPECT_EQ(gfx::Size(64, 16), packer.bestFit(token, 0, 16));
+  expect_valid_packing(packer, gfx::Size(64, 16), 0, 0);
+}
+
+TEST(AtlasPacker, FixedSize)
+{
+  for (auto algorithm : { AtlasPacker::Algorithm::MaxRects,
+                          AtlasPacker::Algorithm::Skyline }) {
+    AtlasPacker packer(algorithm, 1, 2);
+    for (int i=0; i<4; ++i)
+      packer.add(gfx::Size(10, 10));
+
+    // 2x2 rectangles
+    const gfx::Size textureSize(2*10 + 2 + 2*1, 2*10 + 2 + 2*1);
+    base::task_token token;
+    EXPECT_TRUE(packer.pack(textureSize, token));
+    expect_valid_packing(packer, textureSize, 1, 2);
+
+    packer.add(gfx::Size(10, 10));
+    EXPECT_FALSE(packer.pack(textureSize, token));
+  }
+}
+
+// A lot of rectangles are packed with Skyline (MaxRects is too slow)
+TEST(AtlasPacker, ManyRects)
+{
+  std::srand(2);
+  AtlasPacker maxRects(AtlasPacker::Algorithm::MaxRects, 0, 1);
+  AtlasPacker skyline(AtlasPacker::Algorithm::Skyline, 0, 1);
+  for (int i=0; i<5000; ++i) {
+    const gfx::Size size(1 + std::rand() % 40, 1 + std::rand() % 40);
+    maxRects.add(size);
+    skyline.add(size);
+  }
+
+  base::task_token token;
+  const gfx::Size size = maxRects.bestFit(token);
+  EXPECT_EQ(size, skyline.bestFit(token));
+  for (int i=0; i<maxRects.size(); ++i) {
+    EXPECT_EQ(maxRects[i].x, skyline[i].x);
+    EXPECT_EQ(maxRects[i].y, skyline[i].y);
+  }
+}
@@ -0,0 +1,172 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/doc_snapshot.h"
+
+#include "app/doc.h"
+#include "base/debug.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <map>
+#include <memory>
+
+namespace app {
+
+using namespace doc;
+
+static void copy_cels(const LayerImage* srcLayer, LayerImage* dstLayer)
+{
+  // Copied cel data (to keep linked cels linked in the snapshot)
+  std::map<const CelData*, CelDataRef> copies;
+
+  for (auto it=srcLayer->getCelBegin(), end=srcLayer->getCelEnd(); it!=end; ++it) {
+    const Cel* srcCel = *it;
+    const CelData* srcData = srcCel->data();
+
+    CelDataRef data;
+    auto copy = copies.find(srcData);
+    if (copy != copies.end()) {
+      data = copy->second;
+    }
+    else {
+      data = std::make_shared<CelData>(
+        ImageRef(Image::createCopy(srcData->image())));
+      data->setOpacity(srcData->opacity());
+      if (srcData->hasBoundsF())
+        data->setBoundsF(srcData->boundsF());
+      else
+        data->setBounds(srcData->bounds());
+      data->setUserData(srcData->userData());
+      copies[srcData] = data;
+    }
+
+    auto cel = std::make_unique<Cel>(srcCel->frame(), data);
+    cel->setZIndex(srcCel->zIndex());
+    dstLayer->addCel(cel.release());
+  }
+}
+
+static Layer* copy_layer(const Layer* srcLayer, Sprite* dstSprite)
+{
+  std::unique_ptr<Layer> dstLayer;
+
+  switch (srcLayer->type()) {
+
+    case ObjectType::LayerImage:
+    case ObjectType::LayerTilemap: {
+      auto srcImgLayer = static_cast<const LayerImage*>(srcLayer);
+      LayerImage* dstImgLayer;
+      if (srcLayer->isTilemap()) {
+        dstImgLayer = new LayerTilemap(
+          dstSprite,
+          static_cast<const LayerTilemap*>(srcLayer)->tilesetIndex());
+      }
+      else {
+        dstImgLayer = new LayerImage(dstSprite);
+      }
+      dstLayer.reset(dstImgLayer);
+      dstImgLayer->setBlendMode(srcImgLayer->blendMode());
+      dstImgLayer->setOpacity(srcImgLayer->opacity());
+      copy_cels(srcImgLayer, dstImgLayer);
+      break;
+    }
+
+    case ObjectType::LayerGroup: {
+      auto dstGroup = new LayerGroup(dstSprite);
+      dstLayer.reset(dstGroup);
+      for (const Layer* child : static_cast<const LayerGroup*>(srcLayer)->layers())
+        dstGroup->addLayer(copy_layer(child, dstSprite));
+      break;
+    }
+
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+
+  dstLayer->setName(srcLayer->name());
+  dstLayer->setFlags(srcLayer->flags());
+  dstLayer->setUserData(srcLayer->userData());
+  return dstLayer.release();
+}
+
+static Tileset* copy_tileset(const Tileset* srcTileset, Sprite* dstSprite)
+{
+  auto tileset = std::make_unique<Tileset>(dstSprite,
+                                           srcTileset->grid(),
+                                           srcTileset->size());
+  tileset->setName(srcTileset->name());
+  tileset->setUserData(srcTileset->userData());
+  tileset->setBaseIndex(srcTileset->baseIndex());
+  tileset->setMatchFlags(srcTileset->matchFlags());
+  tileset->setExternal(srcTileset->externalFilename(),
+                       srcTileset->externalTileset());
+  for (tile_index ti=0; ti<srcTileset->size(); ++ti) {
+    tileset->set(ti, ImageRef(Image::createCopy(srcTileset->get(ti).get())));
+    tileset->setTileData(ti, srcTileset->getTileData(ti));
+  }
+  return tileset.release();
+}
+
+Doc* make_doc_snapshot(const Doc* doc)
+{
+  const Sprite* srcSprite = doc->sprite();
+  auto sprite = std::make_unique<Sprite>(
+    srcSprite->spec(),
+    srcSprite->palette(frame_t(0))->size());
+
+  sprite->setPixelRatio(srcSprite->pixelRatio());
+  sprite->setGridBounds(srcSprite->gridBounds());
+  sprite->setUserData(srcSprite->userData());
+  sprite->setTileManagementPlugin(srcSprite->tileManagementPlugin());
+
+  sprite->setTotalFrames(srcSprite->totalFrames());
+  for (frame_t frame=0; frame<srcSprite->totalFrames(); ++frame)
+    sprite->setFrameDuration(frame, srcSprite->frameDuration(frame));
+
+  for (const Palette* palette : srcSprite->getPalettes())
+    sprite->setPalette(palette, true);
+
+  for (const Tag* tag : srcSprite->tags())
+    sprite->tags().add(new Tag(*tag));
+
+  for (const Slice* slice : srcSprite->slices())
+    sprite->slices().add(new Slice(*slice));
+
+  // Tilesets must be copied before tilemap layers
+  if (srcSprite->hasTilesets()) {
+    for (const Tileset* tileset : *srcSprite->tilesets()) {
+      sprite->tilesets()->add(
+        tileset ? copy_tileset(tileset, sprite.get()): nullptr);
+    }
+  }
+
+  for (const Layer* layer : srcSprite->root()->layers())
+    sprite->root()->addLayer(copy_layer(layer, sprite.get()));
+
+  auto snapshot = std::make_unique<Doc>(sprite.get());
+  sprite.release();
+
+  snapshot->setFilename(doc->filename());
+  snapshot->setFormatOptions(doc->formatOptions());
+  return snapshot.release();
+}
+
+} // namespace app
@@ -0,0 +1,25 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_DOC_SNAPSHOT_H_INCLUDED
+#define APP_UTIL_DOC_SNAPSHOT_H_INCLUDED
+#pragma once
+
+namespace app {
+  class Doc;
+
+  // Creates a copy of the document (with copies of all its images)
+  // that can be saved in a background thread while the original
+  // document is modified. Unlike Doc::duplicate(), the copy keeps
+  // everything that can be saved in a file (layer visibility, tilemaps
+  // and tilesets, user data, cel precise bounds, grid, pixel ratio,
+  // format options, etc.). The new document isn't added to any
+  // context.
+  Doc* make_doc_snapshot(const Doc* doc);
+
+} // namespace app
+
+#endif
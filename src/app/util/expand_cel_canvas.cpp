@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -639,6 +639,8 @@ void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
     rgnToValidate.offset(-m_bounds.origin());
   rgnToValidate.createSubtraction(rgnToValidate, m_validDstRegion);
   rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_dstImage->bounds()));
+  if (rgnToValidate.isEmpty())
+    return;
 
   // ASSERT(src);                  // TODO is it always true?
   if (src) {
@@ -662,6 +664,12 @@ void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
   }
 
   m_validDstRegion.createUnion(m_validDstRegion, rgnToValidate);
+
+  // The destination canvas can be the cel image during the whole
+  // stroke, so we change its version when its pixels are copied or
+  // cleared to invalidate data cached from its previous pixels
+  // (e.g. cel thumbnails).
+  m_dstImage->incrementVersion();
 }
 
 void ExpandCelCanvas::validateDestTileset(const gfx::Region& rgn, const gfx::Region& forceRgn)
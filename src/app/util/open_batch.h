@@ -21,12 +21,18 @@ namespace app {
   public:
     void open(Context* ctx,
               const std::string& fn,
-              const bool oneFrame) {
+              const bool oneFrame,
+              const bool metadataOnly = false) {
       Params params;
       params.set("filename", fn.c_str());
 
+      if (metadataOnly)
+        params.set("metadataonly", "true");
+
       if (oneFrame)
         params.set("oneframe", "true");
+      else if (metadataOnly)
+        params.set("sequence", "skip");
       else {
         switch (m_lastDecision) {
           case gen::SequenceDecision::ASK:
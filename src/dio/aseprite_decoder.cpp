@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -93,6 +93,9 @@ bool AsepriteDecoder::decode()
   int current_level = -1;
   AsepriteExternalFiles extFiles;
 
+  // Skip cels (and tiles) pixels?
+  const bool metadataOnly = delegate()->decodeMetadataOnly();
+
   // Just one frame?
   doc::frame_t nframes = sprite->totalFrames();
   if (nframes > 1 && delegate()->decodeOneFrame())
@@ -170,6 +173,13 @@ bool AsepriteDecoder::decode()
           }
 
           case ASE_FILE_CHUNK_CEL: {
+            // Cels aren't created at all (their user data is ignored)
+            if (metadataOnly) {
+              last_cel = nullptr;
+              last_object_with_user_data = nullptr;
+              break;
+            }
+
             doc::Cel* cel =
               readCelChunk(sprite.get(), frame,
                            sprite->pixelFormat(), &header,
@@ -286,7 +296,8 @@ bool AsepriteDecoder::decode()
           }
 
           case ASE_FILE_CHUNK_TILESET: {
-            doc::Tileset* tileset = readTilesetChunk(sprite.get(), &header, extFiles);
+            doc::Tileset* tileset = readTilesetChunk(sprite.get(), &header, extFiles,
+                                                     metadataOnly);
             if (tileset)
               last_object_with_user_data = tileset;
             break;
@@ -656,14 +667,25 @@ void read_raw_image_templ(FileInterface* f,
                           const AsepriteHeader* header)
 {
   PixelIO<ImageTraits> pixel_io;
-  int x, y;
-  int w = image->width();
-  int h = image->height();
-
-  for (y=0; y<h; ++y) {
-    for (x=0; x<w; ++x) {
-      doc::put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
+  const int w = image->width();
+  const int h = image->height();
+  const int widthBytes = image->widthBytes();
+  std::vector<uint8_t> scanline;
+
+  for (int y=0; y<h; ++y) {
+    const uint8_t* src = f->readSpan(widthBytes);
+    if (!src) {
+      // Copy the bytes as the file doesn't support spans (or we are
+      // reading an incomplete scanline, missing bytes are zeros)
+      scanline.resize(widthBytes);
+      std::fill(scanline.begin(), scanline.end(), 0);
+      f->readBytes(&scanline[0], widthBytes);
+      src = &scanline[0];
     }
+    pixel_io.read_scanline(
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+      w, src);
+
     delegate->progress((float)f->tell() / (float)header->size);
   }
 }
@@ -700,6 +722,14 @@ void read_raw_image(FileInterface* f,
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// Returns true if the pixels are stored in memory with the same byte
+// order used in .aseprite files (little endian).
+bool same_layout_in_memory()
+{
+  const uint32_t value = doc::rgba(1, 2, 3, 4);
+  return (*(const uint8_t*)&value == 1);
+}
+
 template<typename ImageTraits>
 void read_compressed_image_templ(FileInterface* f,
                                  DecodeDelegate* delegate,
@@ -718,82 +748,93 @@ void read_compressed_image_templ(FileInterface* f,
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
   const int width = image->width();
+  const int height = image->height();
   const int widthBytes = image->widthBytes();
-  std::vector<uint8_t> scanline(widthBytes);
+
+  // If the image pixels have the same layout in memory than in the
+  // file, we can inflate the data directly in the image rows.
+  // In other case we use a scanline buffer to convert the pixels.
+  const bool direct = same_layout_in_memory();
+  std::vector<uint8_t> scanline(direct ? 0: widthBytes);
   std::vector<uint8_t> compressed(4096);
-  std::vector<uint8_t> uncompressed(4096);
   int scanline_offset = 0;
   int y = 0;
 
-  while (true) {
-    size_t input_bytes;
+  while (y < height) {
+    // Memory-mapped files can be inflated directly from the mapped
+    // bytes (the whole chunk at once, without copying it).
+    const uint8_t* input = nullptr;
+    size_t bytes_read = 0;
+    if (f->tell() < chunk_end) {
+      bytes_read = chunk_end - f->tell();
+      input = f->readSpan(bytes_read);
+    }
 
-    if (f->tell()+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - f->tell(); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
+    if (!input) {
+      size_t input_bytes;
 
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else {
-      input_bytes = compressed.size();
-    }
+      if (f->tell()+compressed.size() > chunk_end) {
+        input_bytes = chunk_end - f->tell(); // Remaining bytes
+        ASSERT(input_bytes < compressed.size());
 
-    size_t bytes_read = f->readBytes(&compressed[0], input_bytes);
+        if (input_bytes == 0)
+          break;                // Done, we consumed all chunk
+      }
+      else {
+        input_bytes = compressed.size();
+      }
 
-    // Error reading "input_bytes" bytes, broken file? chunk without
-    // enough compressed data?
-    if (bytes_read == 0) {
-      delegate->error(
-        fmt::format("Error reading {} bytes of compressed data",
-                    input_bytes));
-      break;
+      bytes_read = f->readBytes(&compressed[0], input_bytes);
+
+      // Error reading "input_bytes" bytes, broken file? chunk without
+      // enough compressed data?
+      if (bytes_read == 0) {
+        delegate->error(
+          fmt::format("Error reading {} bytes of compressed data",
+                      input_bytes));
+        break;
+      }
+      input = &compressed[0];
     }
 
-    zstream.next_in = (Bytef*)&compressed[0];
+    zstream.next_in = (Bytef*)input;
     zstream.avail_in = bytes_read;
 
-    do {
-      zstream.next_out = (Bytef*)&uncompressed[0];
-      zstream.avail_out = uncompressed.size();
+    while (y < height) {
+      uint8_t* row = (direct ? image->getPixelAddress(0, y): &scanline[0]);
+      zstream.next_out = (Bytef*)(row + scanline_offset);
+      zstream.avail_out = widthBytes - scanline_offset;
 
       err = inflate(&zstream, Z_NO_FLUSH);
       if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
         throw base::Exception("ZLib error %d in inflate().", err);
 
-      size_t uncompressed_bytes = uncompressed.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        int i = 0;
-        while (y < image->height()) {
-          int n = std::min(uncompressed_bytes, scanline.size() - scanline_offset);
-          if (n > 0) {
-            // Fill the scanline buffer until it's completed
-            std::copy(uncompressed.begin()+i,
-                      uncompressed.begin()+i+n,
-                      scanline.begin()+scanline_offset);
-            uncompressed_bytes -= n;
-            scanline_offset += n;
-            i += n;
-          }
-          else if (scanline_offset < widthBytes) {
-            // The scanline is not filled yet.
-            break;
-          }
-          else {
-            // Copy the whole scanline to the image
-            pixel_io.read_scanline(
-              (typename ImageTraits::address_t)image->getPixelAddress(0, y),
-              width, &scanline[0]);
-            ++y;
-            scanline_offset = 0;
-            if (uncompressed_bytes == 0)
-              break;
-          }
-        }
+      scanline_offset = widthBytes - zstream.avail_out;
+      if (scanline_offset < widthBytes) {
+        // The scanline is not filled yet, we need more input data
+        // (or the stream is finished).
+        break;
       }
-    } while (zstream.avail_in != 0 && zstream.avail_out == 0);
+
+      // Convert the whole scanline to the image pixel format
+      if (!direct) {
+        pixel_io.read_scanline(
+          (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+          width, &scanline[0]);
+      }
+      ++y;
+      scanline_offset = 0;
+
+      // Here we continue inflating even if avail_in is 0, as zlib
+      // could have pending output from the already consumed input.
+      if (err == Z_STREAM_END)
+        break;
+    }
 
     delegate->progress((float)f->tell() / (float)header->size);
+
+    if (err == Z_STREAM_END)
+      break;
   }
 
   err = inflateEnd(&zstream);
@@ -1266,7 +1307,8 @@ doc::Slice* AsepriteDecoder::readSliceChunk(doc::Slices& slices)
 doc::Tileset* AsepriteDecoder::readTilesetChunk(
   doc::Sprite* sprite,
   const AsepriteHeader* header,
-  const AsepriteExternalFiles& extFiles)
+  const AsepriteExternalFiles& extFiles,
+  const bool metadataOnly)
 {
   const doc::tileset_index id = read32();
   const uint32_t flags = read32();
@@ -1306,7 +1348,8 @@ doc::Tileset* AsepriteDecoder::readTilesetChunk(
   }
 
   if (flags & ASE_TILESET_FLAG_EMBEDDED) {
-    if (ntiles > 0) {
+    // Keep the empty tiles created in the Tileset constructor
+    if (ntiles > 0 && !metadataOnly) {
       const size_t dataSize = read32(); // Size of compressed data
       const size_t dataBeg = f()->tell();
       const size_t dataEnd = dataBeg+dataSize;
@@ -68,7 +68,8 @@ private:
                          const AsepriteExternalFiles& extFiles);
   doc::Tileset* readTilesetChunk(doc::Sprite* sprite,
                                  const AsepriteHeader* header,
-                                 const AsepriteExternalFiles& extFiles);
+                                 const AsepriteExternalFiles& extFiles,
+                                 const bool metadataOnly);
   void readPropertiesMaps(doc::UserData::PropertiesMaps& propertiesMaps,
                           const AsepriteExternalFiles& extFiles);
   const doc::UserData::Variant readPropertyValue(uint16_t type);
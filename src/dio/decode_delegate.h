@@ -38,6 +38,11 @@ public:
   // to generate a thumbnail)
   virtual bool decodeOneFrame() { return false; }
 
+  // Return true if you want to read just the sprite structure and
+  // metadata (layers, tags, slices, user data, etc.) without the
+  // pixels of cels and tiles (e.g. to list layers or tags).
+  virtual bool decodeMetadataOnly() { return false; }
+
   // Default color for slices without user data
   virtual doc::color_t defaultSliceColor() {
     return doc::rgba(0, 0, 255, 255);
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -35,6 +35,9 @@ uint8_t Decoder::read8()
 
 uint16_t Decoder::read16()
 {
+  if (const uint8_t* p = m_f->readSpan(2))
+    return ((p[1] << 8) | p[0]); // Little endian
+
   int b1 = m_f->read8();
   int b2 = m_f->read8();
 
@@ -47,6 +50,11 @@ uint16_t Decoder::read16()
 
 uint32_t Decoder::read32()
 {
+  if (const uint8_t* p = m_f->readSpan(4)) {
+    // Little endian
+    return ((uint32_t(p[3]) << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
+  }
+
   int b1 = m_f->read8();
   int b2 = m_f->read8();
   int b3 = m_f->read8();
@@ -62,6 +70,14 @@ uint32_t Decoder::read32()
 
 uint64_t Decoder::read64()
 {
+  if (const uint8_t* p = m_f->readSpan(8)) {
+    // Little endian
+    uint64_t value = 0;
+    for (int i=7; i>=0; --i)
+      value = (value << 8) | p[i];
+    return value;
+  }
+
   int b1 = m_f->read8();
   int b2 = m_f->read8();
   int b3 = m_f->read8();
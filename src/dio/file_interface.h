@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +12,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace dio {
 
@@ -31,6 +33,13 @@ public:
   virtual uint8_t read8() = 0;
   virtual size_t readBytes(uint8_t* buf, size_t n) = 0;
 
+  // Returns a pointer to the next "n" bytes of the file (and skips
+  // them) without copying them. Returns nullptr if the file doesn't
+  // support this or there are not enough bytes, in that case the
+  // position is not modified and the bytes must be read with
+  // readBytes().
+  virtual const uint8_t* readSpan(size_t n) { return nullptr; }
+
   // Writes one byte in the file (or do nothing if ok() = false)
   virtual void write8(uint8_t value) = 0;
 
@@ -50,6 +59,32 @@ private:
   bool m_ok;
 };
 
+// Maps the whole file in memory on Windows (or reads it completely in
+// other platforms, or if it cannot be mapped) to read spans of bytes
+// without copying them. It starts reading from the current position
+// of the given FILE, but it doesn't modify that position. It's
+// read-only, write8() just fails.
+class MappedFileInterface : public FileInterface {
+public:
+  MappedFileInterface(FILE* file);
+  ~MappedFileInterface();
+  size_t size() const { return m_size; }
+  bool ok() const override;
+  size_t tell() override;
+  void seek(size_t absPos) override;
+  uint8_t read8() override;
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  const uint8_t* readSpan(size_t n) override;
+  void write8(uint8_t value) override;
+private:
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_pos = 0;
+  bool m_ok = true;
+  void* m_mapping = nullptr;
+  std::vector<uint8_t> m_buffer; // When the file cannot be mapped
+};
+
 } // namespace dio
 
 #endif
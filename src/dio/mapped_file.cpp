@@ -0,0 +1,128 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "dio/file_interface.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <io.h>
+#endif
+
+namespace dio {
+
+MappedFileInterface::MappedFileInterface(FILE* file)
+{
+  const long pos = ftell(file);
+
+  // The file is mapped only on Windows, where a mapped file cannot be
+  // truncated by other process. On POSIX systems the truncation of a
+  // mapped file generates a SIGBUS when we read its last pages (e.g.
+  // a file that is being saved while we generate its thumbnail), so
+  // the file is read in memory.
+#ifdef _WIN32
+  HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+  LARGE_INTEGER size;
+  if (handle != INVALID_HANDLE_VALUE &&
+      GetFileSizeEx(handle, &size) &&
+      size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    if (mapping) {
+      void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      if (data) {
+        m_data = (const uint8_t*)data;
+        m_size = size_t(size.QuadPart);
+        m_mapping = mapping;
+      }
+      else
+        CloseHandle(mapping);
+    }
+  }
+#endif
+
+  // Read the whole file in memory if it cannot be mapped
+  if (!m_mapping) {
+    if (fseek(file, 0, SEEK_END) == 0) {
+      const long size = ftell(file);
+      if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        m_buffer.resize(size);
+        m_buffer.resize(fread(m_buffer.data(), 1, size, file));
+      }
+    }
+    fseek(file, pos, SEEK_SET);
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+  }
+
+  m_pos = (pos > 0 ? std::min<size_t>(pos, m_size): 0);
+}
+
+MappedFileInterface::~MappedFileInterface()
+{
+  if (m_mapping) {
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle((HANDLE)m_mapping);
+#endif
+  }
+}
+
+bool MappedFileInterface::ok() const
+{
+  return m_ok;
+}
+
+size_t MappedFileInterface::tell()
+{
+  return m_pos;
+}
+
+void MappedFileInterface::seek(size_t absPos)
+{
+  m_pos = std::min<size_t>(absPos, m_size);
+}
+
+uint8_t MappedFileInterface::read8()
+{
+  if (m_pos < m_size)
+    return m_data[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
+size_t MappedFileInterface::readBytes(uint8_t* buf, size_t n)
+{
+  const size_t n2 = std::min<size_t>(n, m_size - m_pos);
+  if (n2 > 0) {
+    std::memcpy(buf, m_data+m_pos, n2);
+    m_pos += n2;
+  }
+  if (n2 != n)
+    m_ok = false;
+  return n2;
+}
+
+const uint8_t* MappedFileInterface::readSpan(size_t n)
+{
+  if (n > m_size - m_pos)
+    return nullptr;
+
+  const uint8_t* span = m_data+m_pos;
+  m_pos += n;
+  return span;
+}
+
+void MappedFileInterface::write8(uint8_t value)
+{
+  m_ok = false;
+}
+
+} // namespace dio
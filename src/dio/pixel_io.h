@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -22,7 +22,7 @@ public:
   typename ImageTraits::pixel_t read_pixel(FileInterface* fi);
   void write_pixel(FileInterface* fi, typename ImageTraits::pixel_t c);
   void read_scanline(typename ImageTraits::address_t address,
-                     int w, uint8_t* buffer);
+                     int w, const uint8_t* buffer);
   void write_scanline(typename ImageTraits::address_t address,
                       int w, uint8_t* buffer);
 };
@@ -45,7 +45,7 @@ public:
     f->write8(doc::rgba_geta(c));
   }
   void read_scanline(doc::RgbTraits::address_t address,
-                     int w, uint8_t* buffer) {
+                     int w, const uint8_t* buffer) {
     for (int x=0; x<w; ++x, ++address) {
       r = *(buffer++);
       g = *(buffer++);
@@ -79,7 +79,7 @@ public:
     f->write8(doc::graya_geta(c));
   }
   void read_scanline(doc::GrayscaleTraits::address_t address,
-                     int w, uint8_t* buffer)
+                     int w, const uint8_t* buffer)
   {
     for (int x=0; x<w; ++x, ++address) {
       k = *(buffer++);
@@ -107,7 +107,7 @@ public:
     f->write8(c);
   }
   void read_scanline(doc::IndexedTraits::address_t address,
-                     int w, uint8_t* buffer) {
+                     int w, const uint8_t* buffer) {
     std::memcpy(address, buffer, w);
   }
   void write_scanline(doc::IndexedTraits::address_t address,
@@ -134,7 +134,7 @@ public:
       return 0;
   }
   void read_scanline(doc::TilemapTraits::address_t address,
-                     int w, uint8_t* buffer) {
+                     int w, const uint8_t* buffer) {
     for (int x=0; x<w; ++x, ++address) {
       b1 = *(buffer++);
       b2 = *(buffer++);
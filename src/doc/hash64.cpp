@@ -0,0 +1,146 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/hash64.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace doc {
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(const uint64_t x, const int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t round(uint64_t acc, const uint64_t input)
+{
+  acc += input * kPrime2;
+  acc = rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, const uint64_t value)
+{
+  acc ^= round(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+} // anonymous namespace
+
+Hash64::Hash64(const uint64_t seed)
+  : m_seed(seed)
+{
+  m_acc[0] = seed + kPrime1 + kPrime2;
+  m_acc[1] = seed + kPrime2;
+  m_acc[2] = seed;
+  m_acc[3] = seed - kPrime1;
+}
+
+void Hash64::consumeStripe(const uint8_t* p)
+{
+  m_acc[0] = round(m_acc[0], read64(p));
+  m_acc[1] = round(m_acc[1], read64(p+8));
+  m_acc[2] = round(m_acc[2], read64(p+16));
+  m_acc[3] = round(m_acc[3], read64(p+24));
+}
+
+void Hash64::update(const void* data, size_t len)
+{
+  auto p = (const uint8_t*)data;
+  m_totalLen += len;
+
+  // Complete the pending stripe
+  if (m_bufLen > 0) {
+    const size_t n = std::min(len, sizeof(m_buf) - m_bufLen);
+    std::memcpy(m_buf + m_bufLen, p, n);
+    m_bufLen += n;
+    p += n;
+    len -= n;
+    if (m_bufLen < sizeof(m_buf))
+      return;
+    consumeStripe(m_buf);
+    m_bufLen = 0;
+  }
+
+  for (; len >= 32; p += 32, len -= 32)
+    consumeStripe(p);
+
+  if (len > 0) {
+    std::memcpy(m_buf, p, len);
+    m_bufLen = len;
+  }
+}
+
+uint64_t Hash64::digest() const
+{
+  uint64_t h;
+  if (m_totalLen >= 32) {
+    h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) +
+        rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+    h = merge_round(h, m_acc[0]);
+    h = merge_round(h, m_acc[1]);
+    h = merge_round(h, m_acc[2]);
+    h = merge_round(h, m_acc[3]);
+  }
+  else {
+    h = m_seed + kPrime5;
+  }
+  h += m_totalLen;
+
+  const uint8_t* p = m_buf;
+  size_t len = m_bufLen;
+  for (; len >= 8; p += 8, len -= 8) {
+    h ^= round(0, read64(p));
+    h = rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if (len >= 4) {
+    h ^= uint64_t(read32(p)) * kPrime1;
+    h = rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+    len -= 4;
+  }
+  for (; len > 0; ++p, --len) {
+    h ^= (*p) * kPrime5;
+    h = rotl(h, 11) * kPrime1;
+  }
+
+  // Avalanche
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+} // namespace doc
@@ -0,0 +1,44 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_HASH64_H_INCLUDED
+#define DOC_HASH64_H_INCLUDED
+#pragma once
+
+#include "base/ints.h"
+
+#include <cstddef>
+
+namespace doc {
+
+  // Streaming 64-bit non-cryptographic hash (XXH64 algorithm). The
+  // result doesn't depend on how the data is split in update()
+  // calls, so an image can be hashed row by row without copying its
+  // pixels to a contiguous buffer.
+  //
+  // Multi-byte words are read in the CPU native byte order, so
+  // values must not be persisted/shared between platforms with
+  // different endianness.
+  class Hash64 {
+  public:
+    Hash64(const uint64_t seed = 0);
+
+    void update(const void* data, size_t len);
+    uint64_t digest() const;
+
+  private:
+    void consumeStripe(const uint8_t* p);
+
+    uint64_t m_acc[4];
+    uint64_t m_totalLen = 0;
+    uint8_t m_buf[32];          // Partial stripe
+    size_t m_bufLen = 0;
+    uint64_t m_seed;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,49 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/hash64.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace doc;
+
+static uint64_t hash(const void* data, size_t len)
+{
+  Hash64 h;
+  h.update(data, len);
+  return h.digest();
+}
+
+TEST(Hash64, KnownValues)
+{
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, hash("", 0));
+  EXPECT_EQ(0xD24EC4F1A98C6E5BULL, hash("a", 1));
+  EXPECT_EQ(0x44BC2CF5AD770999ULL, hash("abc", 3));
+}
+
+TEST(Hash64, SplitUpdates)
+{
+  std::vector<uint8_t> data(1000);
+  for (size_t i=0; i<data.size(); ++i)
+    data[i] = uint8_t(i * 31 + 7);
+
+  for (size_t len : { 0, 1, 5, 31, 32, 33, 64, 100, 1000 }) {
+    const uint64_t expected = hash(data.data(), len);
+    for (size_t step : { 1, 3, 8, 17, 32, 45 }) {
+      Hash64 h;
+      for (size_t i=0; i<len; i+=step)
+        h.update(&data[i], std::min(step, len-i));
+      EXPECT_EQ(expected, h.digest()) << "len=" << len << " step=" << step;
+    }
+  }
+}
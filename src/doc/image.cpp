@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -35,6 +35,18 @@ int Image::getMemSize() const
   return sizeof(Image) + rowBytes()*height();
 }
 
+uint32_t Image::hash() const
+{
+  const ObjectVersion ver = version();
+  const uint64_t cached = m_hash;
+  if (cached && uint32_t(cached >> 32) == ver)
+    return uint32_t(cached);
+
+  const uint32_t hash = calculate_image_hash(this, bounds());
+  m_hash = (uint64_t(ver) << 32) | hash;
+  return hash;
+}
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
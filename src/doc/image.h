@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,8 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <atomic>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
@@ -72,6 +74,13 @@ namespace doc {
 
     virtual int getMemSize() const override;
 
+    // Returns calculate_image_hash() of the whole image. The value is
+    // cached until the image version() changes, so it can be used
+    // only with images that increment their version when they are
+    // modified (or that aren't modified after they are hashed). It
+    // can be called from several threads at the same time.
+    uint32_t hash() const;
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
       return ImageBits<ImageTraits>(this, bounds);
@@ -107,6 +116,10 @@ namespace doc {
 
   private:
     ImageSpec m_spec;
+
+    // Cached hash() in the lower 32 bits and the version() of the
+    // image when it was calculated in the upper 32 bits (0 = invalid)
+    mutable std::atomic<uint64_t> m_hash { 0 };
   };
 
 } // namespace doc
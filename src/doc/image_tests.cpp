@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -153,6 +153,23 @@ TEST(Image, DiffRgbImages)
   ASSERT_FALSE(is_same_image(a.get(), b.get()));
 }
 
+TEST(Image, CachedHash)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 32, 32));
+  clear_image(a.get(), rgba(0, 0, 0, 255));
+
+  const uint32_t hash = a->hash();
+  EXPECT_EQ(calculate_image_hash(a.get(), a->bounds()), hash);
+
+  // The cached hash is used until the version changes
+  put_pixel(a.get(), 0, 0, rgba(255, 0, 0, 255));
+  EXPECT_EQ(hash, a->hash());
+
+  a->incrementVersion();
+  EXPECT_EQ(calculate_image_hash(a.get(), a->bounds()), a->hash());
+  EXPECT_NE(hash, a->hash());
+}
+
 TYPED_TEST(ImageAllTypes, DrawHLine)
 {
   typedef TypeParam ImageTraits;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -19,7 +19,7 @@ namespace doc {
 
     struct image_hash {
       size_t operator()(const ImageRef& i) const {
-        return calculate_image_hash(i.get(), i->bounds());
+        return i->hash();
       }
     };
 
@@ -31,7 +31,8 @@ namespace doc {
 
   }
 
-  // A hash table used to match Image pixels data <-> an index
+  // A hash table used to match Image pixels data <-> an index (the
+  // images must not be modified while they are in the map)
   typedef std::unordered_map<ImageRef,
                              uint32_t,
                              details::image_hash,
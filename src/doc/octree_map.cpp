@@ -10,29 +10,60 @@
 
 #include "doc/octree_map.h"
 
+#include "doc/image_traits.h"
+#include "doc/ordered_jobs.h"
 #include "doc/palette.h"
+#include "doc/primitives_fast.h"
+
+#include <algorithm>
+#include <thread>
 
 #define MIN_LEVEL_OCTREE_DEEP 3
 
+// Minimum number of pixels/rows to split the image feeding in
+// several threads.
+#define MIN_PIXELS_PER_THREAD (128*128)
+#define MIN_ROWS_PER_THREAD   16
+
 namespace doc {
 
 //////////////////////////////////////////////////////////////////////
 // OctreeNode
 
 void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
+                          const OctreeMap* octree,
                           int paletteIndex, int levelDeep)
+{
+  OctreeNode* node = this;
+  for (; level < levelDeep; ++level) {
+    node->m_parent = parent;
+    if (!node->m_children)
+      node->m_children = octree->newChildren();
+    parent = node;
+    node = &(*node->m_children)[getHextet(c, level)];
+  }
+  node->m_parent = parent;
+  node->m_leafColor.add(c);
+  node->m_paletteIndex = paletteIndex;
+}
+
+void OctreeNode::merge(const OctreeNode& other, OctreeNode* parent,
+                       const OctreeMap* octree)
 {
   m_parent = parent;
-  if (level >= levelDeep) {
-    m_leafColor.add(c);
-    m_paletteIndex = paletteIndex;
-    return;
+  if (other.isLeaf()) {
+    m_leafColor.add(other.m_leafColor);
+    m_paletteIndex = other.m_paletteIndex;
   }
-  int index = getHextet(c, level);
-  if (!m_children) {
-    m_children.reset(new std::array<OctreeNode, 16>());
+  if (other.m_children) {
+    if (!m_children)
+      m_children = octree->newChildren();
+    for (int i=0; i<16; ++i) {
+      const OctreeNode& child = (*other.m_children)[i];
+      if (child.isLeaf() || child.hasChildren())
+        (*m_children)[i].merge(child, this, octree);
+    }
   }
-  (*m_children)[index].addColor(c, level + 1, this, paletteIndex, levelDeep);
 }
 
 int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index,
@@ -48,7 +79,7 @@ int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index,
   }
   int index = getHextet(r, g, b, a, level);
   if (!m_children)
-    m_children.reset(new std::array<OctreeNode, 16>());
+    m_children = octree->newChildren();
   return (*m_children)[index].mapColor(r, g, b, a, mask_index, palette, level + 1, octree);
 }
 
@@ -232,6 +263,48 @@ void OctreeMap::feedWithImage(const Image* image,
 {
   ASSERT(image);
   ASSERT(image->pixelFormat() == IMAGE_RGB || image->pixelFormat() == IMAGE_GRAYSCALE);
+
+  const int h = image->height();
+  int nthreads = 1;
+  if (image->width() * h >= 2*MIN_PIXELS_PER_THREAD) {
+    nthreads = OrderedJobs::calcThreads(
+      std::min(image->width() * h / MIN_PIXELS_PER_THREAD,
+               h / MIN_ROWS_PER_THREAD),
+      int(std::thread::hardware_concurrency()));
+  }
+
+  if (nthreads <= 1) {
+    feedWithRows(image, withAlpha, 0, h, levelDeep);
+  }
+  else {
+    // Each band is fed to its own octree (so each thread allocates
+    // nodes from its own arena)
+    std::vector<OctreeMap> bands(nthreads);
+    OrderedJobs jobs(nthreads);
+    for (int i=0; i<nthreads; ++i) {
+      const int y0 = h * i / nthreads;
+      const int y1 = h * (i+1) / nthreads;
+      jobs.add(
+        [&bands, i, image, withAlpha, y0, y1, levelDeep]{
+          bands[i].feedWithRows(image, withAlpha, y0, y1, levelDeep);
+        });
+    }
+
+    // Merge in band order
+    for (int i=0; i<nthreads; ++i) {
+      jobs.wait(i);
+      if (bands[i].m_root.hasChildren())
+        m_root.merge(bands[i].m_root, &m_root, this);
+    }
+  }
+  m_maskColor = maskColor;
+}
+
+void OctreeMap::feedWithRows(const Image* image,
+                             const bool withAlpha,
+                             const int y0, const int y1,
+                             const int levelDeep)
+{
   color_t forceFullOpacity;
   const bool imageIsRGBA = (image->pixelFormat() == IMAGE_RGB);
 
@@ -248,19 +321,25 @@ void OctreeMap::feedWithImage(const Image* image,
       }
     };
 
+  const int w = image->width();
   switch (image->pixelFormat()) {
     case IMAGE_RGB: {
       forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
-      doc::for_each_pixel<RgbTraits>(image, add_color_to_octree);
+      for (int y=y0; y<y1; ++y) {
+        const auto* ptr = get_pixel_address_fast<RgbTraits>(image, 0, y);
+        std::for_each(ptr, ptr+w, add_color_to_octree);
+      }
       break;
     }
     case IMAGE_GRAYSCALE: {
       forceFullOpacity = (withAlpha ? 0 : graya_a_mask);
-      doc::for_each_pixel<GrayscaleTraits>(image, add_color_to_octree);
+      for (int y=y0; y<y1; ++y) {
+        const auto* ptr = get_pixel_address_fast<GrayscaleTraits>(image, 0, y);
+        std::for_each(ptr, ptr+w, add_color_to_octree);
+      }
       break;
     }
   }
-  m_maskColor = maskColor;
 }
 
 int OctreeMap::mapColor(color_t rgba) const
@@ -293,6 +372,7 @@ void OctreeMap::regenerateMap(const Palette* palette,
   m_fitCriteria = fitCriteria;
   m_root = OctreeNode();
   m_leavesVector.clear();
+  clearNodes();
   m_maskIndex = maskIndex;
   int maskColorBestFitIndex;
   if (maskIndex < 0) {
@@ -309,13 +389,28 @@ void OctreeMap::regenerateMap(const Palette* palette,
 
   for (int i=0; i<palette->size(); i++) {
     if (i == maskIndex) {
-      m_root.addColor(palette->entry(i), 0, &m_root, maskColorBestFitIndex, 8);
+      m_root.addColor(palette->entry(i), 0, &m_root, this, maskColorBestFitIndex, 8);
       continue;
     }
-    m_root.addColor(palette->entry(i), 0, &m_root, i, 8);
+    m_root.addColor(palette->entry(i), 0, &m_root, this, i, 8);
   }
 
   m_modifications = palette->getModifications();
 }
 
+OctreeMap::Children* OctreeMap::newChildren() const
+{
+  if (m_chunkUsed == kChunkSize) {
+    m_chunks.emplace_back(new Children[kChunkSize]);
+    m_chunkUsed = 0;
+  }
+  return &m_chunks.back()[m_chunkUsed++];
+}
+
+void OctreeMap::clearNodes()
+{
+  m_chunks.clear();
+  m_chunkUsed = kChunkSize;
+}
+
 } // namespace doc
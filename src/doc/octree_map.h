@@ -32,6 +32,9 @@ using OctreeNodes = std::vector<OctreeNode*>;
 
 class OctreeNode {
 private:
+  // Accumulates the RGBA components of all the pixels that fall in
+  // a leaf (integers, so the result doesn't depend on the order the
+  // colors were added, e.g. when partial trees are merged).
   class LeafColor {
   public:
     LeafColor() :
@@ -43,10 +46,10 @@ private:
     }
 
     LeafColor(int r, int g, int b, int a, size_t pixelCount) :
-      m_r((double)r),
-      m_g((double)g),
-      m_b((double)b),
-      m_a((double)a),
+      m_r(r),
+      m_g(g),
+      m_b(b),
+      m_a(a),
       m_pixelCount(pixelCount) {
     }
 
@@ -67,10 +70,10 @@ private:
     }
 
     color_t rgbaColor() const {
-      int auxR = (((int)m_r) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxG = (((int)m_g) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxB = (((int)m_b) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxA = (((int)m_a) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
+      int auxR = (m_r % m_pixelCount > m_pixelCount / 2) ? 1: 0;
+      int auxG = (m_g % m_pixelCount > m_pixelCount / 2) ? 1: 0;
+      int auxB = (m_b % m_pixelCount > m_pixelCount / 2) ? 1: 0;
+      int auxA = (m_a % m_pixelCount > m_pixelCount / 2) ? 1: 0;
       return rgba(int(m_r / m_pixelCount + auxR),
                   int(m_g / m_pixelCount + auxG),
                   int(m_b / m_pixelCount + auxB),
@@ -80,11 +83,11 @@ private:
     size_t pixelCount() const { return m_pixelCount; }
 
 private:
-    double m_r;
-    double m_g;
-    double m_b;
-    double m_a;
-    size_t m_pixelCount;
+    uint64_t m_r;
+    uint64_t m_g;
+    uint64_t m_b;
+    uint64_t m_a;
+    uint64_t m_pixelCount;
   };
 
 public:
@@ -93,8 +96,14 @@ public:
   LeafColor leafColor() const { return m_leafColor; }
 
   void addColor(color_t c, int level, OctreeNode* parent,
+                const OctreeMap* octree,
                 int paletteIndex = 0, int levelDeep = 7);
 
+  // Adds all the colors/leaves of "other" (a node of another octree)
+  // to this node.
+  void merge(const OctreeNode& other, OctreeNode* parent,
+             const OctreeMap* octree);
+
   int mapColor(int  r, int g, int b, int a, int mask_index,
                const Palette* palette, int level,
                const OctreeMap* octree) const;
@@ -108,7 +117,7 @@ public:
                    OctreeNodes& rootLeavesVector);
 
 private:
-  bool isLeaf() { return m_leafColor.pixelCount() > 0; }
+  bool isLeaf() const { return m_leafColor.pixelCount() > 0; }
   void paletteIndex(int index) { m_paletteIndex = index; }
 
   static int getHextet(color_t c, int level);
@@ -117,14 +126,15 @@ private:
 
   LeafColor m_leafColor;
   mutable int m_paletteIndex = -1;
-  mutable std::unique_ptr<std::array<OctreeNode, 16>> m_children;
+  // Children are allocated from the OctreeMap arena.
+  mutable std::array<OctreeNode, 16>* m_children = nullptr;
   OctreeNode* m_parent = nullptr;
 };
 
 class OctreeMap : public RgbMapBase {
 public:
   void addColor(color_t color, int levelDeep = 7) {
-    m_root.addColor(color, 0, &m_root, 0, levelDeep);
+    m_root.addColor(color, 0, &m_root, this, 0, levelDeep);
   }
 
   // makePalette returns true if a 7 level octreeDeep is OK, and false
@@ -133,6 +143,10 @@ public:
                    int colorCount,
                    const int levelDeep = 7);
 
+  // Big images are split in horizontal bands, each band is fed to
+  // its own octree in a different thread, and then all the partial
+  // octrees are merged in this one (the result is the same as
+  // feeding the whole image in just one thread).
   void feedWithImage(const Image* image,
                      const bool withAlpha,
                      const color_t maskColor,
@@ -154,9 +168,28 @@ public:
   }
 
 private:
+  friend class OctreeNode;
+  using Children = std::array<OctreeNode, 16>;
+
+  // Number of children arrays allocated in each chunk of the arena.
+  static constexpr int kChunkSize = 256;
+
+  void feedWithRows(const Image* image,
+                    const bool withAlpha,
+                    const int y0, const int y1,
+                    const int levelDeep);
+
+  Children* newChildren() const;
+  void clearNodes();
+
   OctreeNode m_root;
   OctreeNodes m_leavesVector;
   color_t m_maskColor = 0;
+
+  // Arena of nodes, all the nodes of the tree (except the root) are
+  // allocated in big chunks instead of individually.
+  mutable std::vector<std::unique_ptr<Children[]>> m_chunks;
+  mutable int m_chunkUsed = kChunkSize;
 };
 
 } // namespace doc
@@ -0,0 +1,71 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/octree_map.h"
+#include "doc/ordered_jobs.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+
+using namespace doc;
+
+// Big images are fed in several threads, the octree must be the same
+// as the one fed in just one thread (feedWithImage() doesn't create
+// more threads inside an OrderedJobs job).
+TEST(OctreeMap, ParallelFeedIsEqualToSerialFeed)
+{
+  for (const PixelFormat pixelFormat : { IMAGE_RGB, IMAGE_GRAYSCALE }) {
+    for (const bool withAlpha : { false, true }) {
+      std::unique_ptr<Image> image(Image::create(pixelFormat, 512, 300));
+      std::srand(512*300);
+      for (int y=0; y<image->height(); ++y) {
+        for (int x=0; x<image->width(); ++x) {
+          const int a = ((std::rand() & 3) == 0 ? 0: std::rand() & 255);
+          put_pixel(image.get(), x, y,
+                    (pixelFormat == IMAGE_RGB ?
+                     rgba(std::rand() & 255, std::rand() & 255,
+                          std::rand() & 255, a):
+                     graya(std::rand() & 255, a)));
+        }
+      }
+
+      OctreeMap parallel;
+      parallel.feedWithImage(image.get(), withAlpha, 0);
+
+      OctreeMap serial;
+      OrderedJobs jobs(1);
+      jobs.wait(jobs.add([&serial, &image, withAlpha]{
+        serial.feedWithImage(image.get(), withAlpha, 0);
+      }));
+
+      Palette parallelPalette(frame_t(0), 256);
+      Palette serialPalette(frame_t(0), 256);
+      EXPECT_EQ(serial.makePalette(&serialPalette, 256),
+                parallel.makePalette(&parallelPalette, 256));
+      ASSERT_EQ(serialPalette.size(), parallelPalette.size());
+      for (int i=0; i<serialPalette.size(); ++i) {
+        EXPECT_EQ(serialPalette.getEntry(i), parallelPalette.getEntry(i))
+          << "entry " << i;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/ordered_jobs.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+
+namespace doc {
+
+namespace {
+
+// True in the worker threads of all OrderedJobs instances
+thread_local bool t_insideJob = false;
+
+} // anonymous namespace
+
+// static
+int OrderedJobs::calcThreads(const int njobs, const int maxThreads)
+{
+  if (t_insideJob)
+    return 1;
+
+  const int n = std::clamp<int>(std::thread::hardware_concurrency(),
+                                1, std::max(1, maxThreads));
+  return std::clamp(njobs, 1, n);
+}
+
+OrderedJobs::OrderedJobs(const int nthreads)
+{
+  ASSERT(nthreads > 0);
+  for (int i=0; i<std::max(1, nthreads); ++i)
+    m_threads.emplace_back([this]{ workerThread(); });
+}
+
+OrderedJobs::~OrderedJobs()
+{
+  {
+    const std::lock_guard lock(m_mutex);
+    m_exit = true;
+  }
+  cancel();
+  m_newJob.notify_all();
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+int OrderedJobs::add(Func&& func)
+{
+  int i;
+  {
+    const std::lock_guard lock(m_mutex);
+    i = int(m_done.size());
+    m_done.push_back(false);
+    m_pending.push_back(Job{ i, std::move(func) });
+  }
+  m_newJob.notify_one();
+  return i;
+}
+
+void OrderedJobs::wait(const int i)
+{
+  std::unique_lock lock(m_mutex);
+  ASSERT(i >= 0 && i < int(m_done.size()));
+  m_jobDone.wait(lock, [this, i]{ return m_done[i]; });
+}
+
+bool OrderedJobs::isDone(const int i) const
+{
+  const std::lock_guard lock(m_mutex);
+  ASSERT(i >= 0 && i < int(m_done.size()));
+  return m_done[i];
+}
+
+void OrderedJobs::cancel()
+{
+  {
+    const std::lock_guard lock(m_mutex);
+    for (const Job& job : m_pending)
+      m_done[job.index] = true;
+    m_pending.clear();
+  }
+  m_jobDone.notify_all();
+}
+
+void OrderedJobs::workerThread()
+{
+  t_insideJob = true;
+
+  std::unique_lock lock(m_mutex);
+  while (true) {
+    m_newJob.wait(lock, [this]{ return m_exit || !m_pending.empty(); });
+    if (m_pending.empty())
+      break;                    // m_exit is true
+
+    Job job = std::move(m_pending.front());
+    m_pending.pop_front();
+
+    lock.unlock();
+    job.func();
+    lock.lock();
+
+    m_done[job.index] = true;
+    m_jobDone.notify_all();
+  }
+}
+
+void for_each_row_band(const int height,
+                       const size_t rowBytes,
+                       const std::function<void(int, int)>& func)
+{
+  // Approximated number of bytes processed in each band
+  const size_t kBandBytes = 256*1024;
+
+  const int bandRows = int(std::clamp<size_t>(kBandBytes / std::max<size_t>(1, rowBytes),
+                                              1, std::max(1, height)));
+  const int nbands = (height + bandRows - 1) / bandRows;
+  if (nbands <= 1) {
+    if (height > 0)
+      func(0, height);
+    return;
+  }
+
+  const int nthreads = OrderedJobs::calcThreads(
+    nbands, int(std::thread::hardware_concurrency()));
+  if (nthreads <= 1) {
+    func(0, height);
+    return;
+  }
+
+  OrderedJobs jobs(nthreads);
+  for (int y=0; y<height; y+=bandRows) {
+    const int y1 = std::min(y+bandRows, height);
+    jobs.add([&func, y, y1]{ func(y, y1); });
+  }
+  for (int i=0; i<nbands; ++i)
+    jobs.wait(i);
+}
+
+} // namespace doc
@@ -0,0 +1,80 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ORDERED_JOBS_H_INCLUDED
+#define DOC_ORDERED_JOBS_H_INCLUDED
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+
+  // Pool of worker threads to process parts of a task in parallel
+  // (e.g. the files of a sequence, the frames of an animation, or
+  // bands of rows of an image). Jobs are started in the same order
+  // they are added, and each job is identified by its index (0 for
+  // the first added job, 1 for the second one, etc.), so the caller
+  // can wait the results in order to write/merge them as in a serial
+  // operation.
+  class OrderedJobs {
+  public:
+    using Func = std::function<void()>;
+
+    // Number of threads to process the given number of jobs (at least
+    // one thread, and no more than "maxThreads"). It returns 1 when
+    // it's called from a job (e.g. to save a PNG file of a sequence
+    // that is saved in parallel), so nested operations are done in
+    // the same thread instead of creating more threads than cores.
+    static int calcThreads(const int njobs, const int maxThreads = 8);
+
+    explicit OrderedJobs(const int nthreads);
+    // Cancels the pending jobs and waits the running ones.
+    ~OrderedJobs();
+
+    // Adds a new job and returns its index. The function must not
+    // throw exceptions.
+    int add(Func&& func);
+
+    // Waits until the given job is done (or canceled).
+    void wait(const int i);
+    bool isDone(const int i) const;
+
+    // Discards all pending jobs, running jobs are completed anyway.
+    void cancel();
+
+  private:
+    struct Job {
+      int index;
+      Func func;
+    };
+
+    void workerThread();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_newJob;
+    std::condition_variable m_jobDone;
+    std::deque<Job> m_pending;
+    std::vector<bool> m_done;
+    bool m_exit = false;
+    std::vector<std::thread> m_threads;
+  };
+
+  // Calls func(y0, y1) for bands of rows [y0, y1) of an image with
+  // the given number of rows and bytes per row. Bands of big images
+  // are processed in several threads (using all available cores), so
+  // func() must only modify the pixels of the given rows.
+  void for_each_row_band(const int height,
+                         const size_t rowBytes,
+                         const std::function<void(int, int)>& func);
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,81 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/ordered_jobs.h"
+
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(OrderedJobs, WaitInOrder)
+{
+  std::vector<int> results(100, 0);
+  OrderedJobs jobs(4);
+  for (int i=0; i<100; ++i) {
+    EXPECT_EQ(i, jobs.add([&results, i]{ results[i] = i*i; }));
+  }
+  for (int i=0; i<100; ++i) {
+    jobs.wait(i);
+    EXPECT_TRUE(jobs.isDone(i));
+    EXPECT_EQ(i*i, results[i]);
+  }
+}
+
+TEST(OrderedJobs, Cancel)
+{
+  OrderedJobs jobs(1);
+  for (int i=0; i<100; ++i)
+    jobs.add([]{ });
+  jobs.cancel();
+
+  // Canceled jobs are done too
+  for (int i=0; i<100; ++i)
+    jobs.wait(i);
+}
+
+TEST(OrderedJobs, ForEachRowBand)
+{
+  for (int height : { 0, 1, 7, 5000 }) {
+    std::vector<int> rows(height, 0);
+    for_each_row_band(height, 1024, [&rows](int y0, int y1){
+      EXPECT_LT(y0, y1);
+      for (int y=y0; y<y1; ++y)
+        ++rows[y];
+    });
+    for (int y=0; y<height; ++y)
+      EXPECT_EQ(1, rows[y]);
+  }
+}
+
+TEST(OrderedJobs, NestedJobsUseOneThread)
+{
+  int n = 0;
+  OrderedJobs jobs(1);
+  jobs.wait(jobs.add([&n]{ n = OrderedJobs::calcThreads(100); }));
+  EXPECT_EQ(1, n);
+
+  // Bands are processed in the job thread
+  std::vector<std::thread::id> ids;
+  jobs.wait(jobs.add([&ids]{
+    for_each_row_band(1024, 1024*1024, [&ids](int y0, int y1){
+      ids.push_back(std::this_thread::get_id());
+    });
+  }));
+  EXPECT_EQ(1, int(ids.size()));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
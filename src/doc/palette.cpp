@@ -13,19 +13,24 @@
 
 #include "base/base.h"
 #include "doc/image.h"
+#include "doc/palette_bestfit.h"
 #include "doc/palette_gradient_type.h"
 #include "doc/remap.h"
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 
 #include <algorithm>
-#include <limits>
 #include <cmath>
+#include <mutex>
 
 namespace doc {
 
 using namespace gfx;
 
+// Used to create the PaletteBestfit structure only once when several
+// threads call findBestfit() at the same time.
+static std::mutex bestfit_mutex;
+
 Palette::Palette()
   : Palette(0, 256)
 {
@@ -33,6 +38,7 @@ Palette::Palette()
 
 Palette::Palette(frame_t frame, int ncolors)
   : Object(ObjectType::Palette)
+  , m_bestfitPtr(nullptr)
 {
   ASSERT(ncolors >= 0);
 
@@ -44,15 +50,22 @@ Palette::Palette(frame_t frame, int ncolors)
 Palette::Palette(const Palette& palette)
   : Object(palette)
   , m_comment(palette.m_comment)
+  , m_bestfitPtr(nullptr)
 {
   m_frame = palette.m_frame;
   m_colors = palette.m_colors;
   m_modifications = 0;
+
+  // Same colors, same bestfit structure
+  std::lock_guard lock(bestfit_mutex);
+  m_bestfit = palette.m_bestfit;
+  m_bestfitPtr = m_bestfit.get();
 }
 
 Palette::Palette(const Palette& palette, const Remap& remap)
   : Object(palette)
   , m_comment(palette.m_comment)
+  , m_bestfitPtr(nullptr)
 {
   m_frame = palette.m_frame;
 
@@ -75,6 +88,12 @@ Palette& Palette::operator=(const Palette& that)
   m_filename = that.m_filename;
   m_comment = that.m_comment;
 
+  if (this != &that) {
+    std::lock_guard lock(bestfit_mutex);
+    m_bestfit = that.m_bestfit;
+    m_bestfitPtr = m_bestfit.get();
+  }
+
   ++m_modifications;
   return *this;
 }
@@ -93,6 +112,7 @@ void Palette::resize(int ncolors, color_t color)
 
   m_colors.resize(ncolors, color);
   ++m_modifications;
+  resetBestfit();
 }
 
 void Palette::addEntry(color_t color)
@@ -132,12 +152,19 @@ void Palette::setEntry(int i, color_t color)
 
   m_colors[i] = color;
   ++m_modifications;
+  resetBestfit();
 }
 
 void Palette::copyColorsTo(Palette* dst) const
 {
   dst->m_colors = m_colors;
   ++dst->m_modifications;
+
+  if (dst != this) {
+    std::lock_guard lock(bestfit_mutex);
+    dst->m_bestfit = m_bestfit;
+    dst->m_bestfitPtr = dst->m_bestfit.get();
+  }
 }
 
 int Palette::countDiff(const Palette* other, int* from, int* to) const
@@ -196,6 +223,7 @@ void Palette::makeBlack()
 {
   std::fill(m_colors.begin(), m_colors.end(), rgba(0, 0, 0, 255));
   ++m_modifications;
+  resetBestfit();
 }
 
 // Creates a linear ramp in the palette.
@@ -313,74 +341,33 @@ bool Palette::findExactMatch(color_t color) const
 }
 
 //////////////////////////////////////////////////////////////////////
-// Based on Allegro's bestfit_color
+// Based on Allegro's bestfit_color (see PaletteBestfit)
 
-static std::vector<uint32_t> col_diff;
-static uint32_t* col_diff_g;
-static uint32_t* col_diff_r;
-static uint32_t* col_diff_b;
-static uint32_t* col_diff_a;
+int Palette::findBestfit(int r, int g, int b, int a, int mask_index) const
+{
+  return bestfit()->findBestfit(r, g, b, a, mask_index);
+}
 
-void Palette::initBestfit()
+const PaletteBestfit* Palette::bestfit() const
 {
-  col_diff.resize(4*128, 0);
-  col_diff_g = &col_diff[128*0];
-  col_diff_r = &col_diff[128*1];
-  col_diff_b = &col_diff[128*2];
-  col_diff_a = &col_diff[128*3];
-
-  for (int i=1; i<64; ++i) {
-    int k = i * i;
-    col_diff_g[i] = col_diff_g[128-i] = k * 59 * 59;
-    col_diff_r[i] = col_diff_r[128-i] = k * 30 * 30;
-    col_diff_b[i] = col_diff_b[128-i] = k * 11 * 11;
-    col_diff_a[i] = col_diff_a[128-i] = k * 8 * 8;
+  const PaletteBestfit* bestfit = m_bestfitPtr.load(std::memory_order_acquire);
+  if (!bestfit) {
+    std::lock_guard lock(bestfit_mutex);
+    if (!m_bestfit)
+      m_bestfit = std::make_shared<PaletteBestfit>(m_colors);
+    bestfit = m_bestfit.get();
+    m_bestfitPtr.store(bestfit, std::memory_order_release);
   }
+  return bestfit;
 }
 
-int Palette::findBestfit(int r, int g, int b, int a, int mask_index) const
+void Palette::resetBestfit()
 {
-  ASSERT(r >= 0 && r <= 255);
-  ASSERT(g >= 0 && g <= 255);
-  ASSERT(b >= 0 && b <= 255);
-  ASSERT(a >= 0 && a <= 255);
-  ASSERT(!col_diff.empty());
-
-  r >>= 3;
-  g >>= 3;
-  b >>= 3;
-  a >>= 3;
-
-  // Mask index is like alpha = 0, so we can use it as transparent color.
-  if (a == 0 && mask_index >= 0)
-    return mask_index;
-
-  int bestfit = 0;
-  int lowest = std::numeric_limits<int>::max();
-  int size = std::min(256, int(m_colors.size()));
-
-  for (int i=0; i<size; ++i) {
-    color_t rgb = m_colors[i];
-
-    int coldiff = col_diff_g[((rgba_getg(rgb)>>3) - g) & 127];
-    if (coldiff < lowest) {
-      coldiff += col_diff_r[(((rgba_getr(rgb)>>3) - r) & 127)];
-      if (coldiff < lowest) {
-        coldiff += col_diff_b[(((rgba_getb(rgb)>>3) - b) & 127)];
-        if (coldiff < lowest) {
-          coldiff += col_diff_a[(((rgba_geta(rgb)>>3) - a) & 127)];
-          if (coldiff < lowest && i != mask_index) {
-            if (coldiff == 0)
-              return i;
-
-            bestfit = i;
-            lowest = coldiff;
-          }
-        }
-      }
-    }
+  if (m_bestfitPtr) {
+    std::lock_guard lock(bestfit_mutex);
+    m_bestfit.reset();
+    m_bestfitPtr = nullptr;
   }
-  return bestfit;
 }
 
 int Palette::findMaskColor() const
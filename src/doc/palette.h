@@ -15,17 +15,18 @@
 #include "doc/object.h"
 #include "doc/palette_gradient_type.h"
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 
 namespace doc {
 
+  class PaletteBestfit;
   class Remap;
 
   class Palette : public Object {
   public:
-    static void initBestfit();
-
     Palette();
     Palette(frame_t frame, int ncolors);
     Palette(const Palette& palette);
@@ -105,6 +106,8 @@ namespace doc {
 
     int findExactMatch(int r, int g, int b, int a, int mask_index) const;
     bool findExactMatch(color_t color) const;
+    // Thread-safe, the search structure used to find the best index
+    // is created on demand and shared with copies of this palette.
     int findBestfit(int r, int g, int b, int a, int mask_index) const;
     int findMaskColor() const;
 
@@ -115,12 +118,20 @@ namespace doc {
     const std::string& getEntryName(const int i) const;
 
   private:
+    const PaletteBestfit* bestfit() const;
+    void resetBestfit();
+
     frame_t m_frame;
     std::vector<color_t> m_colors;
     std::vector<std::string> m_names;
     int m_modifications;
     std::string m_filename; // If the palette is associated with a file.
     std::string m_comment; // Some extra comment from the .gpl file (author, website, etc.).
+
+    // Cached structure for findBestfit(), created in the first call
+    // and discarded each time the colors are modified.
+    mutable std::shared_ptr<const PaletteBestfit> m_bestfit;
+    mutable std::atomic<const PaletteBestfit*> m_bestfitPtr;
   };
 
 } // namespace doc
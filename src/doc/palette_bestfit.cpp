@@ -0,0 +1,106 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/palette_bestfit.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace doc {
+
+PaletteBestfit::PaletteBestfit(const std::vector<color_t>& colors)
+{
+  const int n = std::min(256, int(colors.size()));
+
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(
+    order.begin(), order.end(),
+    [&colors](const int i, const int j){
+      return (rgba_getg(colors[i])>>3) < (rgba_getg(colors[j])>>3);
+    });
+
+  m_r.resize(n);
+  m_g.resize(n);
+  m_b.resize(n);
+  m_a.resize(n);
+  m_index.resize(n);
+  for (int k=0; k<n; ++k) {
+    const color_t c = colors[order[k]];
+    m_r[k] = rgba_getr(c) >> 3;
+    m_g[k] = rgba_getg(c) >> 3;
+    m_b[k] = rgba_getb(c) >> 3;
+    m_a[k] = rgba_geta(c) >> 3;
+    m_index[k] = order[k];
+  }
+
+  int k = 0;
+  for (int g=0; g<int(m_start.size()); ++g) {
+    while (k < n && m_g[k] < g)
+      ++k;
+    m_start[g] = k;
+  }
+}
+
+int PaletteBestfit::findBestfit(int r, int g, int b, int a, int mask_index) const
+{
+  ASSERT(r >= 0 && r <= 255);
+  ASSERT(g >= 0 && g <= 255);
+  ASSERT(b >= 0 && b <= 255);
+  ASSERT(a >= 0 && a <= 255);
+
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+  a >>= 3;
+
+  // Mask index is like alpha = 0, so we can use it as transparent color.
+  if (a == 0 && mask_index >= 0)
+    return mask_index;
+
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  const int n = size();
+
+  auto check = [&](const int k) {
+    const int i = m_index[k];
+    if (i == mask_index)
+      return;
+
+    const int diff = distance(m_r[k], m_g[k], m_b[k], m_a[k], r, g, b, a);
+    if (diff < lowest || (diff == lowest && i < bestfit)) {
+      bestfit = i;
+      lowest = diff;
+    }
+  };
+
+  // Entries are sorted by green, so as soon as the green difference
+  // alone is greater than the best distance found, no other entry in
+  // that direction can be a better (or an equal) match.
+  const int start = m_start[g];
+  for (int k=start; k<n; ++k) {
+    const int dg = m_g[k] - g;
+    if (dg*dg*kWeightG > lowest)
+      break;
+    check(k);
+  }
+  for (int k=start-1; k>=0; --k) {
+    const int dg = g - m_g[k];
+    if (dg*dg*kWeightG > lowest)
+      break;
+    check(k);
+  }
+  return bestfit;
+}
+
+} // namespace doc
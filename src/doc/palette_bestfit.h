@@ -0,0 +1,69 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PALETTE_BESTFIT_H_INCLUDED
+#define DOC_PALETTE_BESTFIT_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/ints.h"
+#include "doc/color.h"
+
+#include <array>
+#include <vector>
+
+namespace doc {
+
+  // Precomputed search structure to find the nearest palette entry
+  // of a RGBA color. Returns exactly the same indexes as the classic
+  // Allegro-like bestfit_color() scan (weighted distance between the
+  // 5-bit channels, ties resolved to the lowest palette index), but
+  // the entries are sorted by the green channel (the one with the
+  // highest weight) so each query only has to visit the entries that
+  // can beat the current best candidate.
+  //
+  // It's immutable after its construction, so it can be shared
+  // between threads and between palettes with the same colors.
+  class PaletteBestfit {
+  public:
+    // Only the first 256 colors are used.
+    PaletteBestfit(const std::vector<color_t>& colors);
+
+    int findBestfit(int r, int g, int b, int a, int mask_index) const;
+
+    int size() const { return int(m_index.size()); }
+
+    // Weighted distance between two colors with 5-bit channels.
+    static int distance(int r1, int g1, int b1, int a1,
+                        int r2, int g2, int b2, int a2) {
+      const int dr = r1 - r2;
+      const int dg = g1 - g2;
+      const int db = b1 - b2;
+      const int da = a1 - a2;
+      return dg*dg*kWeightG + dr*dr*kWeightR + db*db*kWeightB + da*da*kWeightA;
+    }
+
+  private:
+    static constexpr int kWeightG = 59*59;
+    static constexpr int kWeightR = 30*30;
+    static constexpr int kWeightB = 11*11;
+    static constexpr int kWeightA = 8*8;
+
+    // Entries sorted by green channel (structure of arrays with the
+    // 5-bit components of each color).
+    std::vector<uint8_t> m_r, m_g, m_b, m_a;
+    std::vector<uint8_t> m_index;
+
+    // m_start[g] is the first position in the sorted arrays with a
+    // green component >= g (m_start[32] == size()).
+    std::array<int, 33> m_start;
+
+    DISABLE_COPYING(PaletteBestfit);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,106 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette_bestfit.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+using namespace doc;
+
+// Brute force version of the original Allegro-like bestfit_color()
+static int bruteforce_bestfit(const std::vector<color_t>& colors,
+                              int r, int g, int b, int a, int mask_index)
+{
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+  a >>= 3;
+
+  if (a == 0 && mask_index >= 0)
+    return mask_index;
+
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  const int size = std::min(256, int(colors.size()));
+  for (int i=0; i<size; ++i) {
+    const color_t c = colors[i];
+    const int diff = PaletteBestfit::distance(
+      rgba_getr(c)>>3, rgba_getg(c)>>3, rgba_getb(c)>>3, rgba_geta(c)>>3,
+      r, g, b, a);
+    if (diff < lowest && i != mask_index) {
+      if (diff == 0)
+        return i;
+      bestfit = i;
+      lowest = diff;
+    }
+  }
+  return bestfit;
+}
+
+static color_t random_color()
+{
+  return rgba(std::rand() % 256, std::rand() % 256,
+              std::rand() % 256, std::rand() % 256);
+}
+
+TEST(PaletteBestfit, EmptyPalette)
+{
+  PaletteBestfit bestfit({});
+  EXPECT_EQ(0, bestfit.findBestfit(10, 20, 30, 255, -1));
+  EXPECT_EQ(0, bestfit.findBestfit(10, 20, 30, 255, 0));
+  EXPECT_EQ(3, bestfit.findBestfit(10, 20, 30, 0, 3));
+}
+
+TEST(PaletteBestfit, TiesReturnLowestIndex)
+{
+  std::vector<color_t> colors = {
+    rgba(255, 255, 255, 255),
+    rgba(0, 0, 0, 255),
+    rgba(1, 2, 3, 255),         // Same 5-bit color as entry 1
+    rgba(0, 0, 0, 255),
+  };
+  PaletteBestfit bestfit(colors);
+  EXPECT_EQ(1, bestfit.findBestfit(0, 0, 0, 255, -1));
+  EXPECT_EQ(2, bestfit.findBestfit(0, 0, 0, 255, 1));
+  EXPECT_EQ(0, bestfit.findBestfit(250, 250, 250, 255, -1));
+  EXPECT_EQ(1, bestfit.findBestfit(250, 250, 250, 255, 0));
+}
+
+TEST(PaletteBestfit, SameResultsAsBruteForce)
+{
+  std::srand(1);
+  for (int n : { 1, 2, 16, 100, 255, 256, 300 }) {
+    std::vector<color_t> colors(n);
+    for (color_t& c : colors)
+      c = random_color();
+
+    // Repeated entries
+    if (n > 10) {
+      colors[n-1] = colors[0];
+      colors[n/2] = colors[1];
+    }
+
+    PaletteBestfit bestfit(colors);
+    for (int j=0; j<20000; ++j) {
+      const color_t c = random_color();
+      const int r = rgba_getr(c);
+      const int g = rgba_getg(c);
+      const int b = rgba_getb(c);
+      const int a = rgba_geta(c);
+      const int mask = (std::rand() % (n+1)) - 1;
+      ASSERT_EQ(bruteforce_bestfit(colors, r, g, b, a, mask),
+                bestfit.findBestfit(r, g, b, a, mask));
+    }
+  }
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,6 +14,7 @@
 #include "doc/algo.h"
 #include "doc/brush.h"
 #include "doc/dispatch.h"
+#include "doc/hash64.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/remap.h"
@@ -21,8 +22,6 @@
 #include "doc/tile.h"
 #include "gfx/region.h"
 
-#include <city.h>
-
 #include <stdexcept>
 
 #if defined(__x86_64__) || defined(_WIN64)
@@ -539,44 +538,33 @@ void remap_image(Image* image, const Remap& remap)
   }
 }
 
-// TODO test this hash routine and find a better alternative
-
-template <typename ImageTraits, uint32_t Mask>
+template <typename ImageTraits>
 static uint32_t calculate_image_hash_templ(const Image* image,
                                            const gfx::Rect& bounds)
 {
-#if defined(__LP64__) || defined(__x86_64__) || defined(_WIN64)
-  #define CITYHASH(buf, len) (CityHash64(buf, len) & 0xffffffff)
-  static_assert(sizeof(void*) == 8, "This CPU is not 64-bit");
-#else
-  #define CITYHASH(buf, len) CityHash32(buf, len)
-  static_assert(sizeof(void*) == 4, "This CPU is not 32-bit");
-#endif
-
+  Hash64 hash;
   const uint32_t widthBytes = ImageTraits::bytes_per_pixel * bounds.w;
-  const uint32_t len = widthBytes * bounds.h;
   if (bounds == image->bounds() &&
       widthBytes == image->rowBytes()) {
-    return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
+    hash.update(image->getPixelAddress(0, 0), widthBytes * bounds.h);
   }
   else {
-    std::vector<uint8_t> buf(len);
-    uint8_t* dst = &buf[0];
-    for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
-      auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
-      std::copy(src, src+widthBytes, dst);
-    }
-    return CITYHASH((const char*)&buf[0], buf.size());
+    // Hash row by row (same result as hashing all the rows
+    // together in a contiguous buffer)
+    for (int y=0; y<bounds.h; ++y)
+      hash.update(image->getPixelAddress(bounds.x, bounds.y+y), widthBytes);
   }
+  const uint64_t h = hash.digest();
+  return uint32_t(h ^ (h >> 32));
 }
 
 uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
 {
   switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_rgb_mask>(img, bounds);
-    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_v_mask>(img, bounds);
-    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits, 0xff>(img, bounds);
-    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits, 1>(img, bounds);
+    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits>(img, bounds);
+    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits>(img, bounds);
+    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits>(img, bounds);
+    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits>(img, bounds);
   }
   ASSERT(false);
   return 0;
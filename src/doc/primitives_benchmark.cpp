@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,9 +14,34 @@
 #include "doc/image_ref.h"
 
 #include <benchmark/benchmark.h>
+#include <city.h>
+
+#include <vector>
 
 using namespace doc;
 
+// Old calculate_image_hash() implementation (CityHash copying the
+// bounds to a temporary buffer when they don't cover full rows)
+static uint32_t calculate_image_hash_cityhash(const Image* image,
+                                              const gfx::Rect& bounds)
+{
+  const uint32_t widthBytes = image->bytesPerPixel() * bounds.w;
+  const uint32_t len = widthBytes * bounds.h;
+  if (bounds == image->bounds() &&
+      widthBytes == image->rowBytes()) {
+    return CityHash64((const char*)image->getPixelAddress(0, 0), len) & 0xffffffff;
+  }
+  else {
+    std::vector<uint8_t> buf(len);
+    uint8_t* dst = &buf[0];
+    for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
+      auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
+      std::copy(src, src+widthBytes, dst);
+    }
+    return CityHash64((const char*)&buf[0], buf.size()) & 0xffffffff;
+  }
+}
+
 void BM_IsSameImageOld(benchmark::State& state) {
   const auto pf = (PixelFormat)state.range(0);
   const int w = state.range(1);
@@ -52,6 +77,51 @@ void BM_IsSameImageNew(benchmark::State& state) {
    ->Args({ IMAGE_INDEXED, 1024, 1024 })                         \
    ->Args({ IMAGE_INDEXED, 8192, 8192 })
 
+// state.range(3) == 1 to hash a sub-rectangle (without full rows)
+static gfx::Rect hash_bounds(const benchmark::State& state, const Image* image)
+{
+  gfx::Rect bounds = image->bounds();
+  if (state.range(3))
+    bounds.shrink(1);
+  return bounds;
+}
+
+void BM_ImageHashCityHash(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  const gfx::Rect bounds = hash_bounds(state, a.get());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(calculate_image_hash_cityhash(a.get(), bounds));
+  }
+  state.SetBytesProcessed(state.iterations() * bounds.w * bounds.h * a->bytesPerPixel());
+}
+
+void BM_ImageHash(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  const gfx::Rect bounds = hash_bounds(state, a.get());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(calculate_image_hash(a.get(), bounds));
+  }
+  state.SetBytesProcessed(state.iterations() * bounds.w * bounds.h * a->bytesPerPixel());
+}
+
+#define HASHARGS()                                               \
+   ->Args({ IMAGE_RGB, 16, 16, 0 })                              \
+   ->Args({ IMAGE_RGB, 16, 16, 1 })                              \
+   ->Args({ IMAGE_RGB, 1024, 1024, 0 })                          \
+   ->Args({ IMAGE_RGB, 1024, 1024, 1 })                          \
+   ->Args({ IMAGE_INDEXED, 16, 16, 0 })                          \
+   ->Args({ IMAGE_INDEXED, 16, 16, 1 })                          \
+   ->Args({ IMAGE_INDEXED, 1024, 1024, 0 })                      \
+   ->Args({ IMAGE_INDEXED, 1024, 1024, 1 })
+
 BENCHMARK(BM_IsSameImageOld)
   DEFARGS()
   ->UseRealTime();
@@ -60,4 +130,12 @@ BENCHMARK(BM_IsSameImageNew)
   DEFARGS()
   ->UseRealTime();
 
+BENCHMARK(BM_ImageHashCityHash)
+  HASHARGS()
+  ->UseRealTime();
+
+BENCHMARK(BM_ImageHash)
+  HASHARGS()
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
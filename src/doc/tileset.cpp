@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,19 +11,95 @@
 #include "doc/tileset.h"
 
 #include "doc/tilesets.h"
+#include "doc/algorithm/flip_image.h"
+#include "doc/dispatch.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "base/mem_utils.h"
 #include "doc/primitives.h"
+#include "doc/primitives_fast.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 
 #define TS_TRACE(...) // TRACE(__VA_ARGS__)
 
 namespace doc {
 
+namespace {
+
+// Order used to match flipped tiles (the first combination of flips
+// in this list has priority over the next ones).
+const tile_flags kFlipsOrder[] = {
+  0,
+  tile_f_xflip,
+  tile_f_yflip,
+  tile_f_xflip | tile_f_yflip,
+  tile_f_dflip,
+  tile_f_xflip | tile_f_dflip,
+  tile_f_xflip | tile_f_yflip | tile_f_dflip,
+  tile_f_yflip | tile_f_dflip,
+};
+
+int flips_priority(const tile_flags tf)
+{
+  for (int i=0; i<int(sizeof(kFlipsOrder)/sizeof(kFlipsOrder[0])); ++i)
+    if (kFlipsOrder[i] == tf)
+      return i;
+  ASSERT(false);
+  return std::numeric_limits<int>::max();
+}
+
+// Returns true if "image" is equal to "tile" after applying the "tf"
+// flips to the tile (same flips used when a tile is rendered, see
+// get_tile_pixel()).
+template<typename ImageTraits>
+bool is_same_flipped_tile_templ(const Image* image,
+                                const Image* tile,
+                                const tile_flags tf)
+{
+  const int w = image->width();
+  const int h = image->height();
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      int u = x, v = y;
+      if (tf & tile_f_xflip) { u = w-u-1; }
+      if (tf & tile_f_yflip) { v = h-v-1; }
+      if (tf & tile_f_dflip) { std::swap(u, v); }
+      if (get_pixel_fast<ImageTraits>(image, x, y) !=
+          get_pixel_fast<ImageTraits>(tile, u, v))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool is_same_flipped_tile(const Image* image,
+                          const Image* tile,
+                          const tile_flags tf)
+{
+  if (tf == 0)
+    return is_same_image(image, tile);
+
+  if (image->colorMode() != tile->colorMode() ||
+      image->width() != tile->width() ||
+      image->height() != tile->height())
+    return false;
+
+  DOC_DISPATCH_BY_COLOR_MODE(
+    image->colorMode(),
+    is_same_flipped_tile_templ,
+    image, tile, tf);
+
+  ASSERT(false);
+  return false;
+}
+
+} // anonymous namespace
+
 // static
 UserData Tileset::kNoUserData;
 
@@ -218,8 +294,8 @@ void Tileset::insert(const tile_index ti,
   if (!m_hash.empty()) {
     // Fix all indexes in the hash that are greater than "ti"
     for (auto& it : m_hash)
-      if (it.second >= ti)
-        ++it.second;
+      if (it.second.ti >= ti)
+        ++it.second.ti;
 
     // And now we can add the new image with the "ti" index
     hashImage(ti, image);
@@ -250,27 +326,78 @@ void Tileset::setExternal(const std::string& filename,
   m_external.tileset = tsi;
 }
 
+void Tileset::setMatchFlags(const tile_flags tf)
+{
+  if (m_matchFlags != tf) {
+    m_matchFlags = tf;
+
+    // Flipped versions of tiles are hashed depending on the match
+    // flags, so we have to re-create the hash table.
+    m_hash.clear();
+  }
+}
+
 bool Tileset::findTileIndex(const ImageRef& tileImage,
                             tile_index& ti)
 {
   ASSERT(tileImage);
-  if (!tileImage) {
+  tile_flags tf;
+  if (!tileImage || !findTile(tileImage.get(), 0, ti, tf)) {
     ti = notile;
     return false;
   }
+  return true;
+}
 
+bool Tileset::findTileIndex(const ImageRef& tileImage,
+                            tile_index& ti,
+                            tile_flags& tf)
+{
+  ASSERT(tileImage);
+  if (!tileImage || !findTile(tileImage.get(), m_matchFlags, ti, tf)) {
+    ti = notile;
+    tf = 0;
+    return false;
+  }
+  return true;
+}
+
+bool Tileset::findTile(const Image* tileImage,
+                       const tile_flags allowedFlags,
+                       tile_index& ti,
+                       tile_flags& tf)
+{
   auto& h = hashTable(); // Don't use m_hash directly in case that
                          // we've to regenerate the hash table.
 
-  auto it = h.find(tileImage);
-  if (it != h.end()) {
-    ti = it->second;
-    return true;
-  }
-  else {
-    ti = notile;
-    return false;
+  bool found = false;
+  int bestPriority = 0;
+  auto range = h.equal_range(
+    calculate_image_hash(tileImage, tileImage->bounds()));
+  for (auto it=range.first; it!=range.second; ++it) {
+    const TileMatch& match = it->second;
+    if (match.tf & ~allowedFlags)
+      continue;
+
+    // Prefer less flips, and then the lowest tile index
+    const int priority = flips_priority(match.tf);
+    if (found &&
+        (priority > bestPriority ||
+         (priority == bestPriority && match.ti >= ti)))
+      continue;
+
+    ASSERT(match.ti >= 0 && match.ti < size());
+    if (!is_same_flipped_tile(tileImage,
+                              m_tiles[match.ti].image.get(),
+                              match.tf))
+      continue;
+
+    found = true;
+    bestPriority = priority;
+    ti = match.ti;
+    tf = match.tf;
   }
+  return found;
 }
 
 void Tileset::notifyTileContentChange(const tile_index ti)
@@ -332,13 +459,13 @@ void Tileset::removeFromHash(const tile_index ti,
 {
   auto end = m_hash.end();
   for (auto it=m_hash.begin(); it!=end; ) {
-    if (it->second == ti) {
+    if (it->second.ti == ti) {
       it = m_hash.erase(it);
       end = m_hash.end();
     }
     else {
-      if (adjustIndexes && it->second > ti)
-        --it->second;
+      if (adjustIndexes && it->second.ti > ti)
+        --it->second.ti;
       ++it;
     }
   }
@@ -352,39 +479,53 @@ void Tileset::assertValidHashTable()
   if (m_hash.empty())
     return;
 
-  // If two or more tiles are exactly the same, they will have the
-  // same hash, so the m_hash table can be smaller than the m_tiles
-  // array.
-  if (m_hash.size() < m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-
-      // If the hash doesn't match, it is because other tile is equal
-      // to this one.
-      if (it->second != ti) {
-        ASSERT(is_same_image(it->first.get(), m_tiles[it->second].image.get()));
-      }
-    }
-  }
-  else if (m_hash.size() == m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-      ASSERT(it->second == ti);
+  for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
+    tile_index ti2;
+    tile_flags tf;
+    const bool found = findTile(m_tiles[ti].image.get(), 0, ti2, tf);
+    ASSERT(found);
+    ASSERT(tf == 0);
+
+    // If the index doesn't match, it is because other tile is equal
+    // to this one.
+    if (found && ti2 != ti) {
+      ASSERT(is_same_image(m_tiles[ti].image.get(), m_tiles[ti2].image.get()));
     }
   }
-  else {
-    ASSERT(false && "The hash table cannot contain more tiles than the tileset");
-  }
 }
 #endif
 
 void Tileset::hashImage(const tile_index ti,
                         const ImageRef& tileImage)
 {
-  if (m_hash.find(tileImage) == m_hash.end())
-    m_hash[tileImage] = ti;
+  const Image* image = tileImage.get();
+  const gfx::Rect bounds = image->bounds();
+  m_hash.emplace(calculate_image_hash(image, bounds), TileMatch{ ti, 0 });
+
+  // Hash the flipped versions of the tile that can be matched
+  ImageRef flipped;
+  for (const tile_flags tf : kFlipsOrder) {
+    if (tf == 0 || (tf & ~m_matchFlags))
+      continue;
+
+    // Diagonal flips are possible only for square tiles
+    if ((tf & tile_f_dflip) && bounds.w != bounds.h)
+      continue;
+
+    if (!flipped)
+      flipped.reset(Image::createCopy(image));
+    else
+      copy_image(flipped.get(), image);
+
+    if (tf & tile_f_dflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipDiagonal);
+    if (tf & tile_f_yflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipVertical);
+    if (tf & tile_f_xflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipHorizontal);
+
+    m_hash.emplace(calculate_image_hash(flipped.get(), bounds), TileMatch{ ti, tf });
+  }
 }
 
 void Tileset::rehash()
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -62,7 +62,7 @@ namespace doc {
     // Allow to match tiles with the given flags/flips automatically
     // in Auto/Stack modes.
     tile_flags matchFlags() const { return m_matchFlags; }
-    void setMatchFlags(const tile_flags tf) { m_matchFlags = tf; }
+    void setMatchFlags(const tile_flags tf);
 
     // Cached compressed tileset read/writen directly from .aseprite
     // files.
@@ -127,6 +127,15 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Same as findTileIndex() but it can match flipped versions of
+    // the tiles too (only flips allowed by matchFlags()). Returns in
+    // "tf" the flips that must be applied to the "ti" tile to get the
+    // given "tileImage". Without flips are preferred, then X, Y, X+Y,
+    // D, X+D, X+Y+D, and Y+D flips. The given image is not modified.
+    bool findTileIndex(const ImageRef& tileImage,
+                       tile_index& ti,
+                       tile_flags& tf);
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
@@ -143,6 +152,10 @@ namespace doc {
 #endif
 
   private:
+    bool findTile(const Image* tileImage,
+                  const tile_flags allowedFlags,
+                  tile_index& ti,
+                  tile_flags& tf);
     void removeFromHash(const tile_index ti,
                         const bool adjustIndexes);
     void hashImage(const tile_index ti,
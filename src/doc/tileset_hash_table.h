@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,6 +8,7 @@
 #define DOC_TILESET_HASH_TABLE_H_INCLUDED
 #pragma once
 
+#include "base/ints.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
 #include "doc/images_map.h"
@@ -18,11 +19,19 @@
 
 namespace doc {
 
+  // A tile index with the flips that must be applied to the tile
+  // image to get the hashed pixels.
+  struct TileMatch {
+    tile_index ti;
+    tile_flags tf;
+  };
+
   // A hash table used to match Image pixels data <-> tileset index
-  typedef std::unordered_map<ImageRef,
-                             tile_index,
-                             details::image_hash,
-                             details::image_eq> TilesetHashTable;
+  // (+flips). The key is the calculate_image_hash() of the tile image
+  // (or a flipped version of it), so the pixels of each candidate
+  // must be compared to confirm the match.
+  typedef std::unordered_multimap<uint32_t,
+                                  TileMatch> TilesetHashTable;
 
 } // namespace doc
 
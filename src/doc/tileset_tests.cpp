@@ -0,0 +1,96 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+#include <memory>
+
+using namespace doc;
+
+static ImageRef make_tile(const Tileset& tileset, const int seed)
+{
+  const gfx::Size size = tileset.grid().tileSize();
+  ImageRef image(Image::create(IMAGE_RGB, size.w, size.h));
+  for (int y=0; y<size.h; ++y)
+    for (int x=0; x<size.w; ++x)
+      put_pixel(image.get(), x, y, rgba(x*16, y*16, seed, 255));
+  return image;
+}
+
+static ImageRef flip(const ImageRef& image, const tile_flags tf)
+{
+  ImageRef copy(Image::createCopy(image.get()));
+  if (tf & tile_f_dflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipDiagonal);
+  if (tf & tile_f_yflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipVertical);
+  if (tf & tile_f_xflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipHorizontal);
+  return copy;
+}
+
+TEST(Tileset, FindFlippedTiles)
+{
+  std::unique_ptr<Sprite> sprite(
+    new Sprite(ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Tileset tileset(sprite.get(), Grid::MakeRect(gfx::Size(8, 8)), 1);
+
+  ImageRef a = make_tile(tileset, 1);
+  ImageRef b = make_tile(tileset, 2);
+  EXPECT_EQ(1, tileset.add(a));
+  EXPECT_EQ(2, tileset.add(b));
+
+  tile_index ti;
+  tile_flags tf;
+
+  // Without match flags only unflipped tiles are found
+  EXPECT_TRUE(tileset.findTileIndex(flip(b, 0), ti, tf));
+  EXPECT_EQ(2, ti);
+  EXPECT_EQ(0, tf);
+  EXPECT_FALSE(tileset.findTileIndex(flip(b, tile_f_xflip), ti, tf));
+
+  tileset.setMatchFlags(tile_f_xflip | tile_f_yflip | tile_f_dflip);
+  int seed = 10;
+  for (const tile_flags flags : { tile_f_xflip,
+                                  tile_f_yflip,
+                                  tile_f_xflip | tile_f_yflip,
+                                  tile_f_dflip,
+                                  tile_f_xflip | tile_f_dflip,
+                                  tile_f_xflip | tile_f_yflip | tile_f_dflip,
+                                  tile_f_yflip | tile_f_dflip }) {
+    ImageRef image = flip(a, flags);
+    ImageRef original(Image::createCopy(image.get()));
+    EXPECT_TRUE(tileset.findTileIndex(image, ti, tf));
+    EXPECT_EQ(1, ti);
+    EXPECT_EQ(flags, tf);
+    EXPECT_TRUE(is_same_image(original.get(), image.get()));
+
+    // Tiles added later are hashed incrementally
+    ImageRef c = make_tile(tileset, ++seed);
+    const tile_index ci = tileset.add(c);
+    EXPECT_TRUE(tileset.findTileIndex(flip(c, flags), ti, tf));
+    EXPECT_EQ(ci, ti);
+    EXPECT_EQ(flags, tf);
+  }
+
+  // Only allowed flips are matched
+  tileset.setMatchFlags(tile_f_yflip);
+  EXPECT_FALSE(tileset.findTileIndex(flip(a, tile_f_xflip), ti, tf));
+  EXPECT_TRUE(tileset.findTileIndex(flip(a, tile_f_yflip), ti, tf));
+  EXPECT_EQ(1, ti);
+  EXPECT_EQ(tile_f_yflip, tf);
+}
@@ -126,7 +126,6 @@ int app_main(int argc, char* argv[])
     base::SystemConsole systemConsole;
     app::AppOptions options(argc, const_cast<const char**>(argv));
     os::SystemRef system(os::make_system());
-    doc::Palette::initBestfit();
     app::App app;
 
 #if ENABLE_SENTRY
@@ -432,3 +432,53 @@ for i = 1,#frames do
 end
 EOF
 $ASEPRITE -b -script "$d/compare.lua" || exit 1
+
+# --jobs --split-layers --split-tags --save-as
+# Files saved in parallel must be equal to the files saved serially
+d=$t/save-as-jobs
+$ASEPRITE -b sprites/abcd.aseprite sprites/tags3.aseprite \
+          -split-layers -split-tags -save-as "$d/serial/{title}-{layer}-{tag}{frame}.png" || exit 1
+$ASEPRITE -b -jobs 4 sprites/abcd.aseprite sprites/tags3.aseprite \
+          -split-layers -split-tags -save-as "$d/jobs/{title}-{layer}-{tag}{frame}.png" || exit 1
+expect "$(list_files $d/serial)" "list_files $d/jobs"
+for f in $(list_files $d/serial) ; do
+  cmp "$d/serial/$f" "$d/jobs/$f" || exit 1
+done
+for f in 2x2tilemap2x2tile link slices ; do
+  $ASEPRITE -b sprites/$f.aseprite -save-as "$d/serial/$f.aseprite" || exit 1
+  $ASEPRITE -b -jobs 2 sprites/$f.aseprite -save-as "$d/jobs/$f.aseprite" || exit 1
+  cmp "$d/serial/$f.aseprite" "$d/jobs/$f.aseprite" || exit 1
+done
+# Same frames/tags with --tag, --frame-range and --play-subtags
+for opts in "-tag reverse" "-tag pingpong -frame-range 1,2" \
+            "-frame-range 2,5" "-play-subtags" ; do
+  f=$(echo $opts | tr -d ' ,-')
+  for ext in gif png ; do
+    $ASEPRITE -b $opts sprites/tags3x123reps.aseprite \
+              -save-as "$d/serial/$f-{frame}.$ext" || exit 1
+    $ASEPRITE -b -jobs 2 $opts sprites/tags3x123reps.aseprite \
+              -save-as "$d/jobs/$f-{frame}.$ext" || exit 1
+  done
+done
+expect "$(list_files $d/serial)" "list_files $d/jobs"
+for f in $(list_files $d/serial) ; do
+  cmp "$d/serial/$f" "$d/jobs/$f" || exit 1
+done
+
+# Frames of a sequence are saved/loaded in several threads, but they
+# must keep their order
+d=$t/save-as-sequence-order
+$ASEPRITE -b sprites/tags3.aseprite -save-as "$d/frame00.png" || exit 1
+cat >$d/compare.lua <<EOF
+local orig = app.open("sprites/tags3.aseprite")
+app.command.OpenFile{ filename="$d/frame00.png", sequence="yes" }
+local seq = app.sprite
+assert(#seq.frames == #orig.frames)
+for f = 1,#orig.frames do
+  local img = Image(orig.spec)
+  img:clear()
+  img:drawSprite(orig, f)
+  assert(seq.layers[1]:cel(f).image:isEqual(img))
+end
+EOF
+$ASEPRITE -b -script "$d/compare.lua" || exit 1
@@ -0,0 +1,23 @@
+#! /bin/bash
+# Copyright (C) 2024 Igara Studio S.A.
+
+# --server processes one request per line from stdin
+d=$t/server
+mkdir -p $d
+cat >$d/requests.txt <<EOF2
+sprites/1empty3.aseprite --list-tags
+sprites/abcd.aseprite --save-as "$d/abcd image.png"
+
+--jobs 2 sprites/tags3.aseprite --split-tags --save-as $d/tags3-{tag}.gif
+exit
+sprites/abcd.aseprite --save-as $d/not-saved.png
+EOF2
+$ASEPRITE -b --server <$d/requests.txt >$d/output.txt || exit 1
+expect "a
+b
+done 0
+done 0
+done 0" "cat $d/output.txt"
+[ -f "$d/abcd image.png" ] || fail
+[ -f "$d/tags3-forward.gif" ] || fail
+[ ! -f "$d/not-saved.png" ] || fail
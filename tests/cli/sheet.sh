@@ -164,6 +164,94 @@ assert(#sheet2.frames == 4)
 EOF
 $ASEPRITE -b -script "$d/check.lua" || exit 1
 
+# -sheet-pack-algorithm
+
+d=$t/sheet-pack-algorithm
+for algorithm in maxrects skyline ; do
+    $ASEPRITE -b \
+	      -layer "c" \
+	      "sprites/tags3.aseprite" \
+	      -trim \
+	      -sheet-pack-algorithm $algorithm \
+	      -sheet "$d/sheet-$algorithm.png" \
+	      -format json-array \
+	      -data "$d/sheet-$algorithm.json" || exit 1
+done
+
+cat >$d/check.lua <<EOF
+for _,algorithm in ipairs({ 'maxrects', 'skyline' }) do
+  local sheet = json.decode(io.open('$d/sheet-' .. algorithm .. '.json'):read('a'))
+  assert(#sheet.frames == 12)
+  for i = 1,#sheet.frames do
+    for j = i+1,#sheet.frames do
+      local a = sheet.frames[i].frame
+      local b = sheet.frames[j].frame
+      -- Duplicated frames share the same area
+      assert((a.x == b.x and a.y == b.y) or
+             a.x+a.w <= b.x or b.x+b.w <= a.x or
+             a.y+a.h <= b.y or b.y+b.h <= a.y)
+    end
+  end
+end
+EOF
+$ASEPRITE -b -script "$d/check.lua" || exit 1
+
+# Unknown algorithms are rejected (instead of using the default one)
+if $ASEPRITE -b "sprites/tags3.aseprite" \
+	     -sheet-pack-algorithm unknown \
+	     -sheet "$d/sheet-unknown.png" 2>/dev/null ; then
+    fail "-sheet-pack-algorithm with an unknown algorithm must fail"
+fi
+[ -f "$d/sheet-unknown.png" ] && fail "$d/sheet-unknown.png must not be created"
+
+# -sheet-cache
+
+d=$t/sheet-cache
+for i in 1 2 ; do
+    $ASEPRITE -b \
+	      "sprites/tags3.aseprite" \
+	      -trim -sheet-pack \
+	      -sheet-cache "$d/cache" \
+	      -sheet "$d/sheet$i.png" \
+	      -format json-array \
+	      -data "$d/sheet$i.json" || exit 1
+done
+cat >$d/check.lua <<EOF
+local sheet1 = json.decode(io.open('$d/sheet1.json'):read('a'))
+local sheet2 = json.decode(io.open('$d/sheet2.json'):read('a'))
+assert(#sheet1.frames == #sheet2.frames)
+for i = 1,#sheet1.frames do
+  local a = sheet1.frames[i].frame
+  local b = sheet2.frames[i].frame
+  assert(a.x == b.x and a.y == b.y and a.w == b.w and a.h == b.h)
+end
+local img1 = Image{ fromFile='$d/sheet1.png' }
+local img2 = Image{ fromFile='$d/sheet2.png' }
+assert(img1:isEqual(img2))
+EOF
+$ASEPRITE -b -script "$d/check.lua" || exit 1
+
+# -sheet-cache directory can be shared by several sprite sheets (the
+# entries of other sheets and other files in the directory are kept)
+
+echo "not a cache entry" > "$d/cache/0123456789abcdef.bin"
+n=$(ls "$d/cache"/*.bin | wc -l)
+for cache in cache cache2 ; do
+    $ASEPRITE -b \
+	      "sprites/abcd.aseprite" \
+	      -sheet-cache "$d/$cache" \
+	      -sheet "$d/$cache.png" || exit 1
+done
+if [ "$(ls "$d/cache"/*.bin | wc -l)" != "$(( $n + $(ls "$d/cache2"/*.bin | wc -l) ))" ] ; then
+    fail "-sheet-cache should keep entries of other sprite sheets"
+fi
+if [ ! -f "$d/cache/0123456789abcdef.bin" ] ; then
+    fail "-sheet-cache removed a file that is not a cache entry"
+fi
+if ls "$d/cache"/*.tmp >/dev/null 2>&1 ; then
+    fail "-sheet-cache should not leave temporary files"
+fi
+
 # -sheet -sheet-columns vs -sheet-rows
 
 d=$t/sheet-columns-and-rows
@@ -155,6 +155,20 @@ do
   assert(#s.frames == 2)
 end
 
+-- Sprite{ fromFile, metadataOnly }
+do
+  local a = Sprite{ fromFile="sprites/abcd.aseprite" }
+  local b = Sprite{ fromFile="sprites/abcd.aseprite", metadataOnly=true }
+  assert(#b.layers == #a.layers)
+  assert(#b.frames == #a.frames)
+  assert(#b.tags == #a.tags)
+  assert(b.width == a.width)
+  assert(b.height == a.height)
+  assert(b.colorMode == a.colorMode)
+  assert(#a.cels > 0)
+  assert(#b.cels == 0)
+end
+
 -- Issues with sprites having pixel with indexes out of palette bounds:
 -- Saving png failed (https://github.com/aseprite/aseprite/issues/2842)
 do